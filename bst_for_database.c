@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "report_output.h" // Buffered table output and printLine
+#include "op_stats.h"      // Operation counters and latency histograms
 
 // ANSI color codes
 #define RESET       "\033[0m"
@@ -13,15 +15,23 @@
 
 /*
 Compile the code using:
-gcc bst_for_database.c -o database
+gcc bst_for_database.c -o database -lpthread
+(add -DOP_STATS_DISABLE to compile out the operation statistics)
 
 Run the program:
 ./database
 */
 
-
-// Function declaration for printLine
-void printLine(char ch, int length);
+// Operations timed for the statistics menu
+enum {
+    OP_INSERT_PRODUCT,
+    OP_SEARCH_PRODUCT,
+    OP_DISPLAY_PRODUCTS,
+    OP_SORT_PRODUCTS,
+    OP_COUNT
+};
+static const char* const opNames[OP_COUNT] = {"insert_product", "search_product", "display_products",
+                                              "sort_products"};
 
 // Structure for a product
 typedef struct Product {
@@ -194,20 +204,44 @@ void collectProducts(Product* node, Product** products, int* count) {
     collectProducts(node->right, products, count);
 }
 
+// Function to add one product row to a report
+void reportProduct(ReportOutput* out, const Product* product) {
+    reportFormat(out, "| %-8d | %-20s | %-10.2f | %-10d |\n", product->id, product->name, product->price,
+                 product->quantity);
+}
+
 // Function to display products in a tabular format (in-order traversal)
-void displayProducts(Product* root) {
+void displayProducts(ReportOutput* out, Product* root) {
     if (root == NULL) {
         return; // If there are no products, exit the function
     }
 
     // Traverse left subtree
-    displayProducts(root->left);
+    displayProducts(out, root->left);
 
     // Print current node
-    printf("| %-8d | %-20s | %-10.2f | %-10d |\n", root->id, root->name, root->price, root->quantity);
+    reportProduct(out, root);
 
     // Traverse right subtree
-    displayProducts(root->right);
+    displayProducts(out, root->right);
+}
+
+// Function to start a product table with its header
+ReportOutput* beginProductTable(void) {
+    ReportOutput* out = reportBegin();
+    reportStyle(out, CYAN);
+    reportFormat(out, "\n| %-8s | %-20s | %-10s | %-10s |\n", "Item ID", "Item Name", "Price", "Quantity");
+    reportStyle(out, "");
+    reportRepeat(out, '-', 65);
+    reportText(out, "\n");
+    return out;
+}
+
+// Function to close a product table
+void endProductTable(ReportOutput* out) {
+    reportRepeat(out, '-', 65);
+    reportText(out, "\n");
+    reportEnd(out);
 }
 
 // Function to sort and display products based on a given criteria
@@ -240,12 +274,11 @@ void displaySortedProducts(Product* root, int choice) {
     printf(GREEN "\nSorted by %s" RESET, sortBy);
 
     // Print sorted products
-    printf("\n| %-8s | %-20s | %-10s | %-10s |\n", "Item ID", "Item Name", "Price", "Quantity");
-    printLine('-', 65);
+    ReportOutput* out = beginProductTable();
     for (int i = 0; i < count; i++) {
-        printf("| %-8d | %-20s | %-10.2f | %-10d |\n", products[i]->id, products[i]->name, products[i]->price, products[i]->quantity);
+        reportProduct(out, products[i]);
     }
-    printLine('-', 65);
+    endProductTable(out);
 }
 
 // Forward declaration of the helper function
@@ -282,20 +315,13 @@ void trackOutOfStock(Product* root) {
     }
 }
 
-// Function to print decorative lines
-void printLine(char ch, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", ch);
-    }
-    printf("\n");
-}
-
 // Main function
 int main() {
     Product* root = NULL;
     int choice, id, quantity;
     char name[100];
     float price;
+    opStatsInit("database", opNames, OP_COUNT);
 
     do {
         printLine('-', 50);
@@ -307,7 +333,9 @@ int main() {
         printf("4. Display All Products\n");
         printf("5. Sort Products\n");
         printf("6. Track Out-of-Stock Products\n");
-        printf("7. Exit\n" );
+        printf("7. Operation Statistics\n");
+        printf("8. Save Statistics\n");
+        printf("9. Exit\n" );
         printLine('-', 50);
         printf(BLUE "Enter your choice: " RESET);
         scanf("%d", &choice);
@@ -358,13 +386,17 @@ int main() {
     quantity = atoi(name);
 
     // Insert the product using the correct name variable
+    OP_STATS_START(insertTimer);
     root = insertProduct(root, id, productName, price, quantity);
+    OP_STATS_STOP(OP_INSERT_PRODUCT, insertTimer);
     printf(GREEN "Product added: %s (ID: %d)\n" RESET, productName, id);
     break;
             case 2:
                 printf(BLUE"Enter Product Name to Search: "RESET);
                 scanf(" %[^\n]", name);
+                OP_STATS_START(searchTimer);
                 Product* foundProduct = searchProduct(root, name);
+                OP_STATS_STOP(OP_SEARCH_PRODUCT, searchTimer);
                 if (foundProduct != NULL) {
                     printf(GREEN "Product found: ID: %d, Name: %s, Price: %.2f, Quantity: %d\n" RESET,
                            foundProduct->id, foundProduct->name, foundProduct->price, foundProduct->quantity);
@@ -381,10 +413,11 @@ int main() {
                 if (root == NULL) {
                     printf(RED "No products available to display.\n" RESET);
                 } else {
-                    printf(CYAN "\n| %-8s | %-20s | %-10s | %-10s |\n", "Item ID", "Item Name", "Price", "Quantity" RESET);
-                    printLine('-', 65);
-                    displayProducts(root);
-                    printLine('-', 65);
+                    OP_STATS_START(displayTimer);
+                    ReportOutput* out = beginProductTable();
+                    displayProducts(out, root);
+                    endProductTable(out);
+                    OP_STATS_STOP(OP_DISPLAY_PRODUCTS, displayTimer);
                 }
                 break;
             case 5:
@@ -396,19 +429,33 @@ int main() {
                 printf(BLUE "Enter your choice: " RESET);
                 int sortChoice;
                 scanf("%d", &sortChoice);
+                OP_STATS_START(sortTimer);
                 displaySortedProducts(root, sortChoice);
+                OP_STATS_STOP(OP_SORT_PRODUCTS, sortTimer);
                 break;
             case 6:
                 printf("Out-of-Stock Products:\n");
                 trackOutOfStock(root);
                 break;
             case 7:
+                opStatsPrint();
+                break;
+            case 8:
+                printf(BLUE "Enter a file to save to (.json for JSON, other names for Prometheus text): " RESET);
+                scanf(" %[^\n]", name);
+                if (opStatsSave(name)) {
+                    printf(GREEN "Statistics saved to %s\n" RESET, name);
+                } else {
+                    printf(RED "Could not write %s\n" RESET, name);
+                }
+                break;
+            case 9:
                 printf(RED "Exiting...\n" RESET);
                 break;
             default:
                 printf(RED "Invalid choice. Please try again.\n" RESET);
         }
-    } while (choice != 7);
+    } while (choice != 9);
 
     return 0;
 }
\ No newline at end of file
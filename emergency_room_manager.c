@@ -1,17 +1,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "report_output.h" // Buffered queue listings and printLine
+#include "op_stats.h"      // Operation counters and latency histograms
 
 /*
 Compile the Code: 
-gcc patient_management_system.c -o patient_management
+gcc emergency_room_manager.c -o patient_management -lpthread -lm
+(add -DPQ_BACKEND=PQ_QUATERNARY or -DPQ_BACKEND=PQ_PAIRING to pick another heap backend)
+(add -DOP_STATS_DISABLE to compile out the operation statistics)
 
 Run the Program:
-./patient_management
+./patient_management [--queue=heap|bucket] [--aging=SECONDS,MAX_BOOST] [--journal=PATH]
+./patient_management batch FILE|- [same options]   (apply one batch of admissions/updates and exit)
+./patient_management concurrent [desks] [doctors] [patients per desk]
+./patient_management departments [doctors per lane] [patients per desk]
+./patient_management simulate [options]   (see runSimulationMode)
+./patient_management bench-queue [operations]
+./patient_management bench-batch [patients]
 */
 
 
-#define MAX_PATIENTS 100
+#define INITIAL_CAPACITY 16     // Patients allocated before the queue first grows
+#define MAX_NAME_LENGTH 50
+#define MAX_SEVERITY 10
+#define NUM_SEVERITIES (MAX_SEVERITY + 1)
+#define MAX_AGING_BOOST 10       // Largest priority bonus aging can add to a severity
+#define NUM_PRIORITIES (NUM_SEVERITIES + MAX_AGING_BOOST)
+#define DASHBOARD_ROWS 10        // Rows shown when the queue is refreshed after each action
+#define CURSOR_INLINE_SLOTS 32   // Frontier slots a cursor holds before allocating
+#define CONCURRENT_RING_CAPACITY 65536 // Waiting patients per severity in the concurrent queue
+#define CACHE_LINE_SIZE 64
+#define DEPARTMENT_TREATMENT_WORK 2000  // Busy-loop iterations standing in for one treatment in the department demo
+#define JOURNAL_SYNC_BATCH 32         // Journal records covered by one fsync
+#define JOURNAL_SYNC_INTERVAL 1.0     // Seconds a journal record may wait for its fsync
+#define JOURNAL_SNAPSHOT_EVERY 10000  // Journal records between compact snapshots
+#define SNAPSHOT_MAGIC 0x31535245u    // "ERS1"
 
 // ANSI color codes for styling
 #define RESET "\033[0m"
@@ -23,173 +57,3077 @@ Run the Program:
 #define CYAN "\033[36m"
 #define MAGENTA "\033[35m"
 
+// Queue operations timed for the statistics menu (and for OP_STATS_DUMP in the other modes)
+enum {
+    OP_ADMIT_PATIENT,
+    OP_TREAT_PATIENT,
+    OP_UPDATE_SEVERITY,
+    OP_REMOVE_PATIENT,
+    OP_APPLY_BATCH,
+    OP_COUNT
+};
+static const char* const opNames[OP_COUNT] = {"admit_patient", "treat_patient", "update_severity", "remove_patient",
+                                              "apply_batch"};
+// Heap backends, chosen at compile time with -DPQ_BACKEND=PQ_BINARY|PQ_QUATERNARY|PQ_PAIRING
+#define PQ_BINARY 1      // Binary heap of compact keys
+#define PQ_QUATERNARY 2  // 4-ary heap of compact keys, sibling groups aligned within cache lines
+#define PQ_PAIRING 3     // Pairing heap: O(1) insert and priority raise, O(log n) amortized extract
+#ifndef PQ_BACKEND
+#define PQ_BACKEND PQ_BINARY
+#endif
+#if PQ_BACKEND == PQ_BINARY
+#define HEAP_ARITY 2
+#define PQ_BACKEND_NAME "binary heap"
+#elif PQ_BACKEND == PQ_QUATERNARY
+#define HEAP_ARITY 4
+#define PQ_BACKEND_NAME "4-ary heap"
+#elif PQ_BACKEND == PQ_PAIRING
+#define PQ_BACKEND_NAME "pairing heap"
+#else
+#error "PQ_BACKEND must be PQ_BINARY, PQ_QUATERNARY or PQ_PAIRING"
+#endif
+
+// Markers for unused entries in the patient name index
+#define EMPTY_ENTRY -1
+#define DELETED_ENTRY -2
+
 // Patient structure
 typedef struct {
-    char name[50];
-    int severity; // Severity scale from 0 (min) to 10 (max)
+    char name[MAX_NAME_LENGTH];
+    int severity;       // Severity scale from 0 (min) to 10 (max)
+    int priority;       // Severity plus the aging bonus earned while waiting; the queues order by this
+    double arrivalTime; // Queue clock when the patient was admitted
+    int agingNode;      // Entry in the queue's arrival list (-1 = not tracked)
+    long caseId;        // Caller's number for the patient, such as a simulated arrival (-1 = none)
 } Patient;
 
-// Max-Heap structure
+// Function type returning the name of the patient stored at a position of the owning queue
+typedef const char* (*NameAtFunc)(const void* owner, int position);
+
+// Open-addressing hash index from patient name to a position in the owning queue
+typedef struct {
+    int* entries;   // Position, EMPTY_ENTRY or DELETED_ENTRY
+    int capacity;   // Power of two
+    int used;       // Live plus deleted entries
+} PatientIndex;
+
+// Heap key: the priority to order by and the handle of the patient record it belongs to
+typedef struct {
+    int priority;
+    int handle;
+} HeapKey;
+
+#if PQ_BACKEND == PQ_PAIRING
+// Pairing heap node; node h belongs to handle h
+typedef struct {
+    int priority;
+    int child;          // First child (-1 = none)
+    int sibling;        // Next sibling (-1 = none)
+    int prev;           // Previous sibling, or the parent of a first child (-1 = root)
+} PairingNode;
+#endif
+
+// Max-heap of compact keys; patient records stay put in a side table and are reached by handle
+typedef struct {
+    Patient* records;   // Patient by handle
+    int* indexSlotOf;   // Index entry of each handle
+    int* position;      // Heap slot (pairing: node) of each handle (-1 = free handle)
+    int* freeHandles;   // Stack of recycled handles
+    int freeCount;
+    int handlesUsed;    // Handles handed out so far
+    int capacity;       // Handles allocated
+    int size;
+    PatientIndex index; // Name -> handle
+#if PQ_BACKEND == PQ_PAIRING
+    PairingNode* nodes;
+    int root;           // (-1 = empty)
+#else
+    HeapKey* keys;      // keys[0..size) form a HEAP_ARITY-ary max-heap
+    HeapKey* keyBlock;  // Cache-aligned allocation behind keys
+#endif
+} MaxHeap;
+
+// Node of the bucket queue: one patient in a per-priority FIFO line
+typedef struct {
+    Patient patient;
+    int prev;           // Neighbours in the same priority's line (-1 = none); next also chains free nodes
+    int next;
+} BucketNode;
+
+// Bucket queue: one FIFO line per priority plus a bitmask of non-empty lines
+typedef struct {
+    BucketNode* nodes;
+    int* indexSlotOf;   // Index entry of the patient in each node
+    int capacity;
+    int used;           // Nodes handed out so far
+    int freeList;       // Recycled nodes (-1 = none)
+    int head[NUM_PRIORITIES];
+    int tail[NUM_PRIORITIES];
+    unsigned int nonEmpty; // Bit p is set while priority p has waiting patients
+    int size;
+    PatientIndex index; // Name -> node
+} BucketQueue;
+
+// Available queue backends
+typedef enum {
+    QUEUE_HEAP,    // Indexed max-heap (backend chosen by PQ_BACKEND), O(log n) operations
+    QUEUE_BUCKET   // Severity buckets, O(1) operations, first-come-first-served within a severity
+} QueueType;
+
+// Aging policy: effective priority = severity + min(maxBoost, floor(wait / interval))
+typedef struct {
+    double interval;    // Seconds of waiting per +1 priority step
+    int maxBoost;       // Cap on the bonus (0 = aging off)
+} AgingPolicy;
+
+// Entry of the arrival list: waiting patients in admission order
+typedef struct {
+    char name[MAX_NAME_LENGTH];
+    double arrivalTime;
+    int prev;
+    int next;           // Also chains free entries
+} AgingNode;
+
+// Journal event types
+typedef enum {
+    JOURNAL_ADMIT = 1,
+    JOURNAL_TREAT,
+    JOURNAL_UPDATE,
+    JOURNAL_REMOVE
+} JournalEventType;
+
+// One fixed-size journal record
+typedef struct {
+    uint32_t checksum;  // FNV-1a over the rest of the record; a torn final write fails it
+    uint32_t type;
+    uint64_t sequence;
+    double arrivalTime;
+    int32_t severity;
+    char name[MAX_NAME_LENGTH];
+} JournalRecord;
+
+// Header of a snapshot file, followed by count SnapshotEntry records
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t sequence;  // Last journal record the snapshot includes
+    uint32_t checksum;  // FNV-1a over the entries
+    uint32_t reserved;
+} SnapshotHeader;
+
+// One waiting patient in a snapshot
+typedef struct {
+    char name[MAX_NAME_LENGTH];
+    int32_t severity;
+    double arrivalTime;
+} SnapshotEntry;
+
+// Append-only event journal plus its snapshot file
+typedef struct {
+    const char* path;
+    char* snapshotPath; // path + ".snap"
+    int fd;
+    uint64_t sequence;  // Last sequence number written
+    int unsynced;       // Records written since the last fsync
+    double oldestUnsynced;
+    long sinceSnapshot; // Records written since the last snapshot
+} Journal;
+
+// Patient queue with a selectable backend
+typedef struct {
+    QueueType type;
+    MaxHeap heap;
+    BucketQueue buckets;
+
+    AgingPolicy aging;
+    double now;         // Queue clock in seconds, advanced by advanceQueueClock
+    AgingNode* agingNodes;
+    int agingCapacity;
+    int agingUsed;
+    int agingFree;
+    int agingHead;      // Oldest waiting patient
+    int agingTail;      // Newest waiting patient
+    int agingCursor[MAX_AGING_BOOST + 1]; // [k]: oldest patient not yet raised to bonus k (-1 = none)
+    Journal* journal;   // Change log, or NULL when not journaling
+} PatientQueue;
+
+// Batch entry actions
+typedef enum {
+    BATCH_ADMIT,
+    BATCH_UPDATE
+} BatchAction;
+
+// One line of a batch admission list
+typedef struct {
+    BatchAction action;
+    char name[MAX_NAME_LENGTH];
+    int severity;
+} BatchEntry;
+
+// Read-only cursor that visits waiting patients in treatment order without copying the queue
+typedef struct {
+    const PatientQueue* queue;
+    int* frontier;      // Heap backend: candidate positions, kept as a small max-heap by priority
+    int frontierSize;
+    int frontierCapacity;
+    int inlineFrontier[CURSOR_INLINE_SLOTS];
+    int priority;       // Bucket backend: line being walked
+    int node;           // Bucket backend: next node in that line (-1 = line finished)
+} QueueCursor;
+
+// One cell of a lock-free ring; the sequence number says whose turn the cell is
+typedef struct {
+    atomic_size_t sequence;
+    Patient patient;
+} TriageCell;
+
+// Bounded multi-producer multi-consumer FIFO ring (Vyukov), one per severity
+typedef struct {
+    TriageCell* cells;
+    size_t mask;                              // Capacity - 1
+    _Alignas(64) atomic_size_t enqueuePos;    // Producers and consumers work on separate cache lines
+    _Alignas(64) atomic_size_t dequeuePos;
+} TriageRing;
+
+// Concurrent triage queue: per-severity lock-free rings plus a sleep/wake path for idle doctors
+typedef struct {
+    TriageRing rings[NUM_SEVERITIES];
+    _Alignas(64) atomic_long waiting;         // Patients pushed and not yet popped
+    atomic_int sleepers;                      // Doctors blocked in concurrentExtractMax
+    atomic_int closed;
+    pthread_mutex_t lock;                     // Only protects the sleep/wake handshake
+    pthread_cond_t available;
+} ConcurrentTriageQueue;
+
+// Department lanes, each with its own doctors
+typedef enum {
+    DEPARTMENT_TRAUMA,
+    DEPARTMENT_CARDIAC,
+    DEPARTMENT_PEDIATRIC,
+    NUM_DEPARTMENTS
+} Department;
+
+// Per-department lanes sharing one sleep/wake lock; a stealing doctor can be woken by work in any lane
+typedef struct {
+    ConcurrentTriageQueue lanes[NUM_DEPARTMENTS];
+    _Alignas(64) atomic_long waiting;         // Patients waiting in any lane
+    atomic_int sleepers;                      // Doctors blocked in departmentTreat
+    atomic_int closed;
+    pthread_mutex_t lock;                     // Only protects the sleep/wake handshake
+    pthread_cond_t available;                 // Doctors that steal wait for work in any lane
+    pthread_cond_t laneAvailable[NUM_DEPARTMENTS]; // Doctors that do not wait for their own lane only
+} DepartmentQueues;
+
+// Function prototypes
+void initHeap(MaxHeap* heap);
+void freeHeap(MaxHeap* heap);
+int insert(MaxHeap* heap, const char* name, int severity);
+int insertPatient(MaxHeap* heap, const Patient* patient);
+int appendPatient(MaxHeap* heap, const Patient* patient);
+int addPatient(MaxHeap* heap, const Patient* patient, int ordered);
+Patient extractMax(MaxHeap* heap);
+void setPriority(MaxHeap* heap, int handle, int newPriority);
+int updateSeverity(MaxHeap* heap, const char* name, int newSeverity);
+int updateSeverityUnordered(MaxHeap* heap, const char* name, int newSeverity);
+int changeSeverity(MaxHeap* heap, const char* name, int newSeverity, int ordered);
+void repairHeap(MaxHeap* heap);
+int removePatient(MaxHeap* heap, const char* name, Patient* removed);
+int findPatient(const MaxHeap* heap, const char* name);
+void initQueue(PatientQueue* queue, QueueType type);
+void setAgingPolicy(PatientQueue* queue, double interval, int maxBoost);
+void advanceQueueClock(PatientQueue* queue, double now);
+void freeQueue(PatientQueue* queue);
+int queueSize(const PatientQueue* queue);
+int queueInsert(PatientQueue* queue, const char* name, int severity);
+int queueAdmit(PatientQueue* queue, const char* name, int severity, long caseId, int ordered);
+int queueInsertCase(PatientQueue* queue, const char* name, int severity, long caseId);
+int queueChangeSeverity(PatientQueue* queue, const char* name, int newSeverity, int ordered);
+int admitBatchFromPath(PatientQueue* queue, const char* path);
+Patient queueExtractMax(PatientQueue* queue);
+int queueUpdateSeverity(PatientQueue* queue, const char* name, int newSeverity);
+int queueRemove(PatientQueue* queue, const char* name, Patient* removed);
+const Patient* queueFind(const PatientQueue* queue, const char* name);
+void beginOrdered(const PatientQueue* queue, QueueCursor* cursor);
+const Patient* nextOrdered(QueueCursor* cursor);
+void endOrdered(QueueCursor* cursor);
+void displayPatients(const PatientQueue* queue, int maxRows);
+void journalEvent(PatientQueue* queue, JournalEventType type, const Patient* patient);
+int openJournal(Journal* journal, const char* path, PatientQueue* queue);
+void closeJournal(Journal* journal);
+void syncJournal(Journal* journal);
+double nowSeconds();
+double wallClockSeconds();
+void interactiveMenu(PatientQueue* queue);
+int getSeverityInput();
+
+int runConcurrentDemo(int argc, char* argv[]);
+int runDepartmentDemo(int argc, char* argv[]);
+int runSimulationMode(int argc, char* argv[]);
+int runQueueBenchmark(int argc, char* argv[]);
+int runBatchBenchmark(int argc, char* argv[]);
+
+int main(int argc, char* argv[]) {
+    opStatsInit("emergency_room", opNames, OP_COUNT);
+    if (argc > 1 && strcmp(argv[1], "concurrent") == 0) {
+        return runConcurrentDemo(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "departments") == 0) {
+        return runDepartmentDemo(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "simulate") == 0) {
+        return runSimulationMode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench-queue") == 0) {
+        return runQueueBenchmark(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench-batch") == 0) {
+        return runBatchBenchmark(argc, argv);
+    }
+
+    // "batch FILE|-" applies one batch to the (journaled) queue and exits instead of opening the menu
+    const char* batchPath = NULL;
+    int firstOption = 1;
+    if (argc > 2 && strcmp(argv[1], "batch") == 0) {
+        batchPath = argv[2];
+        firstOption = 3;
+    }
+    QueueType type = QUEUE_HEAP;
+    double agingInterval = 0;
+    int agingMaxBoost = 0;
+    const char* journalPath = NULL;
+    for (int i = firstOption; i < argc; i++) {
+        if (strcmp(argv[i], "--queue=bucket") == 0) {
+            type = QUEUE_BUCKET;
+        } else if (strcmp(argv[i], "--queue=heap") == 0) {
+            type = QUEUE_HEAP;
+        } else if (sscanf(argv[i], "--aging=%lf,%d", &agingInterval, &agingMaxBoost) == 2) {
+            continue;
+        } else if (strncmp(argv[i], "--journal=", 10) == 0) {
+            journalPath = argv[i] + 10;
+        } else {
+            printf(RED "Usage: %s [batch FILE|-] [--queue=heap|bucket] [--aging=SECONDS,MAX_BOOST] [--journal=PATH]"
+                   " | concurrent [desks] [doctors] [patients per desk] | departments [doctors per lane] [patients per desk]"
+                   " | simulate [options] | bench-queue [operations] | bench-batch [patients]\n" RESET, argv[0]);
+            return 1;
+        }
+    }
+
+    PatientQueue queue;
+    initQueue(&queue, type);
+    setAgingPolicy(&queue, agingInterval, agingMaxBoost);
+    advanceQueueClock(&queue, wallClockSeconds());
+    Journal journal;
+    if (journalPath != NULL && !openJournal(&journal, journalPath, &queue)) {
+        freeQueue(&queue);
+        return 1;
+    }
+    if (batchPath != NULL) {
+        int ok = admitBatchFromPath(&queue, batchPath);
+        displayPatients(&queue, DASHBOARD_ROWS);
+        if (journalPath != NULL) {
+            closeJournal(&journal);
+        }
+        freeQueue(&queue);
+        return ok ? 0 : 1;
+    }
+    interactiveMenu(&queue);
+    return 0;
+}
+
+// Exit with a message if an allocation failed
+void* checkedAlloc(void* ptr) {
+    if (ptr == NULL) {
+        printf(RED "Memory allocation failed!\n" RESET);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Hash a patient name (FNV-1a)
+unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Initialize an empty name index
+void initIndex(PatientIndex* index, int capacity) {
+    index->capacity = capacity;
+    index->used = 0;
+    index->entries = (int*)checkedAlloc(malloc(capacity * sizeof(int)));
+    for (int i = 0; i < capacity; i++) {
+        index->entries[i] = EMPTY_ENTRY;
+    }
+}
+
+// Find the index entry holding a name, or -1 if the name is not indexed
+int indexFind(const PatientIndex* index, const char* name, NameAtFunc nameAt, const void* owner) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int slot = hashName(name) & mask;
+    while (index->entries[slot] != EMPTY_ENTRY) {
+        int position = index->entries[slot];
+        if (position != DELETED_ENTRY && strcmp(nameAt(owner, position), name) == 0) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Place a position into the first free entry for its name (no resizing)
+int indexPlace(PatientIndex* index, const char* name, int position) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int slot = hashName(name) & mask;
+    while (index->entries[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    if (index->entries[slot] == EMPTY_ENTRY) {
+        index->used++;
+    }
+    index->entries[slot] = position;
+    return (int)slot;
+}
+
+// Rebuild the index at a new capacity without tombstones; indexSlotOf is refreshed for every live position
+void indexRehash(PatientIndex* index, int capacity, NameAtFunc nameAt, const void* owner, int* indexSlotOf) {
+    int* old = index->entries;
+    int oldCapacity = index->capacity;
+    initIndex(index, capacity);
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i] >= 0) {
+            indexSlotOf[old[i]] = indexPlace(index, nameAt(owner, old[i]), old[i]);
+        }
+    }
+    free(old);
+}
+
+// Add a name -> position mapping; on rehash indexSlotOf is refreshed for every live position
+int indexInsert(PatientIndex* index, const char* name, int position, NameAtFunc nameAt, const void* owner, int* indexSlotOf) {
+    if ((index->used + 1) * 2 > index->capacity) {
+        // Rebuild without tombstones, doubling only when live entries need the room
+        int live = 0;
+        for (int i = 0; i < index->capacity; i++) {
+            live += index->entries[i] >= 0;
+        }
+        indexRehash(index, (live + 1) * 4 > index->capacity ? index->capacity * 2 : index->capacity, nameAt, owner, indexSlotOf);
+    }
+    return indexPlace(index, name, position);
+}
+
+// Remove an index entry, leaving a tombstone so later probes still find their names
+void indexErase(PatientIndex* index, int slot) {
+    index->entries[slot] = DELETED_ENTRY;
+}
+
+// Name of the patient with a heap handle (NameAtFunc for the heap's index)
+const char* heapNameAt(const void* owner, int position) {
+    return ((const MaxHeap*)owner)->records[position].name;
+}
+
+#if PQ_BACKEND != PQ_PAIRING
+// Allocate room for capacity keys, shifted so each group of HEAP_ARITY siblings starts on an aligned boundary
+// Slot s lives at keyBlock[s + HEAP_ARITY - 1], so the children of s start at a multiple of HEAP_ARITY
+void allocateKeys(MaxHeap* heap, int capacity) {
+    size_t bytes = (capacity + HEAP_ARITY - 1) * sizeof(HeapKey);
+    bytes = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    HeapKey* block = (HeapKey*)checkedAlloc(aligned_alloc(CACHE_LINE_SIZE, bytes));
+    if (heap->size > 0) {
+        memcpy(block + HEAP_ARITY - 1, heap->keys, heap->size * sizeof(HeapKey));
+    }
+    free(heap->keyBlock);
+    heap->keyBlock = block;
+    heap->keys = block + HEAP_ARITY - 1;
+}
+#endif
+
+// Grow the record table and the backend storage to hold capacity handles
+void reserveHeap(MaxHeap* heap, int capacity) {
+    heap->capacity = capacity;
+    heap->records = (Patient*)checkedAlloc(realloc(heap->records, capacity * sizeof(Patient)));
+    heap->indexSlotOf = (int*)checkedAlloc(realloc(heap->indexSlotOf, capacity * sizeof(int)));
+    heap->position = (int*)checkedAlloc(realloc(heap->position, capacity * sizeof(int)));
+    heap->freeHandles = (int*)checkedAlloc(realloc(heap->freeHandles, capacity * sizeof(int)));
+#if PQ_BACKEND == PQ_PAIRING
+    heap->nodes = (PairingNode*)checkedAlloc(realloc(heap->nodes, capacity * sizeof(PairingNode)));
+#else
+    allocateKeys(heap, capacity);
+#endif
+}
+
+// Initialize the heap
+void initHeap(MaxHeap* heap) {
+    heap->size = 0;
+    heap->handlesUsed = 0;
+    heap->freeCount = 0;
+    heap->records = NULL;
+    heap->indexSlotOf = NULL;
+    heap->position = NULL;
+    heap->freeHandles = NULL;
+#if PQ_BACKEND == PQ_PAIRING
+    heap->nodes = NULL;
+    heap->root = -1;
+#else
+    heap->keyBlock = NULL;
+    heap->keys = NULL;
+#endif
+    reserveHeap(heap, INITIAL_CAPACITY);
+    initIndex(&heap->index, INITIAL_CAPACITY * 2);
+}
+
+// Free the heap's storage
+void freeHeap(MaxHeap* heap) {
+    free(heap->records);
+    free(heap->indexSlotOf);
+    free(heap->position);
+    free(heap->freeHandles);
+#if PQ_BACKEND == PQ_PAIRING
+    free(heap->nodes);
+#else
+    free(heap->keyBlock);
+#endif
+    free(heap->index.entries);
+    heap->size = heap->capacity = 0;
+}
+
+// Look up a patient's handle by name, or -1 if not queued
+int findPatient(const MaxHeap* heap, const char* name) {
+    int slot = indexFind(&heap->index, name, heapNameAt, heap);
+    return slot == -1 ? -1 : heap->index.entries[slot];
+}
+
+#if PQ_BACKEND == PQ_PAIRING
+// Meld two detached trees; the root with the lower priority becomes the first child of the other
+int pairingMeld(MaxHeap* heap, int a, int b) {
+    if (a == -1) {
+        return b;
+    }
+    if (b == -1) {
+        return a;
+    }
+    PairingNode* nodes = heap->nodes;
+    if (nodes[b].priority > nodes[a].priority) {
+        int t = a;
+        a = b;
+        b = t;
+    }
+    nodes[b].prev = a;
+    nodes[b].sibling = nodes[a].child;
+    if (nodes[a].child != -1) {
+        nodes[nodes[a].child].prev = b;
+    }
+    nodes[a].child = b;
+    return a;
+}
+
+// Combine a list of sibling trees into one (two-pass: pair left to right, then fold right to left)
+int pairingMergePairs(MaxHeap* heap, int first) {
+    PairingNode* nodes = heap->nodes;
+    int pairs = -1; // Melded pairs, chained through sibling in reverse order
+    while (first != -1) {
+        int a = first;
+        int b = nodes[a].sibling;
+        first = b == -1 ? -1 : nodes[b].sibling;
+        nodes[a].prev = nodes[a].sibling = -1;
+        if (b != -1) {
+            nodes[b].prev = nodes[b].sibling = -1;
+        }
+        int melded = pairingMeld(heap, a, b);
+        nodes[melded].sibling = pairs;
+        pairs = melded;
+    }
+    int root = -1;
+    while (pairs != -1) {
+        int next = nodes[pairs].sibling;
+        nodes[pairs].sibling = -1;
+        root = pairingMeld(heap, root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+// Detach a non-root node, with its subtree, from its parent and siblings
+void pairingCut(MaxHeap* heap, int node) {
+    PairingNode* nodes = heap->nodes;
+    int prev = nodes[node].prev;
+    if (nodes[prev].child == node) {
+        nodes[prev].child = nodes[node].sibling;
+    } else {
+        nodes[prev].sibling = nodes[node].sibling;
+    }
+    if (nodes[node].sibling != -1) {
+        nodes[nodes[node].sibling].prev = prev;
+    }
+    nodes[node].prev = nodes[node].sibling = -1;
+}
+
+// Take a node out of the heap, merging its children back in
+void pairingDetach(MaxHeap* heap, int node) {
+    int children = heap->nodes[node].child;
+    heap->nodes[node].child = -1;
+    if (node == heap->root) {
+        heap->root = pairingMergePairs(heap, children);
+    } else {
+        pairingCut(heap, node);
+        heap->root = pairingMeld(heap, heap->root, pairingMergePairs(heap, children));
+    }
+}
+
+// Add a handle's key to the heap
+void pushKey(MaxHeap* heap, int handle) {
+    PairingNode* node = &heap->nodes[handle];
+    node->priority = heap->records[handle].priority;
+    node->child = node->sibling = node->prev = -1;
+    heap->position[handle] = handle;
+    heap->root = pairingMeld(heap, heap->root, handle);
+}
+
+// Remove a handle's key from the heap
+void popKey(MaxHeap* heap, int handle) {
+    pairingDetach(heap, handle);
+}
+
+// Re-key a handle: a raise is a cut and a meld, a drop re-inserts the node after merging its children
+void rekey(MaxHeap* heap, int handle, int newPriority) {
+    PairingNode* node = &heap->nodes[handle];
+    if (newPriority > node->priority && handle != heap->root) {
+        pairingCut(heap, handle);
+        node->priority = newPriority;
+        heap->root = pairingMeld(heap, heap->root, handle);
+    } else if (newPriority < node->priority) {
+        pairingDetach(heap, handle);
+        node->priority = newPriority;
+        heap->root = pairingMeld(heap, heap->root, handle);
+    } else {
+        node->priority = newPriority;
+    }
+}
+
+// Handle of the highest-priority patient
+int topHandle(const MaxHeap* heap) {
+    return heap->root;
+}
+
+// Cursor support: the top position, a position's first child and next sibling (-1 = none)
+int heapRootPosition(const MaxHeap* heap) {
+    return heap->root;
+}
+
+int heapFirstChild(const MaxHeap* heap, int position) {
+    return heap->nodes[position].child;
+}
+
+int heapNextSibling(const MaxHeap* heap, int position) {
+    return heap->nodes[position].sibling;
+}
+
+int heapPriorityAt(const MaxHeap* heap, int position) {
+    return heap->nodes[position].priority;
+}
+
+int heapHandleAt(const MaxHeap* heap, int position) {
+    (void)heap;
+    return position;
+}
+
+// Build the heap from handles 0..count-1; pairing inserts are O(1), so this is O(n)
+void buildHeap(MaxHeap* heap, int count) {
+    for (int handle = 0; handle < count; handle++) {
+        pushKey(heap, handle);
+    }
+}
+
+// Batch hooks: pairing inserts and raises are already O(1), so batched keys go straight in and need no repair pass
+void appendKey(MaxHeap* heap, int handle) {
+    pushKey(heap, handle);
+}
+
+void setKeyUnordered(MaxHeap* heap, int handle, int newPriority) {
+    rekey(heap, handle, newPriority);
+}
+
+void repairHeap(MaxHeap* heap) {
+    (void)heap;
+}
+#else
+// Swap two heap slots, keeping each handle's position current; only the 8-byte keys move
+void swap(MaxHeap* heap, int i, int j) {
+    HeapKey temp = heap->keys[i];
+    heap->keys[i] = heap->keys[j];
+    heap->keys[j] = temp;
+    heap->position[heap->keys[i].handle] = i;
+    heap->position[heap->keys[j].handle] = j;
+}
+
+// Move the key at index up until its parent has at least the same priority
+void siftUp(MaxHeap* heap, int index) {
+    while (index != 0 && heap->keys[(index - 1) / HEAP_ARITY].priority < heap->keys[index].priority) {
+        swap(heap, index, (index - 1) / HEAP_ARITY);
+        index = (index - 1) / HEAP_ARITY;
+    }
+}
+
+// Move the key at index down until no child has a higher priority
+void heapify(MaxHeap* heap, int index) {
+    while (1) {
+        int largest = index;
+        int first = HEAP_ARITY * index + 1;
+        int last = first + HEAP_ARITY < heap->size ? first + HEAP_ARITY : heap->size;
+        for (int child = first; child < last; child++) {
+            if (heap->keys[child].priority > heap->keys[largest].priority) {
+                largest = child;
+            }
+        }
+        if (largest == index) {
+            return;
+        }
+        swap(heap, index, largest);
+        index = largest;
+    }
+}
+
+// Add a handle's key to the heap
+void pushKey(MaxHeap* heap, int handle) {
+    int index = heap->size;
+    heap->keys[index].priority = heap->records[handle].priority;
+    heap->keys[index].handle = handle;
+    heap->position[handle] = index;
+    siftUp(heap, index);
+}
+
+// Remove a handle's key from the heap (size already excludes it)
+void popKey(MaxHeap* heap, int handle) {
+    int index = heap->position[handle];
+    if (index != heap->size) {
+        // Move the last key into the hole and repair in whichever direction is needed
+        heap->keys[index] = heap->keys[heap->size];
+        heap->position[heap->keys[index].handle] = index;
+        int moved = heap->keys[index].handle;
+        siftUp(heap, index);
+        heapify(heap, heap->position[moved]);
+    }
+}
+
+// Re-key a handle and repair the heap from its slot
+void rekey(MaxHeap* heap, int handle, int newPriority) {
+    int index = heap->position[handle];
+    int oldPriority = heap->keys[index].priority;
+    heap->keys[index].priority = newPriority;
+    if (newPriority > oldPriority) {
+        siftUp(heap, index);
+    } else {
+        heapify(heap, index);
+    }
+}
+
+// Handle of the highest-priority patient
+int topHandle(const MaxHeap* heap) {
+    return heap->keys[0].handle;
+}
+
+// Cursor support: the top position, a position's first child and next sibling (-1 = none)
+int heapRootPosition(const MaxHeap* heap) {
+    return heap->size > 0 ? 0 : -1;
+}
+
+int heapFirstChild(const MaxHeap* heap, int position) {
+    int child = HEAP_ARITY * position + 1;
+    return child < heap->size ? child : -1;
+}
+
+int heapNextSibling(const MaxHeap* heap, int position) {
+    // The last child of a slot sits at a multiple of HEAP_ARITY; the root has no siblings
+    return position % HEAP_ARITY != 0 && position + 1 < heap->size ? position + 1 : -1;
+}
+
+int heapPriorityAt(const MaxHeap* heap, int position) {
+    return heap->keys[position].priority;
+}
+
+int heapHandleAt(const MaxHeap* heap, int position) {
+    return heap->keys[position].handle;
+}
+
+// Restore the heap property over the whole array bottom-up (Floyd) in O(n)
+void repairHeap(MaxHeap* heap) {
+    for (int i = (heap->size - 2) / HEAP_ARITY; i >= 0; i--) {
+        heapify(heap, i);
+    }
+}
+
+// Build the heap from handles 0..count-1 in O(n)
+void buildHeap(MaxHeap* heap, int count) {
+    for (int handle = 0; handle < count; handle++) {
+        heap->keys[handle].priority = heap->records[handle].priority;
+        heap->keys[handle].handle = handle;
+        heap->position[handle] = handle;
+    }
+    heap->size = count;
+    repairHeap(heap);
+}
+
+// Batch hooks: add or re-key without sifting; repairHeap restores order once the batch is in
+void appendKey(MaxHeap* heap, int handle) {
+    heap->keys[heap->size].priority = heap->records[handle].priority;
+    heap->keys[heap->size].handle = handle;
+    heap->position[handle] = heap->size;
+}
+
+void setKeyUnordered(MaxHeap* heap, int handle, int newPriority) {
+    heap->keys[heap->position[handle]].priority = newPriority;
+}
+#endif
+
+// Insert a patient into the max-heap; returns 0 if a patient with that name is already queued
+int insert(MaxHeap* heap, const char* name, int severity) {
+    Patient newPatient;
+    strncpy(newPatient.name, name, MAX_NAME_LENGTH - 1);
+    newPatient.name[MAX_NAME_LENGTH - 1] = '\0';
+    newPatient.severity = severity;
+    newPatient.priority = severity;
+    newPatient.arrivalTime = 0;
+    newPatient.agingNode = -1;
+    newPatient.caseId = -1;
+    return insertPatient(heap, &newPatient);
+}
+
+// Insert a prepared patient record, ordered by its priority
+int insertPatient(MaxHeap* heap, const Patient* patient) {
+    return addPatient(heap, patient, 1);
+}
+
+// Insert a prepared patient record without restoring heap order; call repairHeap once the batch is in
+int appendPatient(MaxHeap* heap, const Patient* patient) {
+    return addPatient(heap, patient, 0);
+}
+
+// Store a patient record under a fresh handle and add its key, sifted into place only when ordered is set
+int addPatient(MaxHeap* heap, const Patient* patient, int ordered) {
+    if (findPatient(heap, patient->name) != -1) {
+        printf(RED "Patient %s is already in the queue.\n" RESET, patient->name);
+        return 0;
+    }
+    int handle;
+    if (heap->freeCount > 0) {
+        handle = heap->freeHandles[--heap->freeCount];
+    } else {
+        if (heap->handlesUsed == heap->capacity) {
+            reserveHeap(heap, heap->capacity * 2);
+        }
+        handle = heap->handlesUsed++;
+    }
+    heap->records[handle] = *patient;
+    heap->indexSlotOf[handle] = indexInsert(&heap->index, heap->records[handle].name, handle, heapNameAt, heap, heap->indexSlotOf);
+    if (ordered) {
+        pushKey(heap, handle);
+    } else {
+        appendKey(heap, handle);
+    }
+    heap->size++;
+    return 1;
+}
+
+// Take a patient out of the heap by handle and recycle the handle
+Patient removeHandle(MaxHeap* heap, int handle) {
+    heap->size--;
+    popKey(heap, handle);
+    indexErase(&heap->index, heap->indexSlotOf[handle]);
+    heap->position[handle] = -1;
+    heap->freeHandles[heap->freeCount++] = handle;
+    return heap->records[handle];
+}
+
+// Extract the patient with the highest priority
+Patient extractMax(MaxHeap* heap) {
+    if (heap->size == 0) {
+        printf(RED "Heap is empty!\n" RESET);
+        exit(EXIT_FAILURE); // or handle it appropriately
+    }
+    return removeHandle(heap, topHandle(heap));
+}
+
+// Change the priority of a queued patient and repair the heap
+void setPriority(MaxHeap* heap, int handle, int newPriority) {
+    heap->records[handle].priority = newPriority;
+    rekey(heap, handle, newPriority);
+}
+
+// Update severity of a patient and re-heapify; returns 0 if the patient is not queued
+int updateSeverity(MaxHeap* heap, const char* name, int newSeverity) {
+    return changeSeverity(heap, name, newSeverity, 1);
+}
+
+// Update severity of a patient without restoring heap order; call repairHeap once the batch is in
+int updateSeverityUnordered(MaxHeap* heap, const char* name, int newSeverity) {
+    return changeSeverity(heap, name, newSeverity, 0);
+}
+
+// Change a patient's severity, keeping any aging bonus; the heap is repaired right away only when ordered is set
+int changeSeverity(MaxHeap* heap, const char* name, int newSeverity, int ordered) {
+    int handle = findPatient(heap, name);
+    if (handle == -1) {
+        printf(RED "Patient %s not found.\n" RESET, name);
+        return 0;
+    }
+    Patient* patient = &heap->records[handle];
+    int newPriority = newSeverity + patient->priority - patient->severity;
+    patient->severity = newSeverity;
+    if (ordered) {
+        setPriority(heap, handle, newPriority);
+    } else {
+        patient->priority = newPriority;
+        setKeyUnordered(heap, handle, newPriority);
+    }
+    return 1;
+}
+
+// Remove a patient who left or was transferred; returns 0 if the patient is not queued
+int removePatient(MaxHeap* heap, const char* name, Patient* removed) {
+    int handle = findPatient(heap, name);
+    if (handle == -1) {
+        printf(RED "Patient %s not found.\n" RESET, name);
+        return 0;
+    }
+    Patient patient = removeHandle(heap, handle);
+    if (removed != NULL) {
+        *removed = patient;
+    }
+    return 1;
+}
+
+// Make room for extra more patients up front, so a batch grows the tables and rehashes the index at most once
+void reserveHeapFor(MaxHeap* heap, int extra) {
+    int needed = heap->size + extra;
+    if (needed > heap->capacity) {
+        int capacity = heap->capacity;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        reserveHeap(heap, capacity);
+    }
+    // Rehash only where the inserts would have, but straight to the final size
+    if ((heap->index.used + extra) * 2 > heap->index.capacity) {
+        int capacity = heap->index.capacity;
+        while (capacity < needed * 4) {
+            capacity *= 2;
+        }
+        indexRehash(&heap->index, capacity, heapNameAt, heap, heap->indexSlotOf);
+    }
+}
+
+// Fill an empty heap from a list of patients in O(n)
+void heapBulkLoad(MaxHeap* heap, const Patient* patients, int count) {
+    if (count > heap->capacity) {
+        reserveHeap(heap, count);
+    }
+    memcpy(heap->records, patients, count * sizeof(Patient));
+    heap->handlesUsed = count;
+    heap->freeCount = 0;
+    // Size the name index once instead of rehashing as it fills
+    int indexCapacity = heap->index.capacity;
+    while (indexCapacity < count * 4) {
+        indexCapacity *= 2;
+    }
+    free(heap->index.entries);
+    initIndex(&heap->index, indexCapacity);
+    for (int handle = 0; handle < count; handle++) {
+        heap->indexSlotOf[handle] = indexInsert(&heap->index, heap->records[handle].name, handle, heapNameAt, heap, heap->indexSlotOf);
+    }
+    buildHeap(heap, count);
+    heap->size = count;
+}
+
+// Name of the patient in a bucket node (NameAtFunc for the bucket queue's index)
+const char* bucketNameAt(const void* owner, int position) {
+    return ((const BucketQueue*)owner)->nodes[position].patient.name;
+}
+
+// Initialize the bucket queue
+void initBucketQueue(BucketQueue* queue) {
+    queue->size = 0;
+    queue->capacity = INITIAL_CAPACITY;
+    queue->used = 0;
+    queue->freeList = -1;
+    queue->nonEmpty = 0;
+    queue->nodes = (BucketNode*)checkedAlloc(malloc(queue->capacity * sizeof(BucketNode)));
+    queue->indexSlotOf = (int*)checkedAlloc(malloc(queue->capacity * sizeof(int)));
+    for (int p = 0; p < NUM_PRIORITIES; p++) {
+        queue->head[p] = queue->tail[p] = -1;
+    }
+    initIndex(&queue->index, INITIAL_CAPACITY * 2);
+}
+
+// Free the bucket queue's storage
+void freeBucketQueue(BucketQueue* queue) {
+    free(queue->nodes);
+    free(queue->indexSlotOf);
+    free(queue->index.entries);
+    queue->size = queue->capacity = 0;
+}
+
+// Look up a patient's node by name, or -1 if not queued
+int bucketFind(const BucketQueue* queue, const char* name) {
+    int slot = indexFind(&queue->index, name, bucketNameAt, queue);
+    return slot == -1 ? -1 : queue->index.entries[slot];
+}
+
+// Append a node to the back of its priority's line
+void bucketLink(BucketQueue* queue, int node) {
+    int priority = queue->nodes[node].patient.priority;
+    queue->nodes[node].prev = queue->tail[priority];
+    queue->nodes[node].next = -1;
+    if (queue->tail[priority] == -1) {
+        queue->head[priority] = node;
+    } else {
+        queue->nodes[queue->tail[priority]].next = node;
+    }
+    queue->tail[priority] = node;
+    queue->nonEmpty |= 1u << priority;
+}
+
+// Take a node out of its priority's line
+void bucketUnlink(BucketQueue* queue, int node) {
+    BucketNode* n = &queue->nodes[node];
+    int priority = n->patient.priority;
+    if (n->prev == -1) {
+        queue->head[priority] = n->next;
+    } else {
+        queue->nodes[n->prev].next = n->next;
+    }
+    if (n->next == -1) {
+        queue->tail[priority] = n->prev;
+    } else {
+        queue->nodes[n->next].prev = n->prev;
+    }
+    if (queue->head[priority] == -1) {
+        queue->nonEmpty &= ~(1u << priority);
+    }
+}
+
+// Insert a prepared patient record at the back of its priority's line
+int bucketInsertPatient(BucketQueue* queue, const Patient* newPatient) {
+    if (bucketFind(queue, newPatient->name) != -1) {
+        printf(RED "Patient %s is already in the queue.\n" RESET, newPatient->name);
+        return 0;
+    }
+    int node = queue->freeList;
+    if (node != -1) {
+        queue->freeList = queue->nodes[node].next;
+    } else {
+        if (queue->used == queue->capacity) {
+            queue->capacity *= 2;
+            queue->nodes = (BucketNode*)checkedAlloc(realloc(queue->nodes, queue->capacity * sizeof(BucketNode)));
+            queue->indexSlotOf = (int*)checkedAlloc(realloc(queue->indexSlotOf, queue->capacity * sizeof(int)));
+        }
+        node = queue->used++;
+    }
+    Patient* patient = &queue->nodes[node].patient;
+    *patient = *newPatient;
+    queue->indexSlotOf[node] = indexInsert(&queue->index, patient->name, node, bucketNameAt, queue, queue->indexSlotOf);
+    bucketLink(queue, node);
+    queue->size++;
+    return 1;
+}
+
+// Insert a patient at the back of its severity's line; returns 0 if the name is already queued
+int bucketInsert(BucketQueue* queue, const char* name, int severity) {
+    Patient newPatient;
+    strncpy(newPatient.name, name, MAX_NAME_LENGTH - 1);
+    newPatient.name[MAX_NAME_LENGTH - 1] = '\0';
+    newPatient.severity = severity;
+    newPatient.priority = severity;
+    newPatient.arrivalTime = 0;
+    newPatient.agingNode = -1;
+    newPatient.caseId = -1;
+    return bucketInsertPatient(queue, &newPatient);
+}
+
+// Unlink a node, drop it from the index and recycle it
+Patient bucketRemoveNode(BucketQueue* queue, int node) {
+    Patient removed = queue->nodes[node].patient;
+    bucketUnlink(queue, node);
+    indexErase(&queue->index, queue->indexSlotOf[node]);
+    queue->nodes[node].next = queue->freeList;
+    queue->freeList = node;
+    queue->size--;
+    return removed;
+}
+
+// Extract the longest-waiting patient of the highest non-empty priority
+Patient bucketExtractMax(BucketQueue* queue) {
+    if (queue->size == 0) {
+        printf(RED "Queue is empty!\n" RESET);
+        exit(EXIT_FAILURE);
+    }
+    int priority = 31 - __builtin_clz(queue->nonEmpty);
+    return bucketRemoveNode(queue, queue->head[priority]);
+}
+
+// Move a node to the back of the line for a new priority
+void bucketSetPriority(BucketQueue* queue, int node, int newPriority) {
+    if (queue->nodes[node].patient.priority != newPriority) {
+        bucketUnlink(queue, node);
+        queue->nodes[node].patient.priority = newPriority;
+        bucketLink(queue, node);
+    }
+}
+
+// Move a patient to the back of the line for the new severity; returns 0 if not queued
+int bucketUpdateSeverity(BucketQueue* queue, const char* name, int newSeverity) {
+    int node = bucketFind(queue, name);
+    if (node == -1) {
+        printf(RED "Patient %s not found.\n" RESET, name);
+        return 0;
+    }
+    // Keep any aging bonus the patient has already earned
+    Patient* patient = &queue->nodes[node].patient;
+    int boost = patient->priority - patient->severity;
+    patient->severity = newSeverity;
+    bucketSetPriority(queue, node, newSeverity + boost);
+    return 1;
+}
+
+// Remove a patient who left or was transferred; returns 0 if not queued
+int bucketRemove(BucketQueue* queue, const char* name, Patient* removed) {
+    int node = bucketFind(queue, name);
+    if (node == -1) {
+        printf(RED "Patient %s not found.\n" RESET, name);
+        return 0;
+    }
+    Patient patient = bucketRemoveNode(queue, node);
+    if (removed != NULL) {
+        *removed = patient;
+    }
+    return 1;
+}
+
+// Initialize a patient queue with the selected backend (aging off)
+void initQueue(PatientQueue* queue, QueueType type) {
+    queue->type = type;
+    if (type == QUEUE_BUCKET) {
+        initBucketQueue(&queue->buckets);
+    } else {
+        initHeap(&queue->heap);
+    }
+    queue->aging.interval = 0;
+    queue->aging.maxBoost = 0;
+    queue->now = 0;
+    queue->agingCapacity = INITIAL_CAPACITY;
+    queue->agingNodes = (AgingNode*)checkedAlloc(malloc(queue->agingCapacity * sizeof(AgingNode)));
+    queue->agingUsed = 0;
+    queue->agingFree = -1;
+    queue->agingHead = queue->agingTail = -1;
+    for (int k = 0; k <= MAX_AGING_BOOST; k++) {
+        queue->agingCursor[k] = -1;
+    }
+    queue->journal = NULL;
+}
+
+// Free a patient queue
+void freeQueue(PatientQueue* queue) {
+    if (queue->type == QUEUE_BUCKET) {
+        freeBucketQueue(&queue->buckets);
+    } else {
+        freeHeap(&queue->heap);
+    }
+    free(queue->agingNodes);
+}
+
+// Enable aging: every interval seconds of waiting adds 1 to a patient's priority, up to maxBoost
+// Set it before admitting patients
+void setAgingPolicy(PatientQueue* queue, double interval, int maxBoost) {
+    if (interval <= 0 || maxBoost <= 0) {
+        maxBoost = 0;
+    }
+    queue->aging.interval = interval;
+    queue->aging.maxBoost = maxBoost > MAX_AGING_BOOST ? MAX_AGING_BOOST : maxBoost;
+}
+
+// Number of waiting patients
+int queueSize(const PatientQueue* queue) {
+    return queue->type == QUEUE_BUCKET ? queue->buckets.size : queue->heap.size;
+}
+
+// Append a patient to the arrival list; cursors that had run off the end now wait on it
+int agingTrack(PatientQueue* queue, const char* name, double arrivalTime) {
+    int node = queue->agingFree;
+    if (node != -1) {
+        queue->agingFree = queue->agingNodes[node].next;
+    } else {
+        if (queue->agingUsed == queue->agingCapacity) {
+            queue->agingCapacity *= 2;
+            queue->agingNodes = (AgingNode*)checkedAlloc(realloc(queue->agingNodes, queue->agingCapacity * sizeof(AgingNode)));
+        }
+        node = queue->agingUsed++;
+    }
+    AgingNode* entry = &queue->agingNodes[node];
+    strcpy(entry->name, name);
+    entry->arrivalTime = arrivalTime;
+    entry->prev = queue->agingTail;
+    entry->next = -1;
+    if (queue->agingTail == -1) {
+        queue->agingHead = node;
+    } else {
+        queue->agingNodes[queue->agingTail].next = node;
+    }
+    queue->agingTail = node;
+    for (int k = 1; k <= queue->aging.maxBoost; k++) {
+        if (queue->agingCursor[k] == -1) {
+            queue->agingCursor[k] = node;
+        }
+    }
+    return node;
+}
+
+// Drop a patient who left the queue from the arrival list
+void agingUntrack(PatientQueue* queue, int node) {
+    if (node < 0) {
+        return;
+    }
+    AgingNode* entry = &queue->agingNodes[node];
+    for (int k = 1; k <= queue->aging.maxBoost; k++) {
+        if (queue->agingCursor[k] == node) {
+            queue->agingCursor[k] = entry->next;
+        }
+    }
+    if (entry->prev == -1) {
+        queue->agingHead = entry->next;
+    } else {
+        queue->agingNodes[entry->prev].next = entry->next;
+    }
+    if (entry->next == -1) {
+        queue->agingTail = entry->prev;
+    } else {
+        queue->agingNodes[entry->next].prev = entry->prev;
+    }
+    entry->next = queue->agingFree;
+    queue->agingFree = node;
+}
+
+// Advance the queue clock and apply the aging bonuses that came due
+// Patients reach bonus k in admission order, so cursor k only ever moves forward through the arrival list:
+// each patient is re-keyed at most maxBoost times in total, never on a periodic full pass
+void advanceQueueClock(PatientQueue* queue, double now) {
+    if (now > queue->now) {
+        queue->now = now;
+    }
+    for (int k = 1; k <= queue->aging.maxBoost; k++) {
+        double cutoff = queue->now - k * queue->aging.interval;
+        while (queue->agingCursor[k] != -1 && queue->agingNodes[queue->agingCursor[k]].arrivalTime <= cutoff) {
+            const char* name = queue->agingNodes[queue->agingCursor[k]].name;
+            if (queue->type == QUEUE_BUCKET) {
+                int node = bucketFind(&queue->buckets, name);
+                bucketSetPriority(&queue->buckets, node, queue->buckets.nodes[node].patient.severity + k);
+            } else {
+                int handle = findPatient(&queue->heap, name);
+                setPriority(&queue->heap, handle, queue->heap.records[handle].severity + k);
+            }
+            queue->agingCursor[k] = queue->agingNodes[queue->agingCursor[k]].next;
+        }
+    }
+}
+
+// Add a patient arriving at the current queue clock; returns 0 if the name is already queued
+int queueInsert(PatientQueue* queue, const char* name, int severity) {
+    return queueAdmit(queue, name, severity, -1, 1);
+}
+
+// Add a patient carrying the caller's case number, which comes back with the patient when treated or removed
+int queueInsertCase(PatientQueue* queue, const char* name, int severity, long caseId) {
+    return queueAdmit(queue, name, severity, caseId, 1);
+}
+
+// Admit a patient; with ordered unset the heap backend leaves its repair to repairHeap
+int queueAdmit(PatientQueue* queue, const char* name, int severity, long caseId, int ordered) {
+    Patient patient;
+    strncpy(patient.name, name, MAX_NAME_LENGTH - 1);
+    patient.name[MAX_NAME_LENGTH - 1] = '\0';
+    patient.severity = severity;
+    patient.priority = severity;
+    patient.arrivalTime = queue->now;
+    patient.agingNode = -1;
+    patient.caseId = caseId;
+    if (queueFind(queue, patient.name) != NULL) {
+        printf(RED "Patient %s is already in the queue.\n" RESET, patient.name);
+        return 0;
+    }
+    OP_STATS_START(timer);
+    if (queue->aging.maxBoost > 0) {
+        patient.agingNode = agingTrack(queue, patient.name, patient.arrivalTime);
+    }
+    if (queue->type == QUEUE_BUCKET) {
+        bucketInsertPatient(&queue->buckets, &patient);
+    } else {
+        addPatient(&queue->heap, &patient, ordered);
+    }
+    journalEvent(queue, JOURNAL_ADMIT, &patient);
+    OP_STATS_STOP(OP_ADMIT_PATIENT, timer);
+    return 1;
+}
+
+// Take the next patient to treat
+Patient queueExtractMax(PatientQueue* queue) {
+    OP_STATS_START(timer);
+    Patient patient = queue->type == QUEUE_BUCKET ? bucketExtractMax(&queue->buckets) : extractMax(&queue->heap);
+    agingUntrack(queue, patient.agingNode);
+    journalEvent(queue, JOURNAL_TREAT, &patient);
+    OP_STATS_STOP(OP_TREAT_PATIENT, timer);
+    return patient;
+}
+
+// Change a waiting patient's severity, keeping any aging bonus; returns 0 if not queued
+int queueUpdateSeverity(PatientQueue* queue, const char* name, int newSeverity) {
+    return queueChangeSeverity(queue, name, newSeverity, 1);
+}
+
+// Change a severity; with ordered unset the heap backend leaves its repair to repairHeap
+int queueChangeSeverity(PatientQueue* queue, const char* name, int newSeverity, int ordered) {
+    OP_STATS_START(timer);
+    int found = queue->type == QUEUE_BUCKET ? bucketUpdateSeverity(&queue->buckets, name, newSeverity)
+                                            : changeSeverity(&queue->heap, name, newSeverity, ordered);
+    if (found) {
+        journalEvent(queue, JOURNAL_UPDATE, queueFind(queue, name));
+    }
+    OP_STATS_STOP(OP_UPDATE_SEVERITY, timer);
+    return found;
+}
+
+// Remove a waiting patient; returns 0 if not queued
+int queueRemove(PatientQueue* queue, const char* name, Patient* removed) {
+    OP_STATS_START(timer);
+    Patient patient;
+    int found = queue->type == QUEUE_BUCKET ? bucketRemove(&queue->buckets, name, &patient)
+                                            : removePatient(&queue->heap, name, &patient);
+    if (found) {
+        agingUntrack(queue, patient.agingNode);
+        journalEvent(queue, JOURNAL_REMOVE, &patient);
+        if (removed != NULL) {
+            *removed = patient;
+        }
+    }
+    OP_STATS_STOP(OP_REMOVE_PATIENT, timer);
+    return found;
+}
+
+// Look up a waiting patient by name, or NULL if not queued
+const Patient* queueFind(const PatientQueue* queue, const char* name) {
+    if (queue->type == QUEUE_BUCKET) {
+        int node = bucketFind(&queue->buckets, name);
+        return node == -1 ? NULL : &queue->buckets.nodes[node].patient;
+    }
+    int handle = findPatient(&queue->heap, name);
+    return handle == -1 ? NULL : &queue->heap.records[handle];
+}
+
+// Read a batch list, one entry per line: "name severity" or "admit name severity" admits a patient,
+// "update name severity" changes a severity; '#' starts a comment. Malformed lines are skipped, so count may be 0
+BatchEntry* readBatch(FILE* file, int* count) {
+    int capacity = INITIAL_CAPACITY;
+    BatchEntry* entries = (BatchEntry*)checkedAlloc(malloc(capacity * sizeof(BatchEntry)));
+    char line[256], word[MAX_NAME_LENGTH], name[MAX_NAME_LENGTH];
+    int severity;
+    long lineNumber = 0;
+    *count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char first = line[strspn(line, " \t\r\n")];
+        if (first == '\0' || first == '#') {
+            continue;
+        }
+        BatchEntry entry;
+        if (sscanf(line, "%49s %49s %d", word, name, &severity) == 3 &&
+            (strcmp(word, "admit") == 0 || strcmp(word, "update") == 0)) {
+            entry.action = strcmp(word, "update") == 0 ? BATCH_UPDATE : BATCH_ADMIT;
+        } else if (sscanf(line, "%49s %d", name, &severity) == 2) {
+            entry.action = BATCH_ADMIT;
+        } else {
+            printf(RED "Skipping malformed batch line %ld\n" RESET, lineNumber);
+            continue;
+        }
+        if (severity < 0 || severity > MAX_SEVERITY) {
+            printf(RED "Skipping batch line %ld: severity must be between 0 and 10\n" RESET, lineNumber);
+            continue;
+        }
+        strcpy(entry.name, name);
+        entry.severity = severity;
+        if (*count == capacity) {
+            capacity *= 2;
+            entries = (BatchEntry*)checkedAlloc(realloc(entries, capacity * sizeof(BatchEntry)));
+        }
+        entries[(*count)++] = entry;
+    }
+    return entries;
+}
+
+// Whether one bottom-up repair pass over the heap is cheaper than sifting each batch entry
+// The pass costs about n sift steps; per-entry sifting costs up to log2(n) each
+int batchUsesRepairPass(int waiting, int batchSize) {
+    int total = waiting + batchSize;
+    int depth = 1;
+    while ((1 << depth) < total) {
+        depth++;
+    }
+    return (long)batchSize * depth >= total;
+}
+
+// Apply a batch of admissions and severity updates; the heap is repaired once at the end when useRepairPass is set
+int applyBatch(PatientQueue* queue, const BatchEntry* entries, int count, int useRepairPass) {
+    int ordered = !(useRepairPass && queue->type == QUEUE_HEAP);
+    if (!ordered) {
+        reserveHeapFor(&queue->heap, count);
+    }
+    int applied = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].action == BATCH_ADMIT) {
+            applied += queueAdmit(queue, entries[i].name, entries[i].severity, -1, ordered);
+        } else {
+            applied += queueChangeSeverity(queue, entries[i].name, entries[i].severity, ordered);
+        }
+    }
+    if (!ordered) {
+        repairHeap(&queue->heap);
+    }
+    return applied;
+}
+
+// Apply a batch, picking per-entry sifting or one repair pass by batch size; returns how many entries took effect
+int queueApplyBatch(PatientQueue* queue, const BatchEntry* entries, int count) {
+    OP_STATS_START(timer);
+    int applied = applyBatch(queue, entries, count, batchUsesRepairPass(queueSize(queue), count));
+    OP_STATS_STOP(OP_APPLY_BATCH, timer);
+    return applied;
+}
+
+// Apply a batch file ("-" = stdin) to the queue; returns 0 if the file could not be read or held no valid entries
+int admitBatchFromPath(PatientQueue* queue, const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        printf(RED "Cannot open batch file %s\n" RESET, path);
+        return 0;
+    }
+    int count;
+    BatchEntry* entries = readBatch(file, &count);
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (count == 0) {
+        printf(RED "No valid entries in batch file %s\n" RESET, path);
+        free(entries);
+        return 0;
+    }
+    double start = nowSeconds();
+    int applied = queueApplyBatch(queue, entries, count);
+    printf(GREEN "Applied %d of %d batch entries in %.3f ms\n" RESET, applied, count, (nowSeconds() - start) * 1000);
+    free(entries);
+    return 1;
+}
+
+// Batch benchmark: per-entry sifting against one repair pass, for a mass-casualty batch and for a mixed batch
+// Usage: bench-batch [patients]
+int runBatchBenchmark(int argc, char* argv[]) {
+    int patients = argc > 2 ? atoi(argv[2]) : 200000;
+    opStatsSetEnabled(0); // The clock reads would be counted in the timings being compared
+    if (patients < 1) {
+        printf(RED "Usage: bench-batch [patients >= 1]\n" RESET);
+        return 1;
+    }
+    printf(BOLD "Batch admission benchmark, %s build\n" RESET, PQ_BACKEND_NAME);
+    printf("| %-30s | %8s | %8s | %12s | %12s | %7s |\n", "Batch", "Waiting", "Entries", "Single ns/op", "Batch ns/op",
+           "Speedup");
+    BatchEntry* entries = (BatchEntry*)checkedAlloc(malloc(patients * sizeof(BatchEntry)));
+    unsigned int seed = 11;
+    // Mass casualty: every patient arrives in one batch; mixed: a tenth of the queue arrives while a tenth is re-triaged
+    for (int scenario = 0; scenario < 2; scenario++) {
+        int waiting = scenario == 0 ? 0 : patients;
+        int count = scenario == 0 ? patients : patients / 5;
+        for (int i = 0; i < count; i++) {
+            if (scenario == 1 && i % 2 == 1) {
+                entries[i].action = BATCH_UPDATE;
+                snprintf(entries[i].name, MAX_NAME_LENGTH, "w%d", (int)(rand_r(&seed) % waiting));
+            } else {
+                entries[i].action = BATCH_ADMIT;
+                snprintf(entries[i].name, MAX_NAME_LENGTH, "b%d", i);
+            }
+            entries[i].severity = rand_r(&seed) % NUM_SEVERITIES;
+        }
+        // Best of three runs per strategy, alternating so neither always starts on a cold allocator
+        double seconds[2] = {1e30, 1e30};
+        for (int run = 0; run < 6; run++) {
+            int useRepairPass = run % 2;
+            PatientQueue queue;
+            initQueue(&queue, QUEUE_HEAP);
+            char name[MAX_NAME_LENGTH];
+            unsigned int fillSeed = 5;
+            for (int i = 0; i < waiting; i++) {
+                snprintf(name, sizeof(name), "w%d", i);
+                queueInsert(&queue, name, rand_r(&fillSeed) % NUM_SEVERITIES);
+            }
+            double start = nowSeconds();
+            applyBatch(&queue, entries, count, useRepairPass);
+            double elapsed = nowSeconds() - start;
+            if (elapsed < seconds[useRepairPass]) {
+                seconds[useRepairPass] = elapsed;
+            }
+            freeQueue(&queue);
+        }
+        printf("| %-30s | %8d | %8d | %12.1f | %12.1f | %6.2fx |\n",
+               scenario == 0 ? "Mass casualty (admit only)" : "Mixed admit + update", waiting, count,
+               seconds[0] * 1e9 / count, seconds[1] * 1e9 / count, seconds[1] > 0 ? seconds[0] / seconds[1] : 0.0);
+    }
+    free(entries);
+    return 0;
+}
+
+// Push a heap position onto a cursor's frontier (a small max-heap of positions ordered by priority)
+void frontierPush(QueueCursor* cursor, int slot) {
+    const MaxHeap* heap = &cursor->queue->heap;
+    if (cursor->frontierSize == cursor->frontierCapacity) {
+        int newCapacity = cursor->frontierCapacity * 2;
+        int* grown = (int*)checkedAlloc(malloc(newCapacity * sizeof(int)));
+        memcpy(grown, cursor->frontier, cursor->frontierSize * sizeof(int));
+        if (cursor->frontier != cursor->inlineFrontier) {
+            free(cursor->frontier);
+        }
+        cursor->frontier = grown;
+        cursor->frontierCapacity = newCapacity;
+    }
+    int i = cursor->frontierSize++;
+    while (i > 0 && heapPriorityAt(heap, cursor->frontier[(i - 1) / 2]) < heapPriorityAt(heap, slot)) {
+        cursor->frontier[i] = cursor->frontier[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    cursor->frontier[i] = slot;
+}
+
+// Pop the highest-priority heap position from a cursor's frontier
+int frontierPop(QueueCursor* cursor) {
+    const MaxHeap* heap = &cursor->queue->heap;
+    int top = cursor->frontier[0];
+    int last = cursor->frontier[--cursor->frontierSize];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= cursor->frontierSize) {
+            break;
+        }
+        if (child + 1 < cursor->frontierSize &&
+            heapPriorityAt(heap, cursor->frontier[child + 1]) > heapPriorityAt(heap, cursor->frontier[child])) {
+            child++;
+        }
+        if (heapPriorityAt(heap, cursor->frontier[child]) <= heapPriorityAt(heap, last)) {
+            break;
+        }
+        cursor->frontier[i] = cursor->frontier[child];
+        i = child;
+    }
+    cursor->frontier[i] = last;
+    return top;
+}
+
+// Start a read-only walk over the queue in treatment order; the queue must not change until endOrdered
+void beginOrdered(const PatientQueue* queue, QueueCursor* cursor) {
+    cursor->queue = queue;
+    cursor->frontier = cursor->inlineFrontier;
+    cursor->frontierCapacity = CURSOR_INLINE_SLOTS;
+    cursor->frontierSize = 0;
+    if (queue->type == QUEUE_BUCKET) {
+        cursor->priority = NUM_PRIORITIES - 1;
+        cursor->node = queue->buckets.head[NUM_PRIORITIES - 1];
+    } else if (queue->heap.size > 0) {
+        frontierPush(cursor, heapRootPosition(&queue->heap));
+    }
+}
+
+// Return the next patient in treatment order, or NULL when the walk is done
+// Heap: only the children of visited positions can come next, so the k-th patient costs O(log k) for the
+// array heaps; a pairing heap node can have many children, and all of them join the frontier at once
+// Buckets: O(1) amortized, following each priority's line
+const Patient* nextOrdered(QueueCursor* cursor) {
+    const PatientQueue* queue = cursor->queue;
+    if (queue->type == QUEUE_BUCKET) {
+        const BucketQueue* buckets = &queue->buckets;
+        while (cursor->node == -1) {
+            // Jump straight to the next non-empty priority below the current one
+            unsigned int lower = buckets->nonEmpty & ((1u << cursor->priority) - 1);
+            if (cursor->priority == 0 || lower == 0) {
+                return NULL;
+            }
+            cursor->priority = 31 - __builtin_clz(lower);
+            cursor->node = buckets->head[cursor->priority];
+        }
+        const Patient* patient = &buckets->nodes[cursor->node].patient;
+        cursor->node = buckets->nodes[cursor->node].next;
+        return patient;
+    }
+
+    if (cursor->frontierSize == 0) {
+        return NULL;
+    }
+    const MaxHeap* heap = &queue->heap;
+    int position = frontierPop(cursor);
+    for (int child = heapFirstChild(heap, position); child != -1; child = heapNextSibling(heap, child)) {
+        frontierPush(cursor, child);
+    }
+    return &heap->records[heapHandleAt(heap, position)];
+}
+
+// Release a cursor's frontier storage
+void endOrdered(QueueCursor* cursor) {
+    if (cursor->frontier != cursor->inlineFrontier) {
+        free(cursor->frontier);
+    }
+    cursor->frontier = NULL;
+}
+
+// Display current patients with the most severe patient highlighted
+// Shows at most maxRows patients (0 = all); only the rows shown are visited
+void displayPatients(const PatientQueue* queue, int maxRows) {
+    int total = queueSize(queue);
+    if (total == 0) {
+        printf(RED "No patients in the queue.\n" RESET);
+        return;
+    }
+
+    ReportOutput* out = reportBegin();
+    reportText(out, "\n");
+    reportStyle(out, YELLOW);
+    reportText(out, "Current Patients in the Queue:\n");
+    reportStyle(out, CYAN);
+    reportText(out, "+---------------------------+----------+\n"
+                    "| Patient Name              | Severity |\n"
+                    "+---------------------------+----------+\n");
+
+    QueueCursor cursor;
+    beginOrdered(queue, &cursor);
+    int shown = 0;
+    const Patient* p;
+    while ((maxRows == 0 || shown < maxRows) && (p = nextOrdered(&cursor)) != NULL) {
+        // The next patient to treat is highlighted in red; an aging bonus shows as "(+n)"
+        char severity[32];
+        if (p->priority > p->severity) {
+            snprintf(severity, sizeof(severity), "%d (+%d)", p->severity, p->priority - p->severity);
+        } else {
+            snprintf(severity, sizeof(severity), "%d", p->severity);
+        }
+        reportStyle(out, shown == 0 ? RED : CYAN);
+        reportText(out, "| ");
+        reportPadded(out, p->name, 25);
+        reportText(out, " | ");
+        reportPadded(out, severity, 8);
+        reportText(out, " |\n");
+        shown++;
+    }
+    endOrdered(&cursor);
+
+    reportStyle(out, CYAN);
+    reportText(out, "+---------------------------+----------+\n");
+    if (shown < total) {
+        reportStyle(out, YELLOW);
+        reportFormat(out, "... and %d more waiting (choose Display Patients to see all)\n", total - shown);
+    }
+    reportEnd(out);
+}
+
+// ---------------------------------------------------------------------------
+// Concurrent triage queue for several triage desks (producers) and doctors
+// (consumers). Each severity has its own lock-free bounded MPMC ring, so
+// inserts at different severities never touch the same cache lines and no
+// insert ever takes a lock. Idle doctors block on a condition variable.
+// ---------------------------------------------------------------------------
+
+// Initialize one lock-free ring with a power-of-two capacity
+void initTriageRing(TriageRing* ring, size_t capacity) {
+    ring->cells = (TriageCell*)checkedAlloc(malloc(capacity * sizeof(TriageCell)));
+    ring->mask = capacity - 1;
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+    atomic_init(&ring->enqueuePos, 0);
+    atomic_init(&ring->dequeuePos, 0);
+}
+
+// Append a patient to a ring; returns 0 if the ring is full
+int triageRingPush(TriageRing* ring, const Patient* patient) {
+    size_t pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
+    while (1) {
+        TriageCell* cell = &ring->cells[pos & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            // The cell is free for this lap; claim it by advancing the enqueue position
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->patient = *patient;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+// Take the oldest patient from a ring; returns 0 if the ring is empty
+int triageRingPop(TriageRing* ring, Patient* patient) {
+    size_t pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+    while (1) {
+        TriageCell* cell = &ring->cells[pos & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *patient = cell->patient;
+                // Hand the cell back to producers for the next lap
+                atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+        }
+    }
+}
+
+// Initialize a concurrent triage queue; each severity holds up to capacityPerSeverity patients (rounded up to a power of two)
+void initConcurrentQueue(ConcurrentTriageQueue* queue, size_t capacityPerSeverity) {
+    size_t capacity = 2;
+    while (capacity < capacityPerSeverity) {
+        capacity *= 2;
+    }
+    for (int s = 0; s < NUM_SEVERITIES; s++) {
+        initTriageRing(&queue->rings[s], capacity);
+    }
+    atomic_init(&queue->waiting, 0);
+    atomic_init(&queue->sleepers, 0);
+    atomic_init(&queue->closed, 0);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->available, NULL);
+}
+
+// Free a concurrent triage queue (no threads may be using it)
+void freeConcurrentQueue(ConcurrentTriageQueue* queue) {
+    for (int s = 0; s < NUM_SEVERITIES; s++) {
+        free(queue->rings[s].cells);
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->available);
+}
+
+// Admit a patient without taking any lock; returns 0 if that severity's ring is full
+int concurrentInsert(ConcurrentTriageQueue* queue, const char* name, int severity) {
+    Patient patient;
+    strncpy(patient.name, name, MAX_NAME_LENGTH - 1);
+    patient.name[MAX_NAME_LENGTH - 1] = '\0';
+    patient.severity = severity;
+    patient.priority = severity;
+    patient.arrivalTime = 0;
+    patient.agingNode = -1;
+    patient.caseId = -1;
+    if (!triageRingPush(&queue->rings[severity], &patient)) {
+        return 0;
+    }
+    atomic_fetch_add(&queue->waiting, 1);
+    // Only pay for the mutex when a doctor is actually asleep
+    if (atomic_load(&queue->sleepers) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(&queue->available);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return 1;
+}
+
+// Take the most severe waiting patient without blocking; returns 0 if none is waiting
+int concurrentTryExtractMax(ConcurrentTriageQueue* queue, Patient* patient) {
+    if (atomic_load_explicit(&queue->waiting, memory_order_relaxed) <= 0) {
+        return 0;
+    }
+    for (int s = MAX_SEVERITY; s >= 0; s--) {
+        if (triageRingPop(&queue->rings[s], patient)) {
+            atomic_fetch_sub(&queue->waiting, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Take the most severe waiting patient, sleeping while the queue is empty
+// Returns 0 once the queue is closed and drained
+int concurrentExtractMax(ConcurrentTriageQueue* queue, Patient* patient) {
+    while (1) {
+        if (concurrentTryExtractMax(queue, patient)) {
+            return 1;
+        }
+        pthread_mutex_lock(&queue->lock);
+        atomic_fetch_add(&queue->sleepers, 1);
+        while (atomic_load(&queue->waiting) <= 0 && !atomic_load(&queue->closed)) {
+            pthread_cond_wait(&queue->available, &queue->lock);
+        }
+        atomic_fetch_sub(&queue->sleepers, 1);
+        int finished = atomic_load(&queue->closed) && atomic_load(&queue->waiting) <= 0;
+        pthread_mutex_unlock(&queue->lock);
+        if (finished) {
+            return 0;
+        }
+    }
+}
+
+// Stop admissions: doctors drain what is left, then concurrentExtractMax returns 0
+void closeConcurrentQueue(ConcurrentTriageQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    atomic_store(&queue->closed, 1);
+    pthread_cond_broadcast(&queue->available);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Return monotonic time in seconds
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Calendar time in seconds; arrival times measured on it stay meaningful after a restart
+double wallClockSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Arguments and results of one triage desk or doctor thread in the concurrency demo
+typedef struct {
+    ConcurrentTriageQueue* queue;   // Lock-free queue, or NULL to use lockedQueue
+    PatientQueue* lockedQueue;      // Baseline: one PatientQueue behind a single mutex
+    pthread_mutex_t* lockedQueueLock;
+    atomic_int* desksDone;          // Baseline: set once every desk has finished
+    int id;
+    long patients;                  // Patients to admit (desks) or treated (doctors)
+    long fullRetries;               // Desk: inserts that found the severity ring full
+    unsigned int seed;
+} TriageWorker;
+
+// Triage desk: admit patients with random severities
+void* triageDesk(void* arg) {
+    TriageWorker* worker = (TriageWorker*)arg;
+    char name[MAX_NAME_LENGTH];
+    for (long i = 0; i < worker->patients; i++) {
+        snprintf(name, sizeof(name), "desk%d-%ld", worker->id, i);
+        int severity = rand_r(&worker->seed) % NUM_SEVERITIES;
+        if (worker->queue != NULL) {
+            while (!concurrentInsert(worker->queue, name, severity)) {
+                worker->fullRetries++;
+                sched_yield();
+            }
+        } else {
+            pthread_mutex_lock(worker->lockedQueueLock);
+            queueInsert(worker->lockedQueue, name, severity);
+            pthread_mutex_unlock(worker->lockedQueueLock);
+        }
+    }
+    return NULL;
+}
+
+// Doctor: treat patients until the queue is closed and empty
+void* doctorWorker(void* arg) {
+    TriageWorker* worker = (TriageWorker*)arg;
+    Patient patient;
+    worker->patients = 0;
+    if (worker->queue != NULL) {
+        while (concurrentExtractMax(worker->queue, &patient)) {
+            worker->patients++;
+        }
+        return NULL;
+    }
+    // Baseline doctors poll the locked queue until the desks are done and it is empty
+    while (1) {
+        int desksDone = atomic_load(worker->desksDone);
+        pthread_mutex_lock(worker->lockedQueueLock);
+        int waiting = queueSize(worker->lockedQueue);
+        if (waiting > 0) {
+            patient = queueExtractMax(worker->lockedQueue);
+            worker->patients++;
+        }
+        pthread_mutex_unlock(worker->lockedQueueLock);
+        if (waiting == 0) {
+            if (desksDone) {
+                return NULL;
+            }
+            sched_yield();
+        }
+    }
+}
+
+// Run desks and doctors against either queue and return the elapsed seconds
+double runTriageWorkload(ConcurrentTriageQueue* queue, PatientQueue* lockedQueue, int desks, int doctors,
+                         long patientsPerDesk, long* treated, long* fullRetries) {
+    pthread_mutex_t lockedQueueLock = PTHREAD_MUTEX_INITIALIZER;
+    atomic_int desksDone;
+    atomic_init(&desksDone, 0);
+    TriageWorker* workers = (TriageWorker*)checkedAlloc(calloc(desks + doctors, sizeof(TriageWorker)));
+    pthread_t* threads = (pthread_t*)checkedAlloc(malloc((desks + doctors) * sizeof(pthread_t)));
+
+    double start = nowSeconds();
+    for (int i = 0; i < desks + doctors; i++) {
+        workers[i].queue = queue;
+        workers[i].lockedQueue = lockedQueue;
+        workers[i].lockedQueueLock = &lockedQueueLock;
+        workers[i].desksDone = &desksDone;
+        workers[i].id = i;
+        workers[i].patients = i < desks ? patientsPerDesk : 0;
+        workers[i].seed = 1000u + i;
+        pthread_create(&threads[i], NULL, i < desks ? triageDesk : doctorWorker, &workers[i]);
+    }
+    for (int i = 0; i < desks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (queue != NULL) {
+        closeConcurrentQueue(queue);
+    }
+    atomic_store(&desksDone, 1);
+    for (int i = desks; i < desks + doctors; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = nowSeconds() - start;
+
+    *treated = 0;
+    *fullRetries = 0;
+    for (int i = 0; i < desks + doctors; i++) {
+        if (i < desks) {
+            *fullRetries += workers[i].fullRetries;
+        } else {
+            *treated += workers[i].patients;
+        }
+    }
+    free(workers);
+    free(threads);
+    return elapsed;
+}
+
+// Concurrency demo: several triage desks and doctors share one queue
+// Usage: concurrent [desks] [doctors] [patients per desk]
+int runConcurrentDemo(int argc, char* argv[]) {
+    int desks = argc > 2 ? atoi(argv[2]) : 4;
+    int doctors = argc > 3 ? atoi(argv[3]) : 4;
+    long patientsPerDesk = argc > 4 ? atol(argv[4]) : 250000;
+    if (desks < 1 || doctors < 1 || patientsPerDesk < 0) {
+        printf(RED "Usage: concurrent [desks >= 1] [doctors >= 1] [patients per desk]\n" RESET);
+        return 1;
+    }
+    long total = desks * patientsPerDesk;
+    long treated, fullRetries;
+
+    ConcurrentTriageQueue queue;
+    initConcurrentQueue(&queue, CONCURRENT_RING_CAPACITY);
+    double lockFreeTime = runTriageWorkload(&queue, NULL, desks, doctors, patientsPerDesk, &treated, &fullRetries);
+    freeConcurrentQueue(&queue);
+    printf(BOLD "%d triage desks, %d doctors, %ld patients\n" RESET, desks, doctors, total);
+    printf(GREEN "Lock-free severity rings: %.0f patients/s (%ld treated, %ld full-ring retries)\n" RESET,
+           total / lockFreeTime, treated, fullRetries);
+
+    PatientQueue lockedQueue;
+    initQueue(&lockedQueue, QUEUE_BUCKET);
+    double lockedTime = runTriageWorkload(NULL, &lockedQueue, desks, doctors, patientsPerDesk, &treated, &fullRetries);
+    freeQueue(&lockedQueue);
+    printf(CYAN "Single-mutex bucket queue: %.0f patients/s (%ld treated)\n" RESET, total / lockedTime, treated);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Department lanes with work stealing. Each department (trauma, cardiac,
+// pediatric) has its own concurrent triage queue and its own doctors. A
+// doctor treats from their own lane first; when it is empty they steal the
+// most severe patient waiting in any other lane. Choosing a victim only reads
+// ring positions, so stealing costs one CAS on the victim's ring.
+// ---------------------------------------------------------------------------
+
+const char* departmentNames[NUM_DEPARTMENTS] = {"trauma", "cardiac", "pediatric"};
+
+// Severity of the most severe patient waiting in a concurrent queue, or -1 if it looks empty
+// Lock-free hint: a concurrent insert or pop may change the answer right away
+int concurrentPeekSeverity(ConcurrentTriageQueue* queue) {
+    if (atomic_load_explicit(&queue->waiting, memory_order_relaxed) <= 0) {
+        return -1;
+    }
+    for (int s = MAX_SEVERITY; s >= 0; s--) {
+        TriageRing* ring = &queue->rings[s];
+        if (atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed) !=
+            atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed)) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// Initialize the department lanes
+void initDepartmentQueues(DepartmentQueues* queues, size_t capacityPerSeverity) {
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        initConcurrentQueue(&queues->lanes[d], capacityPerSeverity);
+    }
+    atomic_init(&queues->waiting, 0);
+    atomic_init(&queues->sleepers, 0);
+    atomic_init(&queues->closed, 0);
+    pthread_mutex_init(&queues->lock, NULL);
+    pthread_cond_init(&queues->available, NULL);
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        pthread_cond_init(&queues->laneAvailable[d], NULL);
+    }
+}
+
+// Free the department lanes (no threads may be using them)
+void freeDepartmentQueues(DepartmentQueues* queues) {
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        freeConcurrentQueue(&queues->lanes[d]);
+    }
+    pthread_mutex_destroy(&queues->lock);
+    pthread_cond_destroy(&queues->available);
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        pthread_cond_destroy(&queues->laneAvailable[d]);
+    }
+}
+
+// Admit a patient to a department's lane; returns 0 if that lane's severity ring is full
+int departmentAdmit(DepartmentQueues* queues, Department department, const char* name, int severity) {
+    if (!concurrentInsert(&queues->lanes[department], name, severity)) {
+        return 0;
+    }
+    atomic_fetch_add(&queues->waiting, 1);
+    if (atomic_load(&queues->sleepers) > 0) {
+        // Wake one doctor that can take it: any stealing doctor, or one of the lane's own
+        pthread_mutex_lock(&queues->lock);
+        pthread_cond_signal(&queues->available);
+        pthread_cond_signal(&queues->laneAvailable[department]);
+        pthread_mutex_unlock(&queues->lock);
+    }
+    return 1;
+}
+
+// Take the next patient for a doctor of the home department, sleeping while every lane is empty
+// With stealing off the doctor only serves the home lane
+// Returns the lane the patient came from, or -1 once the lanes are closed and drained
+int departmentTreat(DepartmentQueues* queues, Department home, int allowSteal, Patient* patient) {
+    while (1) {
+        if (concurrentTryExtractMax(&queues->lanes[home], patient)) {
+            atomic_fetch_sub(&queues->waiting, 1);
+            return home;
+        }
+        if (allowSteal) {
+            int victim = -1, victimSeverity = -1;
+            for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+                int severity = d == (int)home ? -1 : concurrentPeekSeverity(&queues->lanes[d]);
+                if (severity > victimSeverity) {
+                    victim = d;
+                    victimSeverity = severity;
+                }
+            }
+            if (victim != -1) {
+                if (concurrentTryExtractMax(&queues->lanes[victim], patient)) {
+                    atomic_fetch_sub(&queues->waiting, 1);
+                    return victim;
+                }
+                continue; // Another doctor got there first; look again
+            }
+        } else if (atomic_load_explicit(&queues->lanes[home].waiting, memory_order_relaxed) > 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&queues->lock);
+        atomic_fetch_add(&queues->sleepers, 1);
+        while (!atomic_load(&queues->closed) &&
+               (allowSteal ? atomic_load(&queues->waiting) <= 0 : atomic_load(&queues->lanes[home].waiting) <= 0)) {
+            pthread_cond_wait(allowSteal ? &queues->available : &queues->laneAvailable[home], &queues->lock);
+        }
+        atomic_fetch_sub(&queues->sleepers, 1);
+        int finished = atomic_load(&queues->closed) &&
+                       (allowSteal ? atomic_load(&queues->waiting) <= 0 : atomic_load(&queues->lanes[home].waiting) <= 0);
+        pthread_mutex_unlock(&queues->lock);
+        if (finished) {
+            return -1;
+        }
+    }
+}
+
+// Stop admissions: doctors drain what is left, then departmentTreat returns -1
+void closeDepartmentQueues(DepartmentQueues* queues) {
+    pthread_mutex_lock(&queues->lock);
+    atomic_store(&queues->closed, 1);
+    pthread_cond_broadcast(&queues->available);
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        pthread_cond_broadcast(&queues->laneAvailable[d]);
+    }
+    pthread_mutex_unlock(&queues->lock);
+}
+
+// Arguments and results of one desk or doctor thread in the department demo
 typedef struct {
-    Patient patients[MAX_PATIENTS];
-    int size;
-} MaxHeap;
+    DepartmentQueues* queues;
+    Department department;          // Doctor: home lane
+    int allowSteal;
+    int id;
+    long patients;                  // Desk: patients to admit
+    long admitted[NUM_DEPARTMENTS]; // Desk: patients routed to each lane
+    long treatedFrom[NUM_DEPARTMENTS]; // Doctor: patients treated from each lane
+    unsigned int seed;
+} DepartmentWorker;
 
-// Function prototypes
-void initHeap(MaxHeap* heap);
-void insert(MaxHeap* heap, const char* name, int severity);
-Patient extractMax(MaxHeap* heap);
-void heapify(MaxHeap* heap, int index);
-void updateSeverity(MaxHeap* heap, const char* name, int newSeverity);
-void displayPatients(MaxHeap* heap);
-void swap(Patient* a, Patient* b);
-void printLine(char ch, int length);
-void interactiveMenu(MaxHeap* heap);
-int getSeverityInput();
+// Desk: route arriving patients to departments (trauma 60%, cardiac 30%, pediatric 10%)
+void* departmentDesk(void* arg) {
+    DepartmentWorker* worker = (DepartmentWorker*)arg;
+    char name[MAX_NAME_LENGTH];
+    for (long i = 0; i < worker->patients; i++) {
+        snprintf(name, sizeof(name), "desk%d-%ld", worker->id, i);
+        int roll = rand_r(&worker->seed) % 10;
+        Department department = roll < 6 ? DEPARTMENT_TRAUMA : roll < 9 ? DEPARTMENT_CARDIAC : DEPARTMENT_PEDIATRIC;
+        int severity = rand_r(&worker->seed) % NUM_SEVERITIES;
+        while (!departmentAdmit(worker->queues, department, name, severity)) {
+            sched_yield();
+        }
+        worker->admitted[department]++;
+    }
+    return NULL;
+}
 
-int main() {
-    MaxHeap heap;
-    initHeap(&heap);
-    interactiveMenu(&heap);
+// Doctor: treat patients until the lanes are closed and drained
+void* departmentDoctor(void* arg) {
+    DepartmentWorker* worker = (DepartmentWorker*)arg;
+    Patient patient;
+    int lane;
+    while ((lane = departmentTreat(worker->queues, worker->department, worker->allowSteal, &patient)) != -1) {
+        // Stand-in for the time a treatment takes
+        for (volatile int work = 0; work < DEPARTMENT_TREATMENT_WORK; work++) {
+        }
+        worker->treatedFrom[lane]++;
+    }
+    return NULL;
+}
+
+// Run desks and per-lane doctors once; fills per-lane admitted, treated and steal counts and returns elapsed seconds
+double runDepartmentWorkload(int desks, int doctorsPerLane, long patientsPerDesk, int allowSteal,
+                             long admitted[], long treated[], long stolenFrom[], long stealsBy[]) {
+    DepartmentQueues queues;
+    initDepartmentQueues(&queues, CONCURRENT_RING_CAPACITY);
+    int doctors = doctorsPerLane * NUM_DEPARTMENTS;
+    DepartmentWorker* workers = (DepartmentWorker*)checkedAlloc(calloc(desks + doctors, sizeof(DepartmentWorker)));
+    pthread_t* threads = (pthread_t*)checkedAlloc(malloc((desks + doctors) * sizeof(pthread_t)));
+
+    double start = nowSeconds();
+    for (int i = 0; i < desks + doctors; i++) {
+        workers[i].queues = &queues;
+        workers[i].id = i;
+        workers[i].allowSteal = allowSteal;
+        workers[i].department = i < desks ? DEPARTMENT_TRAUMA : (Department)((i - desks) / doctorsPerLane);
+        workers[i].patients = i < desks ? patientsPerDesk : 0;
+        workers[i].seed = 2000u + i;
+        pthread_create(&threads[i], NULL, i < desks ? departmentDesk : departmentDoctor, &workers[i]);
+    }
+    for (int i = 0; i < desks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    closeDepartmentQueues(&queues);
+    for (int i = desks; i < desks + doctors; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = nowSeconds() - start;
+
+    for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+        admitted[d] = treated[d] = stolenFrom[d] = stealsBy[d] = 0;
+    }
+    for (int i = 0; i < desks + doctors; i++) {
+        for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+            if (i < desks) {
+                admitted[d] += workers[i].admitted[d];
+                continue;
+            }
+            treated[d] += workers[i].treatedFrom[d];
+            if (d != (int)workers[i].department) {
+                stolenFrom[d] += workers[i].treatedFrom[d];
+                stealsBy[workers[i].department] += workers[i].treatedFrom[d];
+            }
+        }
+    }
+    free(workers);
+    free(threads);
+    freeDepartmentQueues(&queues);
+    return elapsed;
+}
+
+// Department demo: trauma, cardiac and pediatric lanes with their own doctors, with and without work stealing
+// Usage: departments [doctors per lane] [patients per desk]
+int runDepartmentDemo(int argc, char* argv[]) {
+    const int desks = 2;
+    int doctorsPerLane = argc > 2 ? atoi(argv[2]) : 2;
+    long patientsPerDesk = argc > 3 ? atol(argv[3]) : 200000;
+    if (doctorsPerLane < 1 || patientsPerDesk < 0) {
+        printf(RED "Usage: departments [doctors per lane >= 1] [patients per desk]\n" RESET);
+        return 1;
+    }
+    long admitted[NUM_DEPARTMENTS], treated[NUM_DEPARTMENTS], stolenFrom[NUM_DEPARTMENTS], stealsBy[NUM_DEPARTMENTS];
+    printf(BOLD "%d desks, %d doctors per lane, %ld patients (trauma 60%%, cardiac 30%%, pediatric 10%%)\n" RESET,
+           desks, doctorsPerLane, desks * patientsPerDesk);
+
+    for (int allowSteal = 0; allowSteal <= 1; allowSteal++) {
+        double elapsed = runDepartmentWorkload(desks, doctorsPerLane, patientsPerDesk, allowSteal,
+                                               admitted, treated, stolenFrom, stealsBy);
+        printf(allowSteal ? GREEN "\nWith work stealing: %.3f s\n" RESET : CYAN "\nOwn lane only: %.3f s\n" RESET, elapsed);
+        printf("| %-10s | %9s | %9s | %12s | %11s | %10s |\n", "Lane", "Admitted", "Treated", "Stolen from", "Steals made",
+               "Patients/s");
+        for (int d = 0; d < NUM_DEPARTMENTS; d++) {
+            printf("| %-10s | %9ld | %9ld | %12ld | %11ld | %10.0f |\n", departmentNames[d], admitted[d], treated[d],
+                   stolenFrom[d], stealsBy[d], elapsed > 0 ? treated[d] / elapsed : 0.0);
+        }
+    }
     return 0;
 }
 
-// Initialize the heap
-void initHeap(MaxHeap* heap) {
-    heap->size = 0;
+// ---------------------------------------------------------------------------
+// Crash-safe journal. Every admit, treat, update and remove is appended to a
+// binary journal as it happens, so a crashed process loses nothing the kernel
+// has seen. fsync is batched to bound its cost. Every JOURNAL_SNAPSHOT_EVERY
+// records the waiting list is written to a compact snapshot and the journal
+// starts over; a restart loads the snapshot and replays the journal tail.
+// ---------------------------------------------------------------------------
+
+// FNV-1a over a block of bytes
+uint32_t checksumBytes(const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Checksum of a journal record, excluding its checksum field
+uint32_t recordChecksum(const JournalRecord* record) {
+    return checksumBytes((const char*)record + sizeof(record->checksum), sizeof(JournalRecord) - sizeof(record->checksum));
 }
 
-// Insert a patient into the max-heap
-void insert(MaxHeap* heap, const char* name, int severity) {
-    if (heap->size >= MAX_PATIENTS) {
-        printf(RED "Heap is full!\n" RESET);
+// Write a whole buffer or exit: a journal that silently drops events is worse than none
+void writeFully(int fd, const void* data, size_t length, const char* path) {
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf(RED "Journal write to %s failed: %s\n" RESET, path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        bytes += written;
+        length -= written;
+    }
+}
+
+// Flush journal records written so far to stable storage
+void syncJournal(Journal* journal) {
+    if (journal != NULL && journal->unsynced > 0) {
+        // After a failed sync the kernel may already have dropped the records, so retrying cannot be trusted
+        if (fdatasync(journal->fd) != 0) {
+            printf(RED "Journal sync of %s failed: %s\n" RESET, journal->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        journal->unsynced = 0;
+    }
+}
+
+// fsync the directory holding a file so a rename into it survives a crash
+void syncParentDirectory(const char* path) {
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s", path);
+    char* slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else if (slash == directory) {
+        slash[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    int fd = open(directory, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Write the waiting list to a new snapshot, then start the journal over
+// The snapshot is written to a temporary file and renamed into place, so a crash leaves either the old or the new one
+void writeSnapshot(PatientQueue* queue) {
+    Journal* journal = queue->journal;
+    int count = queueSize(queue);
+    SnapshotEntry* entries = (SnapshotEntry*)checkedAlloc(calloc(count > 0 ? count : 1, sizeof(SnapshotEntry)));
+    // Bucket lines are saved in treatment order so first-come-first-served survives a restore;
+    // heap records are saved in handle order, since the restore rebuilds the heap bottom-up anyway
+    int n = 0;
+    if (queue->type == QUEUE_BUCKET) {
+        QueueCursor cursor;
+        const Patient* patient;
+        beginOrdered(queue, &cursor);
+        while ((patient = nextOrdered(&cursor)) != NULL) {
+            memcpy(entries[n].name, patient->name, MAX_NAME_LENGTH);
+            entries[n].severity = patient->severity;
+            entries[n].arrivalTime = patient->arrivalTime;
+            n++;
+        }
+        endOrdered(&cursor);
+    } else {
+        for (int handle = 0; handle < queue->heap.handlesUsed; handle++) {
+            if (queue->heap.position[handle] != -1) {
+                const Patient* patient = &queue->heap.records[handle];
+                memcpy(entries[n].name, patient->name, MAX_NAME_LENGTH);
+                entries[n].severity = patient->severity;
+                entries[n].arrivalTime = patient->arrivalTime;
+                n++;
+            }
+        }
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.count = count;
+    header.sequence = journal->sequence;
+    header.checksum = checksumBytes(entries, count * sizeof(SnapshotEntry));
+
+    char temporaryPath[4096];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", journal->snapshotPath);
+    int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf(RED "Cannot write snapshot %s: %s\n" RESET, temporaryPath, strerror(errno));
+        free(entries);
         return;
     }
-    Patient newPatient;
-    strcpy(newPatient.name, name);
-    newPatient.severity = severity;
+    writeFully(fd, &header, sizeof(header), temporaryPath);
+    writeFully(fd, entries, count * sizeof(SnapshotEntry), temporaryPath);
+    free(entries);
+    // The journal is only cut once the new snapshot is durable and in place; otherwise keep it and retry later
+    int synced = fsync(fd) == 0;
+    if (close(fd) != 0) {
+        synced = 0;
+    }
+    if (!synced || rename(temporaryPath, journal->snapshotPath) != 0) {
+        printf(RED "Cannot write snapshot %s: %s\n" RESET, journal->snapshotPath, strerror(errno));
+        unlink(temporaryPath);
+        journal->sinceSnapshot = 0; // Try again after the next JOURNAL_SNAPSHOT_EVERY records
+        return;
+    }
+    syncParentDirectory(journal->snapshotPath);
 
-    heap->patients[heap->size] = newPatient;
-    heap->size++;
+    // Records up to header.sequence are now in the snapshot; replay skips them even if this truncate is lost
+    if (ftruncate(journal->fd, 0) == 0) {
+        fdatasync(journal->fd);
+    }
+    journal->unsynced = 0;
+    journal->sinceSnapshot = 0;
+}
+
+// Append one event to the queue's journal, if it has one
+void journalEvent(PatientQueue* queue, JournalEventType type, const Patient* patient) {
+    Journal* journal = queue->journal;
+    if (journal == NULL) {
+        return;
+    }
+    JournalRecord record;
+    memset(&record, 0, sizeof(record)); // Padding bytes are checksummed too
+    record.type = type;
+    record.sequence = ++journal->sequence;
+    record.arrivalTime = patient->arrivalTime;
+    record.severity = patient->severity;
+    memcpy(record.name, patient->name, MAX_NAME_LENGTH);
+    record.checksum = recordChecksum(&record);
+    writeFully(journal->fd, &record, sizeof(record), journal->path);
 
-    // Heapify upwards
-    int index = heap->size - 1;
-    while (index != 0 && heap->patients[(index - 1) / 2].severity < heap->patients[index].severity) {
-        swap(&heap->patients[index], &heap->patients[(index - 1) / 2]);
-        index = (index - 1) / 2;
+    // Group commit: one fsync covers a batch of records, or whatever arrived within the sync interval
+    double now = nowSeconds();
+    if (journal->unsynced++ == 0) {
+        journal->oldestUnsynced = now;
+    }
+    if (journal->unsynced >= JOURNAL_SYNC_BATCH || now - journal->oldestUnsynced >= JOURNAL_SYNC_INTERVAL) {
+        syncJournal(journal);
+    }
+    if (++journal->sinceSnapshot >= JOURNAL_SNAPSHOT_EVERY) {
+        writeSnapshot(queue);
     }
 }
 
-// Extract the patient with the highest severity
-Patient extractMax(MaxHeap* heap) {
-    if (heap->size == 0) {
-        printf(RED "Heap is empty!\n" RESET);
-        exit(EXIT_FAILURE); // or handle it appropriately
+// Patient position paired with its arrival time, for rebuilding the arrival list
+typedef struct {
+    double arrivalTime;
+    int index;
+} ArrivalOrder;
+
+// Compare arrival-list entries by arrival time, then by position, for qsort
+int compareArrivalOrder(const void* a, const void* b) {
+    const ArrivalOrder* x = (const ArrivalOrder*)a;
+    const ArrivalOrder* y = (const ArrivalOrder*)b;
+    if (x->arrivalTime != y->arrivalTime) {
+        return x->arrivalTime < y->arrivalTime ? -1 : 1;
     }
-    Patient maxPatient = heap->patients[0];
-    heap->patients[0] = heap->patients[heap->size - 1];
-    heap->size--;
-    heapify(heap, 0);
-    return maxPatient;
+    return x->index - y->index;
 }
 
-// Heapify operation to maintain max-heap property
-void heapify(MaxHeap* heap, int index) {
-    int largest = index;
-    int left = 2 * index + 1;
-    int right = 2 * index + 2;
-
-    if (left < heap->size && heap->patients[left].severity > heap->patients[largest].severity) {
-        largest = left;
-    }
-    if (right < heap->size && heap->patients[right].severity > heap->patients[largest].severity) {
-        largest = right;
-    }
-    if (largest != index) {
-        swap(&heap->patients[index], &heap->patients[largest]);
-        heapify(heap, largest);
-    }
-}
-
-// Update severity of a patient and re-heapify
-void updateSeverity(MaxHeap* heap, const char* name, int newSeverity) {
-    for (int i = 0; i < heap->size; i++) {
-        if (strcmp(heap->patients[i].name, name) == 0) {
-            heap->patients[i].severity = newSeverity;
-            // Re-heapify from the updated position
-            int parentIndex = (i - 1) / 2;
-            if (parentIndex >= 0 && heap->patients[parentIndex].severity < heap->patients[i].severity) {
-                // Heapify upwards
-                while (i != 0 && heap->patients[parentIndex].severity < heap->patients[i].severity) {
-                    swap(&heap->patients[i], &heap->patients[parentIndex]);
-                    i = parentIndex;
-                    parentIndex = (i - 1) / 2;
-                }
-            } else {
-                // Heapify downwards
-                heapify(heap, i);
+// Fill an empty queue from a list of patients in O(n)
+// The heap is built in one pass (bottom-up for the array heaps) instead of by n inserts; bucket inserts are O(1) already
+// With aging on, rebuilding the arrival list adds an O(n log n) sort by arrival time
+void queueBulkLoad(PatientQueue* queue, Patient* patients, int count) {
+    if (queue->aging.maxBoost > 0) {
+        // Rebuild the arrival list in admission order and restore each patient's earned bonus
+        ArrivalOrder* order = (ArrivalOrder*)checkedAlloc(malloc((count > 0 ? count : 1) * sizeof(ArrivalOrder)));
+        for (int i = 0; i < count; i++) {
+            order[i].arrivalTime = patients[i].arrivalTime;
+            order[i].index = i;
+        }
+        qsort(order, count, sizeof(ArrivalOrder), compareArrivalOrder);
+        for (int i = 0; i < count; i++) {
+            Patient* patient = &patients[order[i].index];
+            patient->agingNode = agingTrack(queue, patient->name, patient->arrivalTime);
+        }
+        free(order);
+        for (int k = 1; k <= queue->aging.maxBoost; k++) {
+            double cutoff = queue->now - k * queue->aging.interval;
+            while (queue->agingCursor[k] != -1 && queue->agingNodes[queue->agingCursor[k]].arrivalTime <= cutoff) {
+                queue->agingCursor[k] = queue->agingNodes[queue->agingCursor[k]].next;
             }
-            return;
         }
+        for (int i = 0; i < count; i++) {
+            int boost = 0;
+            while (boost < queue->aging.maxBoost &&
+                   patients[i].arrivalTime <= queue->now - (boost + 1) * queue->aging.interval) {
+                boost++;
+            }
+            patients[i].priority = patients[i].severity + boost;
+        }
+    }
+
+    if (queue->type == QUEUE_BUCKET) {
+        for (int i = 0; i < count; i++) {
+            bucketInsertPatient(&queue->buckets, &patients[i]);
+        }
+        return;
     }
-    printf(RED "Patient %s not found.\n" RESET, name);
+    heapBulkLoad(&queue->heap, patients, count);
 }
 
-// Display current patients with the most severe patient highlighted
-void displayPatients(MaxHeap* heap) {
-    if (heap->size == 0) {
-        printf(RED "No patients in the queue.\n" RESET);
+// Patients staged during a restore: the snapshot plus the replayed journal, kept in queue order
+typedef struct {
+    Patient* patients;
+    int* indexSlotOf;
+    int count;
+    int capacity;
+    PatientIndex index; // Name -> staged position
+} RestoreBuffer;
+
+// Name of the staged patient at a position (NameAtFunc for the restore index)
+const char* restoreNameAt(const void* owner, int position) {
+    return ((const RestoreBuffer*)owner)->patients[position].name;
+}
+
+// Stage a patient at the end of the restore buffer
+void restoreAppend(RestoreBuffer* buffer, const char* name, int severity, double arrivalTime) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->patients = (Patient*)checkedAlloc(realloc(buffer->patients, buffer->capacity * sizeof(Patient)));
+        buffer->indexSlotOf = (int*)checkedAlloc(realloc(buffer->indexSlotOf, buffer->capacity * sizeof(int)));
+    }
+    Patient* patient = &buffer->patients[buffer->count];
+    memcpy(patient->name, name, MAX_NAME_LENGTH);
+    patient->name[MAX_NAME_LENGTH - 1] = '\0';
+    patient->severity = severity;
+    patient->priority = severity;
+    patient->arrivalTime = arrivalTime;
+    patient->agingNode = -1;
+    patient->caseId = -1;
+    buffer->indexSlotOf[buffer->count] = indexInsert(&buffer->index, patient->name, buffer->count, restoreNameAt,
+                                                     buffer, buffer->indexSlotOf);
+    buffer->count++;
+}
+
+// Drop a staged patient, leaving a hole (severity -1) so the others keep their order
+int restoreDrop(RestoreBuffer* buffer, const char* name, Patient* dropped) {
+    int slot = indexFind(&buffer->index, name, restoreNameAt, buffer);
+    if (slot == -1) {
+        return 0;
+    }
+    int position = buffer->index.entries[slot];
+    *dropped = buffer->patients[position];
+    buffer->patients[position].severity = -1;
+    indexErase(&buffer->index, slot);
+    return 1;
+}
+
+// Replay one journal record into the restore buffer
+void restoreApply(RestoreBuffer* buffer, const JournalRecord* record) {
+    Patient dropped;
+    switch (record->type) {
+        case JOURNAL_ADMIT:
+            if (indexFind(&buffer->index, record->name, restoreNameAt, buffer) == -1) {
+                restoreAppend(buffer, record->name, record->severity, record->arrivalTime);
+            }
+            break;
+        case JOURNAL_TREAT:
+        case JOURNAL_REMOVE:
+            restoreDrop(buffer, record->name, &dropped);
+            break;
+        case JOURNAL_UPDATE: {
+            // Like the bucket queue, a patient whose severity changed moves to the back of the line
+            int slot = indexFind(&buffer->index, record->name, restoreNameAt, buffer);
+            if (slot != -1 && buffer->patients[buffer->index.entries[slot]].severity != record->severity &&
+                restoreDrop(buffer, record->name, &dropped)) {
+                restoreAppend(buffer, record->name, record->severity, dropped.arrivalTime);
+            }
+            break;
+        }
+    }
+}
+
+// Load the snapshot into the restore buffer; returns its sequence number, or -1 if it is unreadable
+long long loadSnapshot(const char* path, RestoreBuffer* buffer) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    SnapshotHeader header;
+    struct stat st;
+    long long sequence = -1;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == SNAPSHOT_MAGIC) {
+        // A damaged count could ask for more memory than exists; it must fit in the file
+        if (fstat(fileno(file), &st) != 0 ||
+            (uint64_t)header.count * sizeof(SnapshotEntry) > (uint64_t)st.st_size - sizeof(header)) {
+            printf(RED "Snapshot %s has a damaged patient count; replaying the journal only.\n" RESET, path);
+            fclose(file);
+            return 0;
+        }
+        SnapshotEntry* entries = (SnapshotEntry*)checkedAlloc(malloc((header.count > 0 ? header.count : 1) * sizeof(SnapshotEntry)));
+        if (fread(entries, sizeof(SnapshotEntry), header.count, file) == header.count &&
+            checksumBytes(entries, header.count * sizeof(SnapshotEntry)) == header.checksum) {
+            for (uint32_t i = 0; i < header.count; i++) {
+                restoreAppend(buffer, entries[i].name, entries[i].severity, entries[i].arrivalTime);
+            }
+            sequence = (long long)header.sequence;
+        }
+        free(entries);
+    }
+    fclose(file);
+    return sequence;
+}
+
+// Open (or create) a journal and rebuild the queue from its snapshot and journal tail; returns 0 on failure
+int openJournal(Journal* journal, const char* path, PatientQueue* queue) {
+    double start = nowSeconds();
+    journal->path = path;
+    journal->snapshotPath = (char*)checkedAlloc(malloc(strlen(path) + 6));
+    sprintf(journal->snapshotPath, "%s.snap", path);
+    journal->unsynced = 0;
+    journal->sinceSnapshot = 0;
+
+    RestoreBuffer buffer;
+    buffer.count = 0;
+    buffer.capacity = INITIAL_CAPACITY;
+    buffer.patients = (Patient*)checkedAlloc(malloc(buffer.capacity * sizeof(Patient)));
+    buffer.indexSlotOf = (int*)checkedAlloc(malloc(buffer.capacity * sizeof(int)));
+    initIndex(&buffer.index, INITIAL_CAPACITY * 2);
+
+    long long snapshotSequence = loadSnapshot(journal->snapshotPath, &buffer);
+    if (snapshotSequence < 0) {
+        printf(RED "Snapshot %s is corrupt; refusing to start from a partial waiting list.\n" RESET, journal->snapshotPath);
+        free(buffer.patients);
+        free(buffer.indexSlotOf);
+        free(buffer.index.entries);
+        free(journal->snapshotPath);
+        return 0;
+    }
+    int snapshotPatients = buffer.count;
+
+    journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (journal->fd < 0) {
+        printf(RED "Cannot open journal %s: %s\n" RESET, path, strerror(errno));
+        free(buffer.patients);
+        free(buffer.indexSlotOf);
+        free(buffer.index.entries);
+        free(journal->snapshotPath);
+        return 0;
+    }
+    // Replay records newer than the snapshot; stop at the first torn or corrupt record and cut it off
+    JournalRecord record;
+    off_t validEnd = 0;
+    long replayed = 0;
+    journal->sequence = (uint64_t)snapshotSequence;
+    while (read(journal->fd, &record, sizeof(record)) == (ssize_t)sizeof(record) &&
+           record.checksum == recordChecksum(&record)) {
+        validEnd += sizeof(record);
+        if (record.sequence > (uint64_t)snapshotSequence) {
+            restoreApply(&buffer, &record);
+            journal->sequence = record.sequence;
+            replayed++;
+        }
+    }
+    if (lseek(journal->fd, 0, SEEK_END) != validEnd) {
+        printf(YELLOW "Discarding a torn record at the end of %s\n" RESET, path);
+        if (ftruncate(journal->fd, validEnd) == 0) {
+            fdatasync(journal->fd);
+        }
+    }
+
+    // Compact out the holes left by treated, removed and updated patients, then build the queue in one pass
+    int live = 0;
+    for (int i = 0; i < buffer.count; i++) {
+        if (buffer.patients[i].severity >= 0) {
+            buffer.patients[live++] = buffer.patients[i];
+        }
+    }
+    queueBulkLoad(queue, buffer.patients, live);
+    free(buffer.patients);
+    free(buffer.indexSlotOf);
+    free(buffer.index.entries);
+
+    queue->journal = journal;
+    if (replayed > 0) {
+        writeSnapshot(queue);
+    }
+    if (snapshotPatients > 0 || replayed > 0) {
+        printf(GREEN "Restored %d waiting patients (snapshot of %d + %ld journal events) in %.1f ms\n" RESET,
+               live, snapshotPatients, replayed, (nowSeconds() - start) * 1000);
+    }
+    return 1;
+}
+
+// Sync and close a journal
+void closeJournal(Journal* journal) {
+    syncJournal(journal);
+    close(journal->fd);
+    free(journal->snapshotPath);
+}
+
+// One arrival of the simulation: from a trace file or generated
+typedef struct {
+    double time;        // Arrival time in minutes
+    int severity;
+    double service;     // Treatment time in minutes
+} SimArrival;
+
+// Growable array of samples for percentile reports
+typedef struct {
+    double* values;
+    long count;
+    long capacity;
+} SampleSet;
+
+// Simulation settings
+typedef struct {
+    QueueType type;
+    double agingInterval;
+    int agingMaxBoost;
+    int doctors;
+    long patients;
+    double arrivalRate;       // Patients per minute
+    double serviceMean;       // Minutes
+    char service[16];         // exp, fixed or lognormal
+    unsigned int seed;
+    const char* tracePath;    // Replay this trace instead of generating arrivals
+    const char* writeTracePath; // Save the arrivals that were simulated
+} SimConfig;
+
+// Add a sample, growing the set as needed
+void addSample(SampleSet* set, double value) {
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity == 0 ? 1024 : set->capacity * 2;
+        set->values = (double*)checkedAlloc(realloc(set->values, set->capacity * sizeof(double)));
+    }
+    set->values[set->count++] = value;
+}
+
+// Compare doubles for qsort
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Value at the given percentile (0-100) of a sorted sample set
+double percentile(const SampleSet* set, double pct) {
+    if (set->count == 0) {
+        return 0;
+    }
+    long i = (long)(pct / 100.0 * (set->count - 1) + 0.5);
+    return set->values[i];
+}
+
+// Uniform random number in (0, 1)
+double uniformRandom(unsigned int* seed) {
+    return (rand_r(seed) + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+// Draw a treatment time from the configured distribution
+double drawServiceTime(const SimConfig* config, unsigned int* seed) {
+    if (strcmp(config->service, "fixed") == 0) {
+        return config->serviceMean;
+    }
+    if (strcmp(config->service, "lognormal") == 0) {
+        // Box-Muller normal sample, scaled so the mean stays serviceMean
+        const double sigma = 0.5;
+        double normal = sqrt(-2.0 * log(uniformRandom(seed))) * cos(2.0 * M_PI * uniformRandom(seed));
+        return exp(log(config->serviceMean) - sigma * sigma / 2 + sigma * normal);
+    }
+    return -config->serviceMean * log(uniformRandom(seed));
+}
+
+// Generate Poisson arrivals with uniform severities
+SimArrival* generateArrivals(const SimConfig* config, long* count) {
+    SimArrival* arrivals = (SimArrival*)checkedAlloc(malloc((config->patients > 0 ? config->patients : 1) * sizeof(SimArrival)));
+    unsigned int seed = config->seed;
+    double clock = 0;
+    for (long i = 0; i < config->patients; i++) {
+        clock += -log(uniformRandom(&seed)) / config->arrivalRate;
+        arrivals[i].time = clock;
+        arrivals[i].severity = rand_r(&seed) % NUM_SEVERITIES;
+        arrivals[i].service = drawServiceTime(config, &seed);
+    }
+    *count = config->patients;
+    return arrivals;
+}
+
+// Compare arrivals by time for qsort
+int compareArrivals(const void* a, const void* b) {
+    double x = ((const SimArrival*)a)->time, y = ((const SimArrival*)b)->time;
+    return (x > y) - (x < y);
+}
+
+// Load a trace: one "arrival_minutes severity [service_minutes]" line per patient, '#' starts a comment
+// Missing service times are drawn from the configured distribution
+SimArrival* loadTrace(const SimConfig* config, long* count) {
+    FILE* file = fopen(config->tracePath, "r");
+    if (file == NULL) {
+        printf(RED "Cannot open trace %s\n" RESET, config->tracePath);
+        return NULL;
+    }
+    long capacity = 1024;
+    SimArrival* arrivals = (SimArrival*)checkedAlloc(malloc(capacity * sizeof(SimArrival)));
+    unsigned int seed = config->seed;
+    char line[256];
+    long lineNumber = 0;
+    *count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char first = line[strspn(line, " \t\r\n")];
+        if (first == '\0' || first == '#') {
+            continue;
+        }
+        SimArrival arrival;
+        int fields = sscanf(line, "%lf %d %lf", &arrival.time, &arrival.severity, &arrival.service);
+        if (fields < 2 || arrival.severity < 0 || arrival.severity > MAX_SEVERITY || arrival.time < 0) {
+            printf(RED "Skipping malformed trace line %ld\n" RESET, lineNumber);
+            continue;
+        }
+        if (fields < 3) {
+            arrival.service = drawServiceTime(config, &seed);
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            arrivals = (SimArrival*)checkedAlloc(realloc(arrivals, capacity * sizeof(SimArrival)));
+        }
+        arrivals[(*count)++] = arrival;
+    }
+    fclose(file);
+    qsort(arrivals, *count, sizeof(SimArrival), compareArrivals);
+    return arrivals;
+}
+
+// Save arrivals in the trace format so a run can be replayed
+void writeTrace(const char* path, const SimArrival* arrivals, long count) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf(RED "Cannot write trace %s\n" RESET, path);
         return;
     }
+    fprintf(file, "# arrival_minutes severity service_minutes\n");
+    for (long i = 0; i < count; i++) {
+        fprintf(file, "%.6f %d %.6f\n", arrivals[i].time, arrivals[i].severity, arrivals[i].service);
+    }
+    fclose(file);
+}
+
+// Take the next patient and start treating them; records the wait and returns when the doctor will be free
+double startTreatment(PatientQueue* queue, const SimArrival* arrivals, double clock,
+                      SampleSet* extractLatency, SampleSet* waits) {
+    double before = nowSeconds();
+    Patient patient = queueExtractMax(queue);
+    addSample(extractLatency, (nowSeconds() - before) * 1e9);
+    addSample(&waits[patient.severity], clock - patient.arrivalTime);
+    return clock + arrivals[patient.caseId].service;
+}
+
+// Print p50/p90/p99/max of a sample set on one table row
+void printPercentiles(const char* label, SampleSet* set) {
+    if (set->count > 0) {
+        qsort(set->values, set->count, sizeof(double), compareDoubles);
+    }
+    printf("| %-10s | %9ld | %10.1f | %10.1f | %10.1f | %10.1f |\n", label, set->count, percentile(set, 50),
+           percentile(set, 90), percentile(set, 99), set->count > 0 ? set->values[set->count - 1] : 0.0);
+}
+
+// Discrete-event simulation: arrivals and treatment completions advance a virtual clock through the queue
+int runSimulation(const SimConfig* config) {
+    long count;
+    SimArrival* arrivals = config->tracePath != NULL ? loadTrace(config, &count) : generateArrivals(config, &count);
+    if (arrivals == NULL) {
+        return 1;
+    }
+    if (config->writeTracePath != NULL) {
+        writeTrace(config->writeTracePath, arrivals, count);
+    }
+
+    PatientQueue queue;
+    initQueue(&queue, config->type);
+    // --aging gives seconds, as in the menu, but the simulated clock counts minutes
+    setAgingPolicy(&queue, config->agingInterval / 60.0, config->agingMaxBoost);
+    // Time a doctor becomes free; few enough doctors that a linear scan beats a second heap
+    double* freeAt = (double*)checkedAlloc(malloc(config->doctors * sizeof(double)));
+    int* busy = (int*)checkedAlloc(calloc(config->doctors, sizeof(int)));
+    SampleSet insertLatency = {0}, extractLatency = {0}, agingLatency = {0};
+    SampleSet waits[NUM_SEVERITIES] = {{0}};
+    double busyMinutes = 0;
+    long next = 0, maxWaiting = 0;
+    char name[MAX_NAME_LENGTH];
+
+    double start = nowSeconds();
+    double clock = 0;
+    while (1) {
+        // Next event: the earliest treatment completion, or else the next arrival
+        int doctor = -1;
+        for (int d = 0; d < config->doctors; d++) {
+            if (busy[d] && (doctor == -1 || freeAt[d] < freeAt[doctor])) {
+                doctor = d;
+            }
+        }
+        int arrivalNext = next < count && (doctor == -1 || arrivals[next].time < freeAt[doctor]);
+        if (!arrivalNext && doctor == -1) {
+            break;
+        }
+        clock = arrivalNext ? arrivals[next].time : freeAt[doctor];
+        if (queue.aging.maxBoost > 0) {
+            double before = nowSeconds();
+            advanceQueueClock(&queue, clock);
+            addSample(&agingLatency, (nowSeconds() - before) * 1e9);
+        } else {
+            queue.now = clock;
+        }
+
+        if (arrivalNext) {
+            snprintf(name, sizeof(name), "p%ld", next);
+            double before = nowSeconds();
+            queueInsertCase(&queue, name, arrivals[next].severity, next);
+            addSample(&insertLatency, (nowSeconds() - before) * 1e9);
+            next++;
+            if (queueSize(&queue) > maxWaiting) {
+                maxWaiting = queueSize(&queue);
+            }
+            // An idle doctor takes the new arrival straight away
+            for (int d = 0; d < config->doctors; d++) {
+                if (!busy[d]) {
+                    busy[d] = 1;
+                    freeAt[d] = startTreatment(&queue, arrivals, clock, &extractLatency, waits);
+                    busyMinutes += freeAt[d] - clock;
+                    break;
+                }
+            }
+        } else if (queueSize(&queue) > 0) {
+            freeAt[doctor] = startTreatment(&queue, arrivals, clock, &extractLatency, waits);
+            busyMinutes += freeAt[doctor] - clock;
+        } else {
+            busy[doctor] = 0;
+        }
+    }
+    double elapsed = nowSeconds() - start;
+    long operations = insertLatency.count + extractLatency.count + agingLatency.count;
 
-    printf(YELLOW "\nCurrent Patients in the Queue:\n" RESET);
-    printf(CYAN "+---------------------------+----------+\n" RESET);
-    printf(CYAN "| Patient Name              | Severity |\n" RESET);
-    printf(CYAN "+---------------------------+----------+\n" RESET);
-    
-    // Temporary heap for sorting
-    MaxHeap tempHeap;
-    initHeap(&tempHeap);
+    printf(BOLD "Simulated %ld patients, %d doctors, %s queue, aging %s, %s service times\n" RESET, count,
+           config->doctors, config->type == QUEUE_BUCKET ? "bucket" : "heap",
+           config->agingMaxBoost > 0 ? "on" : "off", config->tracePath != NULL ? "trace" : config->service);
+    printf(CYAN "Virtual time %.1f min, doctor utilization %.1f%%, longest queue %ld\n" RESET, clock,
+           clock > 0 ? 100.0 * busyMinutes / (clock * config->doctors) : 0.0, maxWaiting);
+    printf(GREEN "Queue throughput: %.0f operations/s (%ld operations in %.3f s wall time)\n" RESET,
+           elapsed > 0 ? operations / elapsed : 0.0, operations, elapsed);
 
-    // Copy patients to a temporary max heap
-    for (int i = 0; i < heap->size; i++) {
-        insert(&tempHeap, heap->patients[i].name, heap->patients[i].severity);
+    printf(BOLD "\nOperation latency (ns)\n" RESET);
+    printf("| %-10s | %9s | %10s | %10s | %10s | %10s |\n", "Operation", "Count", "p50", "p90", "p99", "Max");
+    printPercentiles("insert", &insertLatency);
+    printPercentiles("treat", &extractLatency);
+    if (agingLatency.count > 0) {
+        printPercentiles("aging", &agingLatency);
     }
 
-    // Extract the most severe patient first
-    if (tempHeap.size > 0) {
-        Patient topPatient = extractMax(&tempHeap);
-        printf(RED "| %-25s | %-8d |\n" RESET, topPatient.name, topPatient.severity);
+    printf(BOLD "\nPatient wait by severity (minutes)\n" RESET);
+    printf("| %-10s | %9s | %10s | %10s | %10s | %10s |\n", "Severity", "Patients", "p50", "p90", "p99", "Max");
+    for (int s = MAX_SEVERITY; s >= 0; s--) {
+        char label[16];
+        snprintf(label, sizeof(label), "%d", s);
+        printPercentiles(label, &waits[s]);
+        free(waits[s].values);
     }
 
-    // Extract remaining patients from the temp heap
-    while (tempHeap.size > 0) {
-        Patient p = extractMax(&tempHeap);
-        printf(CYAN "| %-25s | %-8d |\n" RESET, p.name, p.severity);
+    free(insertLatency.values);
+    free(extractLatency.values);
+    free(agingLatency.values);
+    free(freeAt);
+    free(busy);
+    free(arrivals);
+    freeQueue(&queue);
+    return 0;
+}
+
+// Simulation mode
+// Usage: simulate [--queue=heap|bucket] [--aging=SECONDS,MAX_BOOST] [--doctors=N] [--patients=N]
+//                 [--arrival-rate=PER_MINUTE] [--service=exp|fixed|lognormal] [--service-mean=MINUTES]
+//                 [--seed=N] [--trace=FILE] [--write-trace=FILE]
+int runSimulationMode(int argc, char* argv[]) {
+    opStatsSetEnabled(0); // Hundreds of thousands of queue operations; the clock reads would only slow the run down
+    SimConfig config = {QUEUE_HEAP, 0, 0, 4, 200000, 0.19, 20, "exp", 42, NULL, NULL};
+    for (int i = 2; i < argc; i++) {
+        char* arg = argv[i];
+        if (strcmp(arg, "--queue=bucket") == 0) {
+            config.type = QUEUE_BUCKET;
+        } else if (strcmp(arg, "--queue=heap") == 0) {
+            config.type = QUEUE_HEAP;
+        } else if (sscanf(arg, "--aging=%lf,%d", &config.agingInterval, &config.agingMaxBoost) == 2 ||
+                   sscanf(arg, "--doctors=%d", &config.doctors) == 1 ||
+                   sscanf(arg, "--patients=%ld", &config.patients) == 1 ||
+                   sscanf(arg, "--arrival-rate=%lf", &config.arrivalRate) == 1 ||
+                   sscanf(arg, "--service-mean=%lf", &config.serviceMean) == 1 ||
+                   sscanf(arg, "--seed=%u", &config.seed) == 1) {
+            continue;
+        } else if (strncmp(arg, "--service=", 10) == 0) {
+            snprintf(config.service, sizeof(config.service), "%s", arg + 10);
+        } else if (strncmp(arg, "--trace=", 8) == 0) {
+            config.tracePath = arg + 8;
+        } else if (strncmp(arg, "--write-trace=", 14) == 0) {
+            config.writeTracePath = arg + 14;
+        } else {
+            printf(RED "Unknown simulation option %s\n" RESET, arg);
+            return 1;
+        }
     }
+    if (config.doctors < 1 || config.patients < 0 || config.arrivalRate <= 0 || config.serviceMean <= 0 ||
+        (strcmp(config.service, "exp") != 0 && strcmp(config.service, "fixed") != 0 &&
+         strcmp(config.service, "lognormal") != 0)) {
+        printf(RED "Usage: simulate [--queue=heap|bucket] [--aging=SECONDS,MAX_BOOST] [--doctors=N >= 1] [--patients=N]\n"
+               "                [--arrival-rate=PER_MINUTE] [--service=exp|fixed|lognormal] [--service-mean=MINUTES]\n"
+               "                [--seed=N] [--trace=FILE] [--write-trace=FILE]\n" RESET);
+        return 1;
+    }
+    return runSimulation(&config);
+}
+
+// Ids of the patients waiting in a benchmark run, for picking update and remove targets in O(1)
+typedef struct {
+    long* ids;
+    long* positionOf;   // Position of each id in ids
+    long count;
+} WaitingSet;
 
-    printf(CYAN "+---------------------------+----------+\n" RESET);
+// Record a benchmark patient as waiting
+void waitingAdd(WaitingSet* set, long id) {
+    set->positionOf[id] = set->count;
+    set->ids[set->count++] = id;
 }
 
-// Swap two patients
-void swap(Patient* a, Patient* b) {
-    Patient temp = *a;
-    *a = *b;
-    *b = temp;
+// Record a benchmark patient as gone
+void waitingDrop(WaitingSet* set, long id) {
+    long last = set->ids[--set->count];
+    set->ids[set->positionOf[id]] = last;
+    set->positionOf[last] = set->positionOf[id];
+}
+
+// Run the ER workload mix on one queue: fill to the given size, run the mix, then drain
+// Reports nanoseconds per operation for each phase
+void benchmarkQueue(QueueType type, int waiting, long operations, double* fillNs, double* mixNs, double* drainNs) {
+    PatientQueue queue;
+    initQueue(&queue, type);
+    WaitingSet set;
+    set.ids = (long*)checkedAlloc(malloc((waiting + operations) * sizeof(long)));
+    set.positionOf = (long*)checkedAlloc(malloc((waiting + operations) * sizeof(long)));
+    set.count = 0;
+    unsigned int seed = 7;
+    char name[MAX_NAME_LENGTH];
+    long nextId = 0;
+
+    double start = nowSeconds();
+    for (; nextId < waiting; nextId++) {
+        snprintf(name, sizeof(name), "p%ld", nextId);
+        queueInsertCase(&queue, name, rand_r(&seed) % NUM_SEVERITIES, nextId);
+        waitingAdd(&set, nextId);
+    }
+    *fillNs = (nowSeconds() - start) * 1e9 / (waiting > 0 ? waiting : 1);
+
+    start = nowSeconds();
+    for (long i = 0; i < operations; i++) {
+        int roll = rand_r(&seed) % 100;
+        if (roll < 45 || set.count == 0) {
+            snprintf(name, sizeof(name), "p%ld", nextId);
+            queueInsertCase(&queue, name, rand_r(&seed) % NUM_SEVERITIES, nextId);
+            waitingAdd(&set, nextId++);
+        } else if (roll < 85) {
+            Patient treated = queueExtractMax(&queue);
+            waitingDrop(&set, treated.caseId);
+        } else {
+            long id = set.ids[rand_r(&seed) % set.count];
+            snprintf(name, sizeof(name), "p%ld", id);
+            if (roll < 95) {
+                queueUpdateSeverity(&queue, name, rand_r(&seed) % NUM_SEVERITIES);
+            } else {
+                queueRemove(&queue, name, NULL);
+                waitingDrop(&set, id);
+            }
+        }
+    }
+    *mixNs = (nowSeconds() - start) * 1e9 / (operations > 0 ? operations : 1);
+
+    int remaining = queueSize(&queue);
+    start = nowSeconds();
+    while (queueSize(&queue) > 0) {
+        queueExtractMax(&queue);
+    }
+    *drainNs = (nowSeconds() - start) * 1e9 / (remaining > 0 ? remaining : 1);
+
+    free(set.ids);
+    free(set.positionOf);
+    freeQueue(&queue);
 }
 
-// Print decorative lines
-void printLine(char ch, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", ch);
+// Queue microbenchmark: the ER workload mix on the compiled-in heap backend and on the bucket queue
+// Build once per PQ_BACKEND to compare the heap backends
+// Usage: bench-queue [operations]
+int runQueueBenchmark(int argc, char* argv[]) {
+    long operations = argc > 2 ? atol(argv[2]) : 2000000;
+    opStatsSetEnabled(0); // The clock reads would be counted in the ns/op figures
+    if (operations < 0) {
+        printf(RED "Usage: bench-queue [operations]\n" RESET);
+        return 1;
+    }
+    const int sizes[] = {1000, 100000};
+    printf(BOLD "Queue microbenchmark, %s build: %ld operations of 45%% admit, 40%% treat, 10%% update, 5%% remove\n" RESET,
+           PQ_BACKEND_NAME, operations);
+    printf("| %-14s | %8s | %10s | %10s | %11s |\n", "Queue", "Waiting", "Fill ns/op", "Mix ns/op", "Drain ns/op");
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        for (int t = 0; t < 2; t++) {
+            QueueType type = t == 0 ? QUEUE_HEAP : QUEUE_BUCKET;
+            double fillNs, mixNs, drainNs;
+            benchmarkQueue(type, sizes[i], operations, &fillNs, &mixNs, &drainNs);
+            printf("| %-14s | %8d | %10.1f | %10.1f | %11.1f |\n", type == QUEUE_HEAP ? PQ_BACKEND_NAME : "bucket queue",
+                   sizes[i], fillNs, mixNs, drainNs);
+        }
     }
-    printf("\n");
+    return 0;
 }
 
 // Interactive menu for user input
-void interactiveMenu(MaxHeap* heap) {
+void interactiveMenu(PatientQueue* queue) {
     int choice;
-    char name[50];
+    char name[MAX_NAME_LENGTH];
+    char path[256];
     int severity;
 
     while (1) {
@@ -200,45 +3138,97 @@ void interactiveMenu(MaxHeap* heap) {
         printf("2. Treat Next Patient\n");
         printf("3. Update Patient Severity\n");
         printf("4. Display Patients\n");
-        printf("5. Exit\n");
+        printf("5. Remove Patient (left or transferred)\n");
+        printf("6. Look Up Patient\n");
+        printf("7. Admit Batch from File\n");
+        printf("8. Operation Statistics\n");
+        printf("9. Save Statistics\n");
+        printf("10. Exit\n");
         printf(BLUE "Select an option: " RESET);
+        // Nothing journaled waits unsynced while the desk is idle
+        syncJournal(queue->journal);
         scanf("%d", &choice);
+        advanceQueueClock(queue, wallClockSeconds());
 
         switch (choice) {
             case 1:
                 printf(BLUE "Enter patient name: " RESET);
                 scanf("%s", name);
                 severity = getSeverityInput();
-                insert(heap, name, severity);
-                displayPatients(heap); // Show patients after adding
+                queueInsert(queue, name, severity);
+                displayPatients(queue, DASHBOARD_ROWS); // Show patients after adding
                 break;
             case 2:
-                if (heap->size > 0) {
-                    Patient treated = extractMax(heap);
+                if (queueSize(queue) > 0) {
+                    Patient treated = queueExtractMax(queue);
                     printf(GREEN "Treated patient: %s with severity %d\n" RESET, treated.name, treated.severity);
                 } 
                 // else {
                 //     printf(RED "No patients to treat.\n" RESET);
                 // }
-                displayPatients(heap); // Show patients after treating
+                displayPatients(queue, DASHBOARD_ROWS); // Show patients after treating
                 break;
             case 3:
-                if (heap->size > 0) {
+                if (queueSize(queue) > 0) {
                     printf(BLUE "Enter patient name to update severity: " RESET);
                     scanf("%s", name);
                     severity = getSeverityInput();
-                    updateSeverity(heap, name, severity);
+                    queueUpdateSeverity(queue, name, severity);
                 } 
                 // else {
                 //     printf(RED "No patients to update.\n" RESET);
                 // }
-                displayPatients(heap); // Show patients after updating
+                displayPatients(queue, DASHBOARD_ROWS); // Show patients after updating
                 break;
             case 4:
-                displayPatients(heap);
+                displayPatients(queue, 0);
                 break;
             case 5:
+                if (queueSize(queue) > 0) {
+                    printf(BLUE "Enter patient name to remove: " RESET);
+                    scanf("%s", name);
+                    Patient removed;
+                    if (queueRemove(queue, name, &removed)) {
+                        printf(GREEN "Removed patient: %s with severity %d\n" RESET, removed.name, removed.severity);
+                    }
+                }
+                displayPatients(queue, DASHBOARD_ROWS); // Show patients after removing
+                break;
+            case 6: {
+                printf(BLUE "Enter patient name to look up: " RESET);
+                scanf("%s", name);
+                const Patient* patient = queueFind(queue, name);
+                if (patient == NULL) {
+                    printf(RED "Patient %s not found.\n" RESET, name);
+                } else {
+                    printf(GREEN "%s is waiting with severity %d\n" RESET, name, patient->severity);
+                }
+                break;
+            }
+            case 7:
+                printf(BLUE "Enter batch file path: " RESET);
+                scanf("%255s", path);
+                admitBatchFromPath(queue, path);
+                displayPatients(queue, DASHBOARD_ROWS); // Show patients after the batch
+                break;
+            case 8:
+                opStatsPrint();
+                break;
+            case 9:
+                printf(BLUE "Enter a file to save to (.json for JSON, other names for Prometheus text): " RESET);
+                scanf("%255s", path);
+                if (opStatsSave(path)) {
+                    printf(GREEN "Statistics saved to %s\n" RESET, path);
+                } else {
+                    printf(RED "Could not write %s\n" RESET, path);
+                }
+                break;
+            case 10:
                 printf(RED "Exiting...\n" RESET);
+                if (queue->journal != NULL) {
+                    closeJournal(queue->journal);
+                }
+                freeQueue(queue);
                 exit(0);
             default:
                 printf(RED "Invalid choice. Please try again.\n" RESET);
@@ -253,7 +3243,7 @@ int getSeverityInput() {
     while (1) {
         printf(BLUE "Enter severity (0-10): " RESET);
         scanf("%d", &severity);
-        if (severity >= 0 && severity <= 10) {
+        if (severity >= 0 && severity <= MAX_SEVERITY) {
             return severity;
         } else {
             printf(RED "Invalid input. Please enter a severity between 0 and 10.\n" RESET);
@@ -1,9 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <strings.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mixer.h>
 #include <pthread.h> // For threading
+#include "report_output.h" // Buffered playlist and scan listings, and printLine
+#include "op_stats.h"      // Operation counters and latency histograms
+#if defined(__SSE2__)
+#include <emmintrin.h> // SSE2 mixing kernels; other targets use the scalar loops
+#endif
 
 // ANSI escape codes for styling
 #define RESET   "\033[0m"
@@ -14,150 +31,2964 @@
 #define BLUE    "\033[34m"
 #define CYAN    "\033[36m"
 
+// Operations timed for the statistics menu (and for OP_STATS_DUMP in the other modes)
+enum {
+    OP_DECODE_TRACK,
+    OP_ANALYZE_LOUDNESS,
+    OP_SCAN_FILE,
+    OP_RUN_COMMAND,
+    OP_COUNT
+};
+static const char* const opNames[OP_COUNT] = {"decode_track", "analyze_loudness", "scan_file", "run_command"};
+
+/*
+Usage Instructions
+Install Required Libraries: SDL2 and SDL_mixer
+
+sudo apt-get update
+sudo apt-get install libsdl2-dev libsdl2-mixer-dev
+
+
+Compile the Program:
+gcc -O2 music_playlist_manager.c -o music_playlist_manager -lSDL2 -lSDL2_mixer -lpthread -lm
+(add -DOP_STATS_DISABLE to compile out the operation statistics)
+
+Run the Program:
+./music_playlist_manager [--cache-mb=N] [--crossfade=SECONDS]   (N MB of decoded songs kept for replays; default 256)
+./music_playlist_manager scan FOLDER... [--threads=N]   (read song lengths and titles into playlist_library.idx)
+./music_playlist_manager play FILE... [--crossfade=SECONDS]   (play the files once; SDL_AUDIODRIVER=dummy runs it headless)
+./music_playlist_manager bench-playlist [tracks]
+./music_playlist_manager bench-mix [seconds]
+
+
+*/
+
+
+#define INITIAL_PLAYLIST_CAPACITY 16  // Tracks allocated before the playlist first grows
+#define INITIAL_POOL_BYTES 1024       // Path bytes allocated before the path pool first grows
+#define MAX_PATH_LENGTH 1024          // Longest song file path accepted
+#define PREFETCH_SLOTS 2              // Tracks kept decoded ahead: the current one and the one after it
+#define RETIRED_SLOTS 8               // Finished tracks the audio callback can hand back before they are freed
+#define COMMAND_SLOTS 64              // Playback commands the menu can queue ahead of the worker
+#define MAX_TITLE_LENGTH 256          // Longest song title kept, in UTF-8 bytes
+#define MAX_SCAN_THREADS 16           // Upper bound on library scanner threads
+#define LIBRARY_INDEX_PATH "playlist_library.idx" // Remembered scan results, keyed by path + mtime + size
+#define LIBRARY_INDEX_MAGIC 0x4D4C4958u
+#define LIBRARY_INDEX_VERSION 2
+#define PLAYLIST_SNAPSHOT_PATH "playlist_snapshot.bin" // Playlist saved at exit and restored at startup
+#define PLAYLIST_SNAPSHOT_MAGIC 0x4D504C53u
+#define PLAYLIST_SNAPSHOT_VERSION 2
+#define DEFAULT_CACHE_MB 256          // Decoded audio kept for replays and back-skips (about 24 minutes of CD audio)
+#define CACHE_LOOKAHEAD 4             // Upcoming tracks, beyond the prefetch slots, decoded ahead into the cache
+#define ASSUMED_TRACK_SECONDS 240     // Length assumed when budgeting for a track of unknown length
+#define MAX_CROSSFADE_SECONDS 12      // Longest crossfade between songs
+#define FADE_STEP_FRAMES 64           // Frames mixed at one gain while a crossfade ramps (1.5 ms at 44.1 kHz)
+#define LOUDNESS_BLOCK_MS 50          // RMS window of the loudness analysis, as in ReplayGain
+#define LEVELING_TARGET_DBFS -18.0f   // Level songs are brought to: 95th-percentile 50 ms RMS
+#define MIN_LEVELING_DB -24.0f        // Range of the gain leveling applies
+#define MAX_LEVELING_DB 12.0f
+#define MAX_M3U_LINE (MAX_PATH_LENGTH + MAX_TITLE_LENGTH + 64) // Longest M3U line read; longer lines are skipped
+
+
+// Structure to store each distinct string (song path or title) once; tracks refer to strings by ID
+typedef struct StringPool {
+    char* bytes;           // Interned strings, NUL-terminated, back to back
+    size_t length;         // Bytes in use
+    size_t capacity;       // Bytes allocated
+    size_t* offsets;       // Start of each string in bytes, indexed by string ID
+    int count;             // Number of distinct strings
+    int offsetCapacity;
+    int* index;            // Open-addressing hash table from string to string ID (-1 = empty slot)
+    int indexCapacity;     // Number of slots in index (power of two)
+} StringPool;
+
+// Structure for one playlist entry
+typedef struct Track {
+    int pathId;            // Interned song file path
+    int titleId;           // Interned song title (-1 = none known)
+    int length;            // Length of the song in seconds
+    float gainDb;          // ReplayGain from the file's tags (NAN = none: the loudness is measured when decoded)
+} Track;
+
+// Structure for a playlist: a growable array of tracks in play order
+typedef struct Playlist {
+    Track* tracks;
+    int count;
+    int capacity;
+    StringPool strings;
+    int current;                  // Track playing, or the next one to play
+    int playing;                  // Set by the playback worker while a track is playing or paused
+    int restartPending;           // `current` was changed under the worker: play it instead of advancing
+    unsigned long long rngState;  // xorshift64* state used for shuffling
+    pthread_mutex_t lock;         // Guards the playlist against the playback worker
+    void* snapshot;               // Mapped snapshot the tracks and strings still live in (NULL = own memory)
+    size_t snapshotSize;
+} Playlist;
+
+// On-disk playlist snapshot: this header, then the track array, the string offsets, the string hash table
+// and the string bytes, each at an 8-byte aligned file offset, laid out exactly as they are in memory
+typedef struct SnapshotHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int trackSize;       // sizeof(Track) and sizeof(size_t) of the writer: snapshots are not
+    unsigned int offsetSize;      // portable between ABIs, only between sessions on one machine
+    int trackCount;
+    int current;
+    int stringCount;
+    int indexCapacity;
+    unsigned long long stringBytes;
+    unsigned long long tracksAt;
+    unsigned long long offsetsAt;
+    unsigned long long indexAt;
+    unsigned long long bytesAt;
+    unsigned long long fileSize;
+} SnapshotHeader;
+
+// Structure for one decoded track, shared by the audio cache, the prefetch slots and the audio callback
+typedef struct DecodedTrack {
+    Mix_Chunk* chunk;
+    float gain;                    // Linear gain that levels the track's loudness, capped so its peak does not clip
+    int pathId;
+    int users;                     // Prefetch slots, `next`, the callback and the retired ring holding the track
+    unsigned long long lastUse;    // Cache clock at the last lookup, for least-recently-used eviction
+} DecodedTrack;
+
+// States of a prefetch slot
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_LOADING,          // The loader thread is decoding the track
+    SLOT_LOADED,           // Decoded, not yet handed to the audio callback
+    SLOT_QUEUED,           // Handed to the audio callback (waiting in `next` or playing)
+    SLOT_FAILED            // The file could not be decoded; the track is skipped
+} SlotState;
+
+// Structure for one decoded-ahead track
+typedef struct PrefetchSlot {
+    SlotState state;
+    int pathId;            // Track the slot was filled for, checked against the playlist after edits
+    unsigned int request;  // Loader request serial while loading
+    DecodedTrack* track;   // Decoded audio while loaded
+} PrefetchSlot;
+
+// Where a song's duration was read from
+typedef enum {
+    DURATION_UNKNOWN,
+    DURATION_XING,         // Frame count in a Xing/Info header (LAME, ffmpeg), minus encoder delay and padding
+    DURATION_VBRI,         // Frame count in a Fraunhofer VBRI header
+    DURATION_FRAMES        // Every frame header walked and counted
+} DurationSource;
+
+// Structure for a decoded MPEG audio frame header
+typedef struct FrameHeader {
+    int version;           // 0 = MPEG-1, 1 = MPEG-2, 2 = MPEG-2.5
+    int layer;             // 1, 2 or 3
+    int sampleRate;
+    int samples;           // Samples per channel in the frame
+    int length;            // Frame length in bytes, header included
+    int mono;
+} FrameHeader;
+
+// Structure for the metadata read from one MP3 file
+typedef struct Mp3Info {
+    double seconds;                // Exact playing time
+    char title[MAX_TITLE_LENGTH];  // UTF-8 title from the ID3 tag ("" = none)
+    DurationSource source;
+    float gainDb;                  // ReplayGain track gain from the ID3 or LAME tag (NAN = none)
+} Mp3Info;
+
+// Structure for one remembered scan result, indexed by the path's ID in the library's path pool
+typedef struct LibraryEntry {
+    long long mtimeNs;     // File modification time when scanned
+    long long size;        // File size when scanned
+    double seconds;
+    int source;            // DurationSource
+    int titleId;           // In the library's title pool (-1 = none)
+    float gainDb;          // NAN = none
+} LibraryEntry;
+
+// Structure for the persistent library index: scan results that stay valid until a file changes
+typedef struct LibraryIndex {
+    StringPool paths;
+    StringPool titles;
+    LibraryEntry* entries;
+    int capacity;
+    int dirty;             // Changed since it was loaded or saved
+} LibraryIndex;
+
+// On-disk library index: a header, then one record per file followed by its path and title bytes
+typedef struct LibraryFileHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int count;
+} LibraryFileHeader;
+
+typedef struct LibraryFileRecord {
+    long long mtimeNs;
+    long long size;
+    double seconds;
+    int source;
+    float gainDb;
+    unsigned short pathLength;
+    unsigned short titleLength;
+} LibraryFileRecord;
+
+// Structure for one file in a library scan
+typedef struct ScanJob {
+    char* path;
+    long long mtimeNs;
+    long long size;
+    int cached;            // Taken from the index: the file is unchanged since its last scan
+    int ok;                // Metadata was read
+    Mp3Info info;
+} ScanJob;
+
+// Structure for a library scan shared by the scanner threads
+typedef struct LibraryScan {
+    ScanJob* jobs;
+    int count;
+    int cachedCount;
+    atomic_int nextJob;    // Next job to hand out
+} LibraryScan;
+
+// Playback commands sent from the menu to the playback worker
+typedef enum {
+    CMD_PLAY,              // Start from `current`, or resume if paused
+    CMD_PAUSE,
+    CMD_STOP,
+    CMD_NEXT,              // Skip to the next track
+    CMD_SEEK,              // Move within the playing track to `seconds`
+    CMD_SYNC,              // The playlist was edited; recheck what plays next
+    CMD_STATS,             // Print the audio cache statistics
+    CMD_QUIT
+} CommandType;
+
+// Structure for the decoded-audio cache (playback worker only)
+// Entries are few (the budget holds tens of songs), so lookups scan the array rather than hash
+typedef struct ChunkCache {
+    DecodedTrack** entries;
+    int count;
+    int capacity;
+    size_t bytes;                  // Decoded audio held
+    size_t budget;                 // Unused entries are evicted, oldest first, to stay under this
+    unsigned long long clock;
+    long hits;                     // Tracks started from the cache
+    long misses;                   // Tracks that had to be decoded before playing
+    long filledAhead;              // Upcoming tracks decoded into the cache while the loader was idle
+    long evictions;
+    int* failedPaths;              // Songs that could not be decoded, skipped when filling ahead
+    int failedCount;
+    int failedCapacity;
+} ChunkCache;
+
+// Structure for one queued playback command
+typedef struct Command {
+    CommandType type;
+    double seconds;        // Seek target
+} Command;
+
+// States of the playback worker
+typedef enum {
+    PLAYER_STOPPED,
+    PLAYER_PLAYING,
+    PLAYER_PAUSED
+} PlayerState;
+
+// Structure for the gapless player shared by the menu, the playback worker, the loader thread and the audio callback
+typedef struct Player {
+    Playlist* playlist;
+
+    // Menu to worker: single-producer, single-consumer command ring
+    Command commands[COMMAND_SLOTS];
+    atomic_uint commandHead;
+    atomic_uint commandTail;
+    pthread_t workerThread;
+
+    // Audio callback side
+    DecodedTrack* playing;              // Track being read (owned by the callback while it is hooked)
+    Uint32 playedBytes;
+    DecodedTrack* incoming;             // Track fading in over the end of `playing` (NULL = no crossfade running)
+    Uint32 incomingBytes;               // Bytes of `incoming` played
+    Uint32 fadeBytes;                   // Length of the running crossfade
+    _Atomic(DecodedTrack*) next;        // Track to continue with when `playing` ends
+    DecodedTrack* retired[RETIRED_SLOTS]; // Finished tracks for the playback worker to release (single-producer ring)
+    atomic_uint retiredHead;
+    atomic_uint retiredTail;
+    atomic_int tracksStarted;
+    atomic_long silentBytes;            // Silence written since the last track started
+    atomic_long handoverGapBytes;       // Silence written before the latest track started
+    atomic_int paused;                  // Write silence without moving through the track
+    atomic_long seekBytes;              // Pending seek within the playing track (-1 = none)
+    atomic_int crossfadeBytes;          // Overlap between songs, set from the menu (0 = gapless, no fade)
+    atomic_int leveling;                // Apply each track's leveling gain
+    sem_t events;                       // Posted for each command, track boundary and finished load
+    sem_t commandsDone;                 // Posted once per command the worker has carried out
+
+    // Loader thread side, guarded by loaderLock
+    pthread_t loaderThread;
+    pthread_mutex_t loaderLock;
+    pthread_cond_t loaderWake;
+    char pendingPath[MAX_PATH_LENGTH];
+    float pendingGainDb;                // ReplayGain from the tags of the pending track (NAN = measure it)
+    unsigned int pendingRequest;        // Request waiting for the loader (0 = none)
+    DecodedTrack* loadedTrack;
+    unsigned int loadedRequest;
+    int loadDone;
+    int loaderExit;
+
+    // Worker side, guarded by the playlist lock
+    PlayerState state;
+    int exitWhenFinished;               // Leave the worker loop at the end of the playlist (play mode)
+    PrefetchSlot slots[PREFETCH_SLOTS];
+    unsigned int requestSerial;
+    int loaderBusy;
+    int loadingPathId;                  // Song the loader is decoding while loaderBusy
+    int afterReset;                     // The next track to start follows a (re)start, not a handover
+    double bytesPerSecond;
+    int bytesPerFrame;
+    int frequency;
+    int channels;
+    int mixable;                        // The device takes 16-bit samples, which the mixing stage works on
+    int endedTracks;                    // Tracks started that have since ended or been cut off (worker)
+    int handovers;
+    int crossfades;
+    double totalGapMs;
+    ChunkCache cache;                   // Every decoded track, including those playing, is owned by the cache
+} Player;
+
+// Function to exit on a failed allocation
+void* checkedAlloc(void* ptr) {
+    if (ptr == NULL) {
+        printf(RED "Memory allocation failed!\n" RESET);
+        exit(1);
+    }
+    return ptr;
+}
+
+// Function to hash a string (FNV-1a)
+unsigned int hashString(const char* text) {
+    unsigned int hash = 2166136261u;
+    while (*text) {
+        hash ^= (unsigned char)*text++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to draw a random number below bound (xorshift64*)
+unsigned int randomBelow(unsigned long long* state, unsigned int bound) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    unsigned long long x = *state * 2685821657736338717ull;
+    return (unsigned int)(((x >> 32) * bound) >> 32);
+}
+
+// Function to read a monotonic clock in seconds
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to initialize an empty string pool
+void initStringPool(StringPool* pool) {
+    pool->length = 0;
+    pool->capacity = INITIAL_POOL_BYTES;
+    pool->bytes = (char*)checkedAlloc(malloc(pool->capacity));
+    pool->count = 0;
+    pool->offsetCapacity = INITIAL_PLAYLIST_CAPACITY;
+    pool->offsets = (size_t*)checkedAlloc(malloc(pool->offsetCapacity * sizeof(size_t)));
+    pool->indexCapacity = INITIAL_PLAYLIST_CAPACITY * 2;
+    pool->index = (int*)checkedAlloc(malloc(pool->indexCapacity * sizeof(int)));
+    for (int i = 0; i < pool->indexCapacity; i++) {
+        pool->index[i] = -1;
+    }
+}
+
+// Function to free a string pool
+void freeStringPool(StringPool* pool) {
+    free(pool->bytes);
+    free(pool->offsets);
+    free(pool->index);
+}
+
+// Function to get the string stored under a string ID
+const char* stringAt(const StringPool* pool, int id) {
+    return pool->bytes + pool->offsets[id];
+}
+
+// Function to double the string hash table and re-file every string
+void growStringIndex(StringPool* pool) {
+    free(pool->index);
+    pool->indexCapacity *= 2;
+    pool->index = (int*)checkedAlloc(malloc(pool->indexCapacity * sizeof(int)));
+    for (int i = 0; i < pool->indexCapacity; i++) {
+        pool->index[i] = -1;
+    }
+    unsigned int mask = pool->indexCapacity - 1;
+    for (int id = 0; id < pool->count; id++) {
+        unsigned int slot = hashString(stringAt(pool, id)) & mask;
+        while (pool->index[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        pool->index[slot] = id;
+    }
+}
+
+// Function to find the hash table slot holding a string, or the empty slot where it would go
+unsigned int findStringSlot(const StringPool* pool, const char* text) {
+    unsigned int mask = pool->indexCapacity - 1;
+    unsigned int slot = hashString(text) & mask;
+    while (pool->index[slot] != -1 && strcmp(stringAt(pool, pool->index[slot]), text) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Function to look up a string's ID without adding it, returning -1 if it was never interned
+int findString(const StringPool* pool, const char* text) {
+    return pool->index[findStringSlot(pool, text)];
+}
+
+// Function to intern a string, returning the ID of its single stored copy
+int internString(StringPool* pool, const char* text) {
+    unsigned int slot = findStringSlot(pool, text);
+    if (pool->index[slot] != -1) {
+        return pool->index[slot];
+    }
+
+    size_t size = strlen(text) + 1;
+    if (pool->length + size > pool->capacity) {
+        while (pool->length + size > pool->capacity) {
+            pool->capacity *= 2;
+        }
+        pool->bytes = (char*)checkedAlloc(realloc(pool->bytes, pool->capacity));
+    }
+    if (pool->count == pool->offsetCapacity) {
+        pool->offsetCapacity *= 2;
+        pool->offsets = (size_t*)checkedAlloc(realloc(pool->offsets, pool->offsetCapacity * sizeof(size_t)));
+    }
+    memcpy(pool->bytes + pool->length, text, size);
+    pool->offsets[pool->count] = pool->length;
+    pool->length += size;
+
+    int id = pool->count++;
+    pool->index[slot] = id;
+    // Keep the hash table at most half full
+    if (pool->count * 2 > pool->indexCapacity) {
+        growStringIndex(pool);
+    }
+    return id;
+}
+
+// Function to initialize an empty playlist
+void initPlaylist(Playlist* playlist) {
+    playlist->count = 0;
+    playlist->capacity = INITIAL_PLAYLIST_CAPACITY;
+    playlist->tracks = (Track*)checkedAlloc(malloc(playlist->capacity * sizeof(Track)));
+    initStringPool(&playlist->strings);
+    playlist->current = 0;
+    playlist->playing = 0;
+    playlist->restartPending = 0;
+    playlist->rngState = (unsigned long long)time(NULL) * 0x9E3779B97F4A7C15ull | 1;
+    pthread_mutex_init(&playlist->lock, NULL);
+    playlist->snapshot = NULL;
+    playlist->snapshotSize = 0;
+}
+
+// Function to free the playlist memory
+void freePlaylist(Playlist* playlist) {
+    if (playlist->snapshot != NULL) {
+        munmap(playlist->snapshot, playlist->snapshotSize);
+    } else {
+        free(playlist->tracks);
+        freeStringPool(&playlist->strings);
+    }
+    pthread_mutex_destroy(&playlist->lock);
+}
+
+// Function to copy an array out of a snapshot mapping into a new allocation of the given capacity
+void* copyOut(const void* mapped, size_t used, size_t capacity) {
+    void* copy = checkedAlloc(malloc(capacity));
+    memcpy(copy, mapped, used);
+    return copy;
+}
+
+// Function to move a restored playlist out of its snapshot mapping so it can grow
+// Edits in place (shuffle, move, remove) do not need this: the mapping is private and copy-on-write
+void detachSnapshot(Playlist* playlist) {
+    StringPool* pool = &playlist->strings;
+    playlist->capacity = playlist->count > INITIAL_PLAYLIST_CAPACITY ? playlist->count : INITIAL_PLAYLIST_CAPACITY;
+    playlist->tracks = (Track*)copyOut(playlist->tracks, playlist->count * sizeof(Track), playlist->capacity * sizeof(Track));
+    pool->capacity = pool->length > INITIAL_POOL_BYTES ? pool->length : INITIAL_POOL_BYTES;
+    pool->bytes = (char*)copyOut(pool->bytes, pool->length, pool->capacity);
+    pool->offsetCapacity = pool->count > INITIAL_PLAYLIST_CAPACITY ? pool->count : INITIAL_PLAYLIST_CAPACITY;
+    pool->offsets = (size_t*)copyOut(pool->offsets, pool->count * sizeof(size_t), pool->offsetCapacity * sizeof(size_t));
+    pool->index = (int*)copyOut(pool->index, pool->indexCapacity * sizeof(int), pool->indexCapacity * sizeof(int));
+    munmap(playlist->snapshot, playlist->snapshotSize);
+    playlist->snapshot = NULL;
+    playlist->snapshotSize = 0;
+}
+
+// Function to append a track in amortized O(1), returning its position (title may be NULL or "" if unknown)
+int appendTrack(Playlist* playlist, const char* path, const char* title, int length, float gainDb) {
+    pthread_mutex_lock(&playlist->lock);
+    if (playlist->snapshot != NULL) {
+        detachSnapshot(playlist);
+    }
+    if (playlist->count == playlist->capacity) {
+        playlist->capacity *= 2;
+        playlist->tracks = (Track*)checkedAlloc(realloc(playlist->tracks, playlist->capacity * sizeof(Track)));
+    }
+    int position = playlist->count++;
+    playlist->tracks[position].pathId = internString(&playlist->strings, path);
+    playlist->tracks[position].titleId = title != NULL && title[0] != '\0' ? internString(&playlist->strings, title) : -1;
+    playlist->tracks[position].length = length;
+    playlist->tracks[position].gainDb = gainDb;
+    pthread_mutex_unlock(&playlist->lock);
+    return position;
+}
+
+// Function to get the track at a position
+Track trackAt(const Playlist* playlist, int position) {
+    return playlist->tracks[position];
+}
+
+// Function to shuffle the playlist (Fisher-Yates); a playing track stays current
+void shufflePlaylist(Playlist* playlist) {
+    pthread_mutex_lock(&playlist->lock);
+    for (int i = playlist->count - 1; i > 0; i--) {
+        int j = (int)randomBelow(&playlist->rngState, (unsigned int)i + 1);
+        Track swap = playlist->tracks[i];
+        playlist->tracks[i] = playlist->tracks[j];
+        playlist->tracks[j] = swap;
+        if (playlist->current == i) {
+            playlist->current = j;
+        } else if (playlist->current == j) {
+            playlist->current = i;
+        }
+    }
+    if (!playlist->playing) {
+        playlist->current = 0; // Nothing playing: the next Play starts from the new first track
+    }
+    pthread_mutex_unlock(&playlist->lock);
+}
+
+// Function to move a track from one position to another, shifting the tracks in between
+void moveTrack(Playlist* playlist, int from, int to) {
+    pthread_mutex_lock(&playlist->lock);
+    Track moved = playlist->tracks[from];
+    if (from < to) {
+        memmove(playlist->tracks + from, playlist->tracks + from + 1, (size_t)(to - from) * sizeof(Track));
+    } else {
+        memmove(playlist->tracks + to + 1, playlist->tracks + to, (size_t)(from - to) * sizeof(Track));
+    }
+    playlist->tracks[to] = moved;
+
+    // Keep `current` on the same track
+    if (playlist->current == from) {
+        playlist->current = to;
+    } else if (from < playlist->current && playlist->current <= to) {
+        playlist->current--;
+    } else if (to <= playlist->current && playlist->current < from) {
+        playlist->current++;
+    }
+    pthread_mutex_unlock(&playlist->lock);
+}
+
+// Function to remove the track at a position; removing the playing track skips to the next one
+void removeTrack(Playlist* playlist, int position) {
+    pthread_mutex_lock(&playlist->lock);
+    memmove(playlist->tracks + position, playlist->tracks + position + 1,
+            (size_t)(playlist->count - position - 1) * sizeof(Track));
+    playlist->count--;
+    if (position < playlist->current) {
+        playlist->current--;
+    } else if (position == playlist->current && playlist->playing) {
+        playlist->restartPending = 1;
+    }
+    pthread_mutex_unlock(&playlist->lock);
+}
+
+// Function to make a position the next track to play, leaving the playing song if there is one
+// Returns whether a song was playing
+int jumpToTrack(Playlist* playlist, int position) {
+    pthread_mutex_lock(&playlist->lock);
+    playlist->current = position;
+    int playing = playlist->playing;
+    if (playing) {
+        playlist->restartPending = 1;
+    }
+    pthread_mutex_unlock(&playlist->lock);
+    return playing;
+}
+
+// Function to read a big-endian 32-bit value
+unsigned int readBE32(const unsigned char* p) {
+    return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+// Function to read a 28-bit ID3v2 "syncsafe" integer (7 bits per byte)
+unsigned int readSyncsafe(const unsigned char* p) {
+    return (unsigned int)(p[0] & 0x7F) << 21 | (unsigned int)(p[1] & 0x7F) << 14 | (unsigned int)(p[2] & 0x7F) << 7 |
+           (p[3] & 0x7F);
+}
+
+// Function to decode a 4-byte MPEG audio frame header; returns 0 if the bytes are not one
+int parseFrameHeader(const unsigned char* p, FrameHeader* header) {
+    static const short bitrates[2][3][15] = {
+        {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},     // MPEG-1 layer I
+         {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},        // MPEG-1 layer II
+         {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},        // MPEG-1 layer III
+        {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},        // MPEG-2/2.5 layer I
+         {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},             // MPEG-2/2.5 layer II
+         {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};           // MPEG-2/2.5 layer III
+    static const int sampleRates[3][3] = {{44100, 48000, 32000}, {22050, 24000, 16000}, {11025, 12000, 8000}};
+
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return 0;
+    }
+    int versionBits = (p[1] >> 3) & 3;  // 0 = MPEG-2.5, 1 = reserved, 2 = MPEG-2, 3 = MPEG-1
+    int layerBits = (p[1] >> 1) & 3;    // 1 = layer III, 2 = layer II, 3 = layer I
+    int bitrateIndex = p[2] >> 4;
+    int rateIndex = (p[2] >> 2) & 3;
+    // Free-format streams (bitrate index 0) have no computable frame length and are not supported
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+        return 0;
+    }
+
+    header->version = versionBits == 3 ? 0 : versionBits == 2 ? 1 : 2;
+    header->layer = 4 - layerBits;
+    header->sampleRate = sampleRates[header->version][rateIndex];
+    header->mono = (p[3] >> 6) == 3;
+    int kbps = bitrates[header->version > 0][header->layer - 1][bitrateIndex];
+    int padding = (p[2] >> 1) & 1;
+    if (header->layer == 1) {
+        header->samples = 384;
+        header->length = (12000 * kbps / header->sampleRate + padding) * 4;
+    } else {
+        header->samples = header->layer == 3 && header->version > 0 ? 576 : 1152;
+        header->length = header->samples / 8 * 1000 * kbps / header->sampleRate + padding;
+    }
+    return 1;
+}
+
+// Function to append one Unicode code point to a UTF-8 buffer; returns 0 when it does not fit
+int appendUtf8(char* out, int* used, int capacity, unsigned int code) {
+    unsigned char bytes[4];
+    int n;
+    if (code < 0x80) {
+        bytes[0] = (unsigned char)code;
+        n = 1;
+    } else if (code < 0x800) {
+        bytes[0] = (unsigned char)(0xC0 | code >> 6);
+        bytes[1] = (unsigned char)(0x80 | (code & 0x3F));
+        n = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = (unsigned char)(0xE0 | code >> 12);
+        bytes[1] = (unsigned char)(0x80 | (code >> 6 & 0x3F));
+        bytes[2] = (unsigned char)(0x80 | (code & 0x3F));
+        n = 3;
+    } else {
+        bytes[0] = (unsigned char)(0xF0 | code >> 18);
+        bytes[1] = (unsigned char)(0x80 | (code >> 12 & 0x3F));
+        bytes[2] = (unsigned char)(0x80 | (code >> 6 & 0x3F));
+        bytes[3] = (unsigned char)(0x80 | (code & 0x3F));
+        n = 4;
+    }
+    if (*used + n >= capacity) {
+        return 0;
+    }
+    memcpy(out + *used, bytes, n);
+    *used += n;
+    out[*used] = '\0';
+    return 1;
+}
+
+// Function to convert an ID3v2 text frame body (encoding byte + text) to UTF-8
+void decodeId3Text(const unsigned char* p, size_t size, char* out, int capacity) {
+    int used = 0;
+    out[0] = '\0';
+    if (size < 2) {
+        return;
+    }
+    int encoding = p[0];
+    p++;
+    size--;
+    if (encoding == 0 || encoding == 3) {
+        for (size_t i = 0; i < size && p[i] != 0; i++) {
+            if (encoding == 0) {
+                // ISO-8859-1 maps byte for byte onto the first 256 code points
+                if (!appendUtf8(out, &used, capacity, p[i])) {
+                    break;
+                }
+            } else if (used + 1 < capacity) {
+                out[used++] = (char)p[i];
+                out[used] = '\0';
+            } else {
+                // Out of room: drop a multi-byte character cut in half
+                while (used > 0 && ((unsigned char)out[used - 1] & 0xC0) == 0x80) {
+                    used--;
+                }
+                if (used > 0 && ((unsigned char)out[used - 1] & 0xC0) == 0xC0) {
+                    used--;
+                }
+                out[used] = '\0';
+                break;
+            }
+        }
+        return;
+    }
+
+    // UTF-16: encoding 1 starts with a byte order mark, encoding 2 is always big-endian
+    int bigEndian = 1;
+    if (encoding == 1 && size >= 2) {
+        bigEndian = !(p[0] == 0xFF && p[1] == 0xFE);
+        if ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF)) {
+            p += 2;
+            size -= 2;
+        }
+    }
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        unsigned int unit = bigEndian ? (unsigned int)p[i] << 8 | p[i + 1] : (unsigned int)p[i + 1] << 8 | p[i];
+        if (unit == 0) {
+            break;
+        }
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < size) {
+            unsigned int low = bigEndian ? (unsigned int)p[i + 2] << 8 | p[i + 3] : (unsigned int)p[i + 3] << 8 | p[i + 2];
+            if (low >= 0xDC00 && low < 0xE000) {
+                unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        if (!appendUtf8(out, &used, capacity, unit)) {
+            break;
+        }
+    }
+}
+
+// Function to read the ReplayGain track gain ("-6.54 dB") from a TXXX frame body; returns 0 for other TXXX frames
+int readReplayGainFrame(const unsigned char* body, size_t size, float* gainDb) {
+    char description[32];
+    decodeId3Text(body, size, description, sizeof(description));
+    if (strcasecmp(description, "REPLAYGAIN_TRACK_GAIN") != 0) {
+        return 0;
+    }
+    // The value follows the description's terminator: one zero byte, or a zero UTF-16 unit
+    int wide = body[0] == 1 || body[0] == 2;
+    size_t pos = 1;
+    while (pos + wide < size && (body[pos] != 0 || (wide && body[pos + 1] != 0))) {
+        pos += 1 + wide;
+    }
+    pos += 1 + wide;
+    if (pos >= size) {
+        return 0;
+    }
+    unsigned char value[48];
+    size_t length = size - pos < sizeof(value) - 1 ? size - pos : sizeof(value) - 1;
+    value[0] = body[0];
+    memcpy(value + 1, body + pos, length);
+    char text[32];
+    decodeId3Text(value, length + 1, text, sizeof(text));
+    char* end;
+    float gain = strtof(text, &end);
+    if (end == text || !isfinite(gain)) {
+        return 0;
+    }
+    *gainDb = gain;
+    return 1;
+}
+
+// Function to read the title (TIT2, or TT2 in ID3v2.2) and ReplayGain track gain (TXXX, or TXX) from an ID3v2 tag
+void readId3v2Tags(const unsigned char* tag, size_t tagSize, Mp3Info* info) {
+    int major = tag[3];
+    int flags = tag[5];
+    // Whole-tag unsynchronisation (ID3v2.2/2.3) changes frame bytes; such tags are rare and skipped
+    if (major < 2 || major > 4 || ((flags & 0x80) && major < 4)) {
+        return;
+    }
+    size_t pos = 10;
+    if ((flags & 0x40) && major >= 3) {
+        // Extended header: its size excludes itself in ID3v2.3 and includes itself in ID3v2.4
+        if (tagSize < 14) {
+            return;
+        }
+        pos += major == 3 ? 4 + (size_t)readBE32(tag + 10) : (size_t)readSyncsafe(tag + 10);
+        if (pos > tagSize) {
+            return;
+        }
+    }
+    int headerSize = major == 2 ? 6 : 10;
+    while (pos + headerSize <= tagSize && tag[pos] != 0) {
+        const unsigned char* frame = tag + pos;
+        size_t size;
+        int skip = 0;
+        if (major == 2) {
+            size = (size_t)frame[3] << 16 | (size_t)frame[4] << 8 | frame[5];
+        } else {
+            size = major == 4 ? readSyncsafe(frame + 4) : readBE32(frame + 4);
+            // Compressed, encrypted or (ID3v2.4) unsynchronised frames are not decoded
+            skip = major == 3 ? (frame[9] & 0xC0) != 0 : (frame[9] & 0x0E) != 0;
+        }
+        if (size > tagSize - pos - headerSize) {
+            return;
+        }
+        if (!skip && memcmp(frame, major == 2 ? "TT2" : "TIT2", major == 2 ? 3 : 4) == 0) {
+            decodeId3Text(frame + headerSize, size, info->title, MAX_TITLE_LENGTH);
+        } else if (!skip && memcmp(frame, major == 2 ? "TXX" : "TXXX", major == 2 ? 3 : 4) == 0) {
+            readReplayGainFrame(frame + headerSize, size, &info->gainDb);
+        }
+        pos += headerSize + size;
+    }
+}
+
+// Function to read the title from a 128-byte ID3v1 tag at the end of the file
+void readId3v1Title(const unsigned char* tag, char* title) {
+    int used = 0;
+    int end = 30;
+    while (end > 0 && (tag[3 + end - 1] == ' ' || tag[3 + end - 1] == 0)) {
+        end--;
+    }
+    title[0] = '\0';
+    for (int i = 0; i < end && tag[3 + i] != 0; i++) {
+        appendUtf8(title, &used, MAX_TITLE_LENGTH, tag[3 + i]); // ISO-8859-1
+    }
+}
+
+// Function to find the first real audio frame: a valid header followed by another valid header (or the end)
+size_t findFirstFrame(const unsigned char* data, size_t start, size_t end, FrameHeader* header) {
+    for (size_t pos = start; pos + 4 <= end; pos++) {
+        if (data[pos] != 0xFF || !parseFrameHeader(data + pos, header)) {
+            continue;
+        }
+        size_t next = pos + header->length;
+        FrameHeader following;
+        if (next + 4 > end || parseFrameHeader(data + next, &following)) {
+            return pos;
+        }
+    }
+    return end;
+}
+
+// Function to read an MP3's exact duration and title from a mapped file; returns 0 if no audio frame is found
+// The duration comes from a Xing/Info or VBRI header when the encoder wrote one, otherwise from walking every frame
+int parseMp3(const unsigned char* data, size_t size, Mp3Info* info) {
+    info->seconds = 0;
+    info->title[0] = '\0';
+    info->source = DURATION_UNKNOWN;
+    info->gainDb = NAN;
+
+    size_t audioStart = 0;
+    size_t audioEnd = size;
+    if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+        size_t tagSize = 10 + (size_t)readSyncsafe(data + 6) + ((data[5] & 0x10) ? 10 : 0);
+        if (tagSize <= size) {
+            readId3v2Tags(data, tagSize, info);
+            audioStart = tagSize;
+        }
+    }
+    if (size >= 128 && memcmp(data + size - 128, "TAG", 3) == 0) {
+        audioEnd = size - 128;
+        if (info->title[0] == '\0') {
+            readId3v1Title(data + size - 128, info->title);
+        }
+    }
+
+    FrameHeader header;
+    size_t first = findFirstFrame(data, audioStart, audioEnd, &header);
+    if (first >= audioEnd) {
+        return 0;
+    }
+    const unsigned char* frame = data + first;
+
+    // Xing (VBR) / Info (CBR) header, right after the side information of the first frame
+    size_t sideInfo = header.version == 0 ? (header.mono ? 17 : 32) : (header.mono ? 9 : 17);
+    size_t xing = 4 + sideInfo;
+    if (header.layer == 3 && first + xing + 12 <= audioEnd &&
+        (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0)) {
+        unsigned int flags = readBE32(frame + xing + 4);
+        if (flags & 1) {
+            double samples = (double)readBE32(frame + xing + 8) * header.samples;
+            // The LAME/Lavc extension records the encoder delay and end padding for gapless players
+            size_t lame = xing + 8 + 4 + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) + ((flags & 8) ? 4 : 0);
+            if (first + lame + 24 <= audioEnd &&
+                (memcmp(frame + lame, "LAME", 4) == 0 || memcmp(frame + lame, "Lavc", 4) == 0 ||
+                 memcmp(frame + lame, "Lavf", 4) == 0)) {
+                const unsigned char* gapless = frame + lame + 21;
+                int delay = gapless[0] << 4 | gapless[1] >> 4;
+                int padding = (gapless[1] & 0x0F) << 8 | gapless[2];
+                if (delay + padding < samples) {
+                    samples -= delay + padding;
+                }
+                // LAME's "radio" ReplayGain field: name code (3 bits), originator (3), sign (1), tenths of a dB (9)
+                const unsigned char* radio = frame + lame + 15;
+                if (memcmp(frame + lame, "LAME", 4) == 0 && radio[0] >> 5 == 1 && (radio[0] >> 2 & 7) != 0 &&
+                    isnan(info->gainDb)) {
+                    int tenths = (radio[0] & 1) << 8 | radio[1];
+                    info->gainDb = (radio[0] & 2 ? -tenths : tenths) / 10.0f;
+                }
+            }
+            info->seconds = samples / header.sampleRate;
+            info->source = DURATION_XING;
+            return 1;
+        }
+    }
+
+    // VBRI header (Fraunhofer encoder), always 32 bytes after the frame header
+    if (first + 36 + 18 <= audioEnd && memcmp(frame + 36, "VBRI", 4) == 0) {
+        info->seconds = (double)readBE32(frame + 36 + 14) * header.samples / header.sampleRate;
+        info->source = DURATION_VBRI;
+        return 1;
+    }
+
+    // No header: count the samples frame by frame, resynchronizing over damaged stretches
+    double samples = 0;
+    size_t pos = first;
+    while (pos + 4 <= audioEnd) {
+        FrameHeader current;
+        if (parseFrameHeader(data + pos, &current) && pos + current.length <= audioEnd) {
+            samples += current.samples;
+            pos += current.length;
+        } else {
+            pos = findFirstFrame(data, pos + 1, audioEnd, &current);
+        }
+    }
+    info->seconds = samples / header.sampleRate;
+    info->source = DURATION_FRAMES;
+    return 1;
+}
+
+// Function to memory-map an MP3 file and read its metadata; returns 0 if it cannot be read or has no audio
+int scanMp3(const char* path, Mp3Info* info) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    int ok = parseMp3((const unsigned char*)data, (size_t)st.st_size, info);
+    munmap(data, (size_t)st.st_size);
+    return ok;
+}
+
+// Function to initialize an empty library index
+void initLibraryIndex(LibraryIndex* library) {
+    initStringPool(&library->paths);
+    initStringPool(&library->titles);
+    library->capacity = INITIAL_PLAYLIST_CAPACITY;
+    library->entries = (LibraryEntry*)checkedAlloc(malloc(library->capacity * sizeof(LibraryEntry)));
+    library->dirty = 0;
+}
+
+// Function to free a library index
+void freeLibraryIndex(LibraryIndex* library) {
+    freeStringPool(&library->paths);
+    freeStringPool(&library->titles);
+    free(library->entries);
+}
+
+// Function to record a file's metadata under its path, replacing what was stored before
+void libraryStore(LibraryIndex* library, const char* path, long long mtimeNs, long long size, const Mp3Info* info) {
+    int id = internString(&library->paths, path);
+    if (id >= library->capacity) {
+        library->capacity *= 2;
+        library->entries = (LibraryEntry*)checkedAlloc(realloc(library->entries, library->capacity * sizeof(LibraryEntry)));
+    }
+    LibraryEntry* entry = &library->entries[id];
+    entry->mtimeNs = mtimeNs;
+    entry->size = size;
+    entry->seconds = info->seconds;
+    entry->source = info->source;
+    entry->gainDb = info->gainDb;
+    entry->titleId = info->title[0] != '\0' ? internString(&library->titles, info->title) : -1;
+    library->dirty = 1;
+}
+
+// Function to get a file's remembered metadata if the file has not changed since it was scanned
+int libraryFind(const LibraryIndex* library, const char* path, long long mtimeNs, long long size, Mp3Info* info) {
+    int id = findString(&library->paths, path);
+    if (id < 0 || library->entries[id].mtimeNs != mtimeNs || library->entries[id].size != size) {
+        return 0;
+    }
+    const LibraryEntry* entry = &library->entries[id];
+    info->seconds = entry->seconds;
+    info->source = (DurationSource)entry->source;
+    info->gainDb = entry->gainDb;
+    if (entry->titleId >= 0) {
+        snprintf(info->title, MAX_TITLE_LENGTH, "%s", stringAt(&library->titles, entry->titleId));
+    } else {
+        info->title[0] = '\0';
+    }
+    return 1;
+}
+
+// Function to get a file's modification time (nanoseconds) and size; returns 0 if it cannot be read
+int fileVersion(const char* path, long long* mtimeNs, long long* size) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    *mtimeNs = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    *size = (long long)st.st_size;
+    return 1;
+}
+
+// Function to load the library index; a missing or damaged file leaves it empty, so everything is rescanned
+void loadLibraryIndex(LibraryIndex* library, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return;
+    }
+    LibraryFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != LIBRARY_INDEX_MAGIC ||
+        header.version != LIBRARY_INDEX_VERSION) {
+        fclose(file);
+        return;
+    }
+    char entryPath[MAX_PATH_LENGTH];
+    Mp3Info info;
+    for (unsigned int i = 0; i < header.count; i++) {
+        LibraryFileRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.pathLength >= MAX_PATH_LENGTH ||
+            record.titleLength >= MAX_TITLE_LENGTH || fread(entryPath, 1, record.pathLength, file) != record.pathLength ||
+            fread(info.title, 1, record.titleLength, file) != record.titleLength) {
+            break; // Truncated: keep what was read
+        }
+        entryPath[record.pathLength] = '\0';
+        info.title[record.titleLength] = '\0';
+        info.seconds = record.seconds;
+        info.source = (DurationSource)record.source;
+        info.gainDb = record.gainDb;
+        libraryStore(library, entryPath, record.mtimeNs, record.size, &info);
+    }
+    fclose(file);
+    library->dirty = 0;
+}
+
+// Function to save the library index, replacing the old file only once the new one is complete
+int saveLibraryIndex(LibraryIndex* library, const char* path) {
+    char tmpPath[MAX_PATH_LENGTH + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        printf(RED "Cannot write library index %s\n" RESET, tmpPath);
+        return 0;
+    }
+    LibraryFileHeader header = {LIBRARY_INDEX_MAGIC, LIBRARY_INDEX_VERSION, (unsigned int)library->paths.count};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int id = 0; ok && id < library->paths.count; id++) {
+        const LibraryEntry* entry = &library->entries[id];
+        const char* entryPath = stringAt(&library->paths, id);
+        const char* title = entry->titleId >= 0 ? stringAt(&library->titles, entry->titleId) : "";
+        LibraryFileRecord record;
+        memset(&record, 0, sizeof(record));
+        record.mtimeNs = entry->mtimeNs;
+        record.size = entry->size;
+        record.seconds = entry->seconds;
+        record.source = entry->source;
+        record.gainDb = entry->gainDb;
+        record.pathLength = (unsigned short)strlen(entryPath);
+        record.titleLength = (unsigned short)strlen(title);
+        ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+             fwrite(entryPath, 1, record.pathLength, file) == record.pathLength &&
+             fwrite(title, 1, record.titleLength, file) == record.titleLength;
+    }
+    if (fclose(file) != 0 || !ok || rename(tmpPath, path) != 0) {
+        printf(RED "Cannot write library index %s\n" RESET, path);
+        remove(tmpPath);
+        return 0;
+    }
+    library->dirty = 0;
+    return 1;
+}
+
+// Function to check for a .mp3 extension, in any letter case
+int hasMp3Extension(const char* name) {
+    size_t length = strlen(name);
+    return length > 4 && strcasecmp(name + length - 4, ".mp3") == 0;
+}
+
+// Function to add a path to a growable list of paths
+void addScanPath(char*** paths, int* count, int* capacity, const char* path) {
+    if (*count == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 64;
+        *paths = (char**)checkedAlloc(realloc(*paths, *capacity * sizeof(char*)));
+    }
+    (*paths)[(*count)++] = (char*)checkedAlloc(strdup(path));
+}
+
+// Function to collect MP3 files under a directory, descending into subdirectories (a file is taken as is)
+void collectMp3Files(const char* root, char*** paths, int* count, int* capacity) {
+    DIR* dir = opendir(root);
+    if (dir == NULL) {
+        long long mtimeNs, size;
+        if (fileVersion(root, &mtimeNs, &size)) {
+            addScanPath(paths, count, capacity, root);
+        } else {
+            printf(RED "Cannot open %s\n" RESET, root);
+        }
+        return;
+    }
+    struct dirent* item;
+    char path[MAX_PATH_LENGTH];
+    while ((item = readdir(dir)) != NULL) {
+        if (item->d_name[0] == '.') {
+            continue; // Hidden files, "." and ".."
+        }
+        size_t rootLength = strlen(root);
+        if (snprintf(path, sizeof(path), "%s%s%s", root, rootLength > 0 && root[rootLength - 1] == '/' ? "" : "/",
+                     item->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            collectMp3Files(path, paths, count, capacity);
+        } else if (S_ISREG(st.st_mode) && hasMp3Extension(item->d_name)) {
+            addScanPath(paths, count, capacity, path);
+        }
+    }
+    closedir(dir);
+}
+
+// Function to compare two paths for qsort
+int comparePaths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Function to scan the files handed out by a shared counter (one per thread pool worker)
+void* scanWorker(void* arg) {
+    LibraryScan* scan = (LibraryScan*)arg;
+    int i;
+    while ((i = atomic_fetch_add(&scan->nextJob, 1)) < scan->count) {
+        ScanJob* job = &scan->jobs[i];
+        if (!job->cached) {
+            OP_STATS_START(timer);
+            job->ok = scanMp3(job->path, &job->info);
+            OP_STATS_STOP(OP_SCAN_FILE, timer);
+        }
+    }
+    return NULL;
+}
+
+// Function to scan directories (or files) for MP3s on a thread pool, reusing index entries for unchanged files
+// Fills `result` with one job per file, sorted by path; free it with freeLibraryScan
+void scanLibrary(LibraryIndex* library, char* const roots[], int rootCount, int threads, LibraryScan* result) {
+    LibraryScan scan;
+    char** paths = NULL;
+    int capacity = 0;
+    scan.count = 0;
+    for (int i = 0; i < rootCount; i++) {
+        collectMp3Files(roots[i], &paths, &scan.count, &capacity);
+    }
+    if (scan.count > 0) {
+        qsort(paths, scan.count, sizeof(char*), comparePaths);
+    }
+
+    scan.jobs = (ScanJob*)checkedAlloc(calloc(scan.count > 0 ? scan.count : 1, sizeof(ScanJob)));
+    scan.cachedCount = 0;
+    for (int i = 0; i < scan.count; i++) {
+        ScanJob* job = &scan.jobs[i];
+        job->path = paths[i];
+        job->ok = fileVersion(job->path, &job->mtimeNs, &job->size);
+        job->cached = job->ok && libraryFind(library, job->path, job->mtimeNs, job->size, &job->info);
+        scan.cachedCount += job->cached;
+    }
+    free(paths);
+
+    // Only changed or new files reach the pool
+    int pending = scan.count - scan.cachedCount;
+    if (threads > pending) {
+        threads = pending;
+    }
+    atomic_init(&scan.nextJob, 0);
+    pthread_t pool[MAX_SCAN_THREADS];
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&pool[started], NULL, scanWorker, &scan) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        scanWorker(&scan);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool[i], NULL);
+    }
+
+    for (int i = 0; i < scan.count; i++) {
+        ScanJob* job = &scan.jobs[i];
+        if (job->ok && !job->cached) {
+            libraryStore(library, job->path, job->mtimeNs, job->size, &job->info);
+        }
+    }
+    result->jobs = scan.jobs;
+    result->count = scan.count;
+    result->cachedCount = scan.cachedCount;
+}
+
+// Function to free the results of a library scan
+void freeLibraryScan(LibraryScan* scan) {
+    for (int i = 0; i < scan->count; i++) {
+        free(scan->jobs[i].path);
+    }
+    free(scan->jobs);
+}
+
+// Function to get one file's metadata, from the index if the file is unchanged, otherwise by scanning it
+int libraryLookup(LibraryIndex* library, const char* path, Mp3Info* info) {
+    long long mtimeNs, size;
+    if (!fileVersion(path, &mtimeNs, &size)) {
+        return 0;
+    }
+    if (libraryFind(library, path, mtimeNs, size, info)) {
+        return 1;
+    }
+    if (!scanMp3(path, info)) {
+        return 0;
+    }
+    libraryStore(library, path, mtimeNs, size, info);
+    return 1;
+}
+
+// Function to pick the scanner thread count: one per online CPU, within 1..MAX_SCAN_THREADS
+int defaultScanThreads() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : cpus > MAX_SCAN_THREADS ? MAX_SCAN_THREADS : (int)cpus;
+}
+
+// Function to round a file offset up to the next multiple of 8
+unsigned long long alignTo8(unsigned long long offset) {
+    return (offset + 7) & ~7ull;
+}
+
+// Function to write one snapshot section at the next 8-byte aligned offset, zero-filling the gap
+int writeSection(FILE* file, unsigned long long* position, const void* data, size_t size) {
+    static const char zeros[8] = {0};
+    size_t gap = (size_t)(alignTo8(*position) - *position);
+    if (fwrite(zeros, 1, gap, file) != gap || fwrite(data, 1, size, file) != size) {
+        return 0;
+    }
+    *position += gap + size;
+    return 1;
+}
+
+// Function to save the playlist as a binary snapshot: its arrays written as they are, so loading needs no parsing
+int savePlaylistSnapshot(const Playlist* playlist, const char* path) {
+    const StringPool* pool = &playlist->strings;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PLAYLIST_SNAPSHOT_MAGIC;
+    header.version = PLAYLIST_SNAPSHOT_VERSION;
+    header.trackSize = sizeof(Track);
+    header.offsetSize = sizeof(size_t);
+    header.trackCount = playlist->count;
+    header.current = playlist->current;
+    header.stringCount = pool->count;
+    header.indexCapacity = pool->indexCapacity;
+    header.stringBytes = pool->length;
+    header.tracksAt = alignTo8(sizeof(header));
+    header.offsetsAt = alignTo8(header.tracksAt + (unsigned long long)playlist->count * sizeof(Track));
+    header.indexAt = alignTo8(header.offsetsAt + (unsigned long long)pool->count * sizeof(size_t));
+    header.bytesAt = alignTo8(header.indexAt + (unsigned long long)pool->indexCapacity * sizeof(int));
+    header.fileSize = header.bytesAt + pool->length;
+
+    char tmpPath[MAX_PATH_LENGTH + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        printf(RED "Cannot write playlist snapshot %s\n" RESET, tmpPath);
+        return 0;
+    }
+    unsigned long long position = 0;
+    int ok = writeSection(file, &position, &header, sizeof(header)) &&
+             writeSection(file, &position, playlist->tracks, playlist->count * sizeof(Track)) &&
+             writeSection(file, &position, pool->offsets, pool->count * sizeof(size_t)) &&
+             writeSection(file, &position, pool->index, pool->indexCapacity * sizeof(int)) &&
+             writeSection(file, &position, pool->bytes, pool->length);
+    if (fclose(file) != 0 || !ok || rename(tmpPath, path) != 0) {
+        printf(RED "Cannot write playlist snapshot %s\n" RESET, path);
+        remove(tmpPath);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to check that a mapped snapshot is complete and that every ID and offset in it is in range
+int snapshotIsValid(const char* base, size_t size) {
+    const SnapshotHeader* header = (const SnapshotHeader*)base;
+    if (header->magic != PLAYLIST_SNAPSHOT_MAGIC || header->version != PLAYLIST_SNAPSHOT_VERSION ||
+        header->trackSize != sizeof(Track) || header->offsetSize != sizeof(size_t) || header->fileSize != size ||
+        header->trackCount < 0 || header->stringCount < 0 || header->current < 0 ||
+        header->current > header->trackCount || header->indexCapacity <= header->stringCount ||
+        (header->indexCapacity & (header->indexCapacity - 1)) != 0) {
+        return 0;
+    }
+    // Sections in order, aligned, inside the file, with the string bytes running to its end
+    if (header->tracksAt != alignTo8(sizeof(SnapshotHeader)) ||
+        header->offsetsAt != alignTo8(header->tracksAt + (unsigned long long)header->trackCount * sizeof(Track)) ||
+        header->indexAt != alignTo8(header->offsetsAt + (unsigned long long)header->stringCount * sizeof(size_t)) ||
+        header->bytesAt != alignTo8(header->indexAt + (unsigned long long)header->indexCapacity * sizeof(int)) ||
+        header->bytesAt > size || header->stringBytes != size - header->bytesAt) {
+        return 0;
+    }
+    const Track* tracks = (const Track*)(base + header->tracksAt);
+    const size_t* offsets = (const size_t*)(base + header->offsetsAt);
+    const int* index = (const int*)(base + header->indexAt);
+    const char* bytes = base + header->bytesAt;
+    if (header->stringCount > 0 && (header->stringBytes == 0 || bytes[header->stringBytes - 1] != '\0')) {
+        return 0;
+    }
+    for (int i = 0; i < header->stringCount; i++) {
+        if (offsets[i] >= header->stringBytes) {
+            return 0;
+        }
+    }
+    // One slot per string: the rest must be empty, or probing for a new string would never stop
+    int usedSlots = 0;
+    for (int i = 0; i < header->indexCapacity; i++) {
+        if (index[i] < -1 || index[i] >= header->stringCount) {
+            return 0;
+        }
+        usedSlots += index[i] != -1;
+    }
+    if (usedSlots != header->stringCount) {
+        return 0;
+    }
+    for (int i = 0; i < header->trackCount; i++) {
+        if (tracks[i].pathId < 0 || tracks[i].pathId >= header->stringCount || tracks[i].titleId < -1 ||
+            tracks[i].titleId >= header->stringCount) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to restore an empty playlist from a snapshot with one mmap: the playlist's arrays are pointed into
+// the mapping rather than copied or rebuilt. Returns 0 if there is no snapshot or it cannot be used
+int loadPlaylistSnapshot(Playlist* playlist, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    // Private and writable: shuffles and moves edit the mapped tracks copy-on-write, never the file
+    char* base = (char*)mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+    if (!snapshotIsValid(base, (size_t)st.st_size)) {
+        printf(RED "Ignoring damaged or incompatible playlist snapshot %s\n" RESET, path);
+        munmap(base, (size_t)st.st_size);
+        return 0;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*)base;
+    StringPool* pool = &playlist->strings;
+    free(playlist->tracks);
+    freeStringPool(pool);
+    playlist->tracks = (Track*)(base + header->tracksAt);
+    playlist->count = playlist->capacity = header->trackCount;
+    playlist->current = header->current;
+    pool->bytes = base + header->bytesAt;
+    pool->length = pool->capacity = (size_t)header->stringBytes;
+    pool->offsets = (size_t*)(base + header->offsetsAt);
+    pool->count = pool->offsetCapacity = header->stringCount;
+    pool->index = (int*)(base + header->indexAt);
+    pool->indexCapacity = header->indexCapacity;
+    playlist->snapshot = base;
+    playlist->snapshotSize = (size_t)st.st_size;
+    return 1;
+}
+
+// Function to copy UTF-8 text into a buffer, cutting it at a character boundary if it does not fit
+void copyUtf8(char* out, const char* text, int capacity) {
+    int used = (int)strlen(text);
+    if (used >= capacity) {
+        used = capacity - 1;
+        while (used > 0 && ((unsigned char)text[used] & 0xC0) == 0x80) {
+            used--;
+        }
+    }
+    memcpy(out, text, used);
+    out[used] = '\0';
+}
+
+// Function to read the length and title from the text after "#EXTINF:" (length -1 = unknown)
+void parseExtinf(const char* text, int* length, char* title) {
+    char* end;
+    double seconds = strtod(text, &end);
+    *length = end != text && seconds >= 0 && seconds < 1e8 ? (int)(seconds + 0.5) : -1;
+    // Skip extended attributes (key="value", which may hold commas) up to the comma before the title
+    int quoted = 0;
+    while (*end != '\0' && (quoted || *end != ',')) {
+        if (*end == '"') {
+            quoted = !quoted;
+        }
+        end++;
+    }
+    title[0] = '\0';
+    if (*end == ',') {
+        end++;
+        while (*end == ' ' || *end == '\t') {
+            end++;
+        }
+        copyUtf8(title, end, MAX_TITLE_LENGTH);
+    }
+}
+
+// Function to save the playlist as an extended M3U file; it is written in UTF-8, so it suits .m3u and .m3u8 alike
+int savePlaylistM3u(const Playlist* playlist, const char* path) {
+    // Relative song paths are relative to the working folder: write them out in full unless the
+    // playlist file goes in the working folder too, where they still resolve
+    char prefix[MAX_PATH_LENGTH] = "";
+    if (strchr(path, '/') != NULL) {
+        if (getcwd(prefix, sizeof(prefix) - 1) == NULL) {
+            prefix[0] = '\0';
+        } else {
+            strcat(prefix, "/");
+        }
+    }
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf(RED "Cannot write playlist file %s\n" RESET, path);
+        return 0;
+    }
+    fprintf(file, "#EXTM3U\n");
+    for (int i = 0; i < playlist->count; i++) {
+        Track track = trackAt(playlist, i);
+        const char* songPath = stringAt(&playlist->strings, track.pathId);
+        fprintf(file, "#EXTINF:%d,", track.length);
+        if (track.titleId >= 0) {
+            // One line per entry: line breaks inside a tag title become spaces
+            for (const char* c = stringAt(&playlist->strings, track.titleId); *c != '\0'; c++) {
+                fputc(*c == '\n' || *c == '\r' ? ' ' : *c, file);
+            }
+        }
+        fprintf(file, "\n%s%s\n", songPath[0] == '/' ? "" : prefix, songPath);
+    }
+    int ok = !ferror(file);
+    if (fclose(file) != 0 || !ok) {
+        printf(RED "Cannot write playlist file %s\n" RESET, path);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to append the songs of an M3U/M3U8 file, returning how many were added (-1 if it cannot be read)
+// Lengths and titles come from #EXTINF lines; songs without one are looked up in the library (if given)
+int loadPlaylistM3u(Playlist* playlist, LibraryIndex* library, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    // Relative entries are relative to the playlist file's folder
+    char folder[MAX_PATH_LENGTH] = "";
+    const char* slash = strrchr(path, '/');
+    if (slash != NULL) {
+        snprintf(folder, sizeof(folder), "%.*s", (int)(slash - path + 1), path);
+    }
+
+    char line[MAX_M3U_LINE];
+    char songPath[MAX_PATH_LENGTH];
+    char title[MAX_TITLE_LENGTH] = "";
+    int length = -1;       // From the #EXTINF line before the entry (-1 = none)
+    float gainDb = NAN;
+    int added = 0;
+    int firstLine = 1;
+    Mp3Info info;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t size = strlen(line);
+        if (size > 0 && line[size - 1] != '\n' && !feof(file)) {
+            // Longer than any path or title kept: skip the rest of the line and the entry it belongs to
+            int ch;
+            while ((ch = fgetc(file)) != EOF && ch != '\n') {
+            }
+            length = -1;
+            title[0] = '\0';
+            continue;
+        }
+        while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r')) {
+            line[--size] = '\0';
+        }
+        char* text = line;
+        if (firstLine && strncmp(text, "\xEF\xBB\xBF", 3) == 0) {
+            text += 3; // UTF-8 byte order mark, common in .m3u8 files
+        }
+        firstLine = 0;
+
+        if (strncmp(text, "#EXTINF:", 8) == 0) {
+            parseExtinf(text + 8, &length, title);
+            continue;
+        }
+        if (text[0] == '#' || text[0] == '\0') {
+            continue; // #EXTM3U, other directives and comments
+        }
+
+        int absolute = text[0] == '/' || strstr(text, "://") != NULL;
+        if (snprintf(songPath, sizeof(songPath), "%s%s", absolute ? "" : folder, text) >= (int)sizeof(songPath)) {
+            printf(RED "Skipped a song with a path longer than %d bytes.\n" RESET, MAX_PATH_LENGTH - 1);
+        } else {
+            if (length < 0) {
+                if (library != NULL && libraryLookup(library, songPath, &info)) {
+                    length = (int)(info.seconds + 0.5);
+                    gainDb = info.gainDb;
+                    if (title[0] == '\0') {
+                        strcpy(title, info.title);
+                    }
+                } else {
+                    length = 0;
+                }
+            }
+            appendTrack(playlist, songPath, title, length, gainDb);
+            added++;
+        }
+        length = -1;
+        gainDb = NAN;
+        title[0] = '\0';
+    }
+    fclose(file);
+    return added;
+}
+
+// Function to read a 1-based track number from the user, returning its position or -1 if out of range
+int readTrackNumber(const Playlist* playlist, const char* prompt) {
+    int number;
+    printf(BLUE "%s (1-%d): " RESET, prompt, playlist->count);
+    if (scanf("%d", &number) != 1 || number < 1 || number > playlist->count) {
+        scanf("%*[^\n]");
+        printf(RED "Invalid track number.\n" RESET);
+        return -1;
+    }
+    return number - 1;
+}
+
+// Function to add a song to the playlist; the length is read from the file when it is an MP3
+void addSong(Playlist* playlist, LibraryIndex* library) {
+    char songName[MAX_PATH_LENGTH];
+    int songLength;
+    Mp3Info info;
+
+    printf(BLUE "Enter song file path (e.g \"songs/song1.mp3\" to add song1.mp3 located in songs folder): " RESET);
+    scanf(" %1023[^\n]", songName);  // Read string with spaces
+    if (libraryLookup(library, songName, &info)) {
+        songLength = (int)(info.seconds + 0.5);
+    } else {
+        printf(BLUE "Enter song length (in seconds): " RESET);
+        scanf("%d", &songLength);     // Read song length
+        info.title[0] = '\0';
+        info.gainDb = NAN;
+    }
+
+    appendTrack(playlist, songName, info.title, songLength, info.gainDb);
+    printf(GREEN "%s added to the playlist (%d:%02d).\n" RESET, songName, songLength / 60, songLength % 60);
+}
+
+// Function to add every MP3 under a folder, sorted by path, with lengths and titles read by the library scanner
+void addFolder(Playlist* playlist, LibraryIndex* library) {
+    char folder[MAX_PATH_LENGTH];
+    printf(BLUE "Enter folder path (e.g \"songs\"): " RESET);
+    scanf(" %1023[^\n]", folder);
+
+    char* roots[1] = {folder};
+    LibraryScan scan;
+    double start = nowSeconds();
+    scanLibrary(library, roots, 1, defaultScanThreads(), &scan);
+    double elapsedMs = (nowSeconds() - start) * 1e3;
+
+    int added = 0;
+    for (int i = 0; i < scan.count; i++) {
+        if (scan.jobs[i].ok) {
+            const Mp3Info* info = &scan.jobs[i].info;
+            appendTrack(playlist, scan.jobs[i].path, info->title, (int)(info->seconds + 0.5), info->gainDb);
+            added++;
+        } else {
+            printf(RED "Skipped %s: no MPEG audio found.\n" RESET, scan.jobs[i].path);
+        }
+    }
+    printf(GREEN "Added %d songs from %s (%d unchanged since the last scan) in %.1f ms.\n" RESET, added, folder,
+           scan.cachedCount, elapsedMs);
+    freeLibraryScan(&scan);
+}
+
+// Function to save the playlist to an M3U/M3U8 file named by the user
+void savePlaylist(Playlist* playlist) {
+    char path[MAX_PATH_LENGTH];
+    printf(BLUE "Enter playlist file path (e.g \"mix.m3u8\"): " RESET);
+    scanf(" %1023[^\n]", path);
+    if (savePlaylistM3u(playlist, path)) {
+        printf(GREEN "Saved %d songs to %s.\n" RESET, playlist->count, path);
+    }
+}
+
+// Function to add the songs of an M3U/M3U8 file named by the user to the end of the playlist
+void loadPlaylist(Playlist* playlist, LibraryIndex* library) {
+    char path[MAX_PATH_LENGTH];
+    printf(BLUE "Enter playlist file path (e.g \"mix.m3u8\"): " RESET);
+    scanf(" %1023[^\n]", path);
+    int added = loadPlaylistM3u(playlist, library, path);
+    if (added < 0) {
+        printf(RED "Cannot read playlist file %s\n" RESET, path);
+    } else {
+        printf(GREEN "Added %d songs from %s.\n" RESET, added, path);
+    }
+}
+
+// Function to display the playlist
+void displayPlaylist(Playlist* playlist) {
+    if (playlist->count == 0) {
+        printf(YELLOW "The playlist is empty.\n" RESET);
+        return;
+    }
+    pthread_mutex_lock(&playlist->lock);
+    int current = playlist->playing ? playlist->current : -1;
+    pthread_mutex_unlock(&playlist->lock);
+
+    ReportOutput* out = reportBegin();
+    reportStyle(out, BOLD CYAN);
+    reportText(out, "***Playlist***\n");
+    for (int i = 0; i < playlist->count; i++) {
+        Track track = trackAt(playlist, i);
+        reportStyle(out, i == current ? BOLD CYAN : GREEN);
+        reportInt(out, i + 1, 0);
+        reportText(out, ". Song: ");
+        reportText(out, stringAt(&playlist->strings, track.pathId));
+        if (track.titleId >= 0) {
+            reportText(out, " - ");
+            reportText(out, stringAt(&playlist->strings, track.titleId));
+        }
+        reportText(out, ", Length: ");
+        reportInt(out, track.length, 0);
+        reportText(out, i == current ? " seconds (now playing)\n" : " seconds\n");
+    }
+    reportEnd(out);
+}
+
+// Function to move a song to another position in the playlist
+void moveSong(Playlist* playlist) {
+    if (playlist->count < 2) {
+        printf(YELLOW "Add at least two songs to reorder the playlist.\n" RESET);
+        return;
+    }
+    int from = readTrackNumber(playlist, "Enter the number of the song to move");
+    if (from < 0) {
+        return;
+    }
+    int to = readTrackNumber(playlist, "Enter its new position");
+    if (to < 0) {
+        return;
+    }
+    moveTrack(playlist, from, to);
+    printf(GREEN "Moved song %d to position %d.\n" RESET, from + 1, to + 1);
+}
+
+// Function to remove a song from the playlist
+void removeSong(Playlist* playlist) {
+    if (playlist->count == 0) {
+        printf(YELLOW "The playlist is empty.\n" RESET);
+        return;
+    }
+    int position = readTrackNumber(playlist, "Enter the number of the song to remove");
+    if (position < 0) {
+        return;
+    }
+    printf(GREEN "%s removed from the playlist.\n" RESET,
+           stringAt(&playlist->strings, trackAt(playlist, position).pathId));
+    removeTrack(playlist, position);
+}
+
+// Function to jump to a song in the playlist
+void jumpToSong(Playlist* playlist) {
+    if (playlist->count == 0) {
+        printf(YELLOW "The playlist is empty.\n" RESET);
+        return;
+    }
+    int position = readTrackNumber(playlist, "Enter the number of the song to jump to");
+    if (position < 0) {
+        return;
+    }
+    if (jumpToTrack(playlist, position)) {
+        printf(GREEN "Jumping to song %d.\n" RESET, position + 1);
+    } else {
+        printf(GREEN "Playback will start from song %d.\n" RESET, position + 1);
+    }
+}
+
+// Function to scale 16-bit samples by a gain, rounding and saturating (portable version)
+void scaleSamplesScalar(Sint16* out, const Sint16* in, int count, float gain) {
+    for (int i = 0; i < count; i++) {
+        long v = lrintf(in[i] * gain);
+        out[i] = (Sint16)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+}
+
+// Function to mix two 16-bit sample streams, each with its own gain, rounding and saturating (portable version)
+void mixSamplesScalar(Sint16* out, const Sint16* a, float gainA, const Sint16* b, float gainB, int count) {
+    for (int i = 0; i < count; i++) {
+        long v = lrintf(a[i] * gainA + b[i] * gainB);
+        out[i] = (Sint16)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+}
+
+// Function to add up the squares of 16-bit samples and track their largest magnitude (portable version)
+float sumSquaresScalar(const Sint16* samples, int count, int* peak) {
+    float sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += (float)samples[i] * samples[i];
+        int magnitude = samples[i] < 0 ? -samples[i] : samples[i];
+        if (magnitude > *peak) {
+            *peak = magnitude;
+        }
+    }
+    return sum;
+}
+
+#if defined(__SSE2__)
+// Function to widen eight 16-bit samples to two vectors of four floats
+void widenSamples(__m128i samples, __m128* low, __m128* high) {
+    *low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+    *high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+}
+
+// Function to round two vectors of floats back to eight saturated 16-bit samples
+__m128i narrowSamples(__m128 low, __m128 high) {
+    return _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+}
+
+// Function to scale 16-bit samples by a gain, eight at a time (SSE2); same results as the scalar loop
+void scaleSamples(Sint16* out, const Sint16* in, int count, float gain) {
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 low, high;
+        widenSamples(_mm_loadu_si128((const __m128i*)(in + i)), &low, &high);
+        _mm_storeu_si128((__m128i*)(out + i), narrowSamples(_mm_mul_ps(low, g), _mm_mul_ps(high, g)));
+    }
+    scaleSamplesScalar(out + i, in + i, count - i, gain);
+}
+
+// Function to mix two 16-bit sample streams with a gain each, eight samples at a time (SSE2)
+void mixSamples(Sint16* out, const Sint16* a, float gainA, const Sint16* b, float gainB, int count) {
+    __m128 ga = _mm_set1_ps(gainA);
+    __m128 gb = _mm_set1_ps(gainB);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 aLow, aHigh, bLow, bHigh;
+        widenSamples(_mm_loadu_si128((const __m128i*)(a + i)), &aLow, &aHigh);
+        widenSamples(_mm_loadu_si128((const __m128i*)(b + i)), &bLow, &bHigh);
+        __m128 low = _mm_add_ps(_mm_mul_ps(aLow, ga), _mm_mul_ps(bLow, gb));
+        __m128 high = _mm_add_ps(_mm_mul_ps(aHigh, ga), _mm_mul_ps(bHigh, gb));
+        _mm_storeu_si128((__m128i*)(out + i), narrowSamples(low, high));
+    }
+    mixSamplesScalar(out + i, a + i, gainA, b + i, gainB, count - i);
+}
+
+// Function to add up the squares of 16-bit samples and track their largest magnitude, eight at a time (SSE2)
+float sumSquares(const Sint16* samples, int count, int* peak) {
+    __m128 sum = _mm_setzero_ps();
+    __m128i largest = _mm_setzero_si128();
+    __m128i smallest = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128 low, high;
+        widenSamples(v, &low, &high);
+        sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(low, low), _mm_mul_ps(high, high)));
+        largest = _mm_max_epi16(largest, v);
+        smallest = _mm_min_epi16(smallest, v);
+    }
+    float lanes[4];
+    Sint16 highs[8], lows[8];
+    _mm_storeu_ps(lanes, sum);
+    _mm_storeu_si128((__m128i*)highs, largest);
+    _mm_storeu_si128((__m128i*)lows, smallest);
+    for (int lane = 0; lane < 8; lane++) {
+        if (highs[lane] > *peak) {
+            *peak = highs[lane];
+        }
+        if (-lows[lane] > *peak) {
+            *peak = -lows[lane];
+        }
+    }
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumSquaresScalar(samples + i, count - i, peak);
+}
+#else
+void scaleSamples(Sint16* out, const Sint16* in, int count, float gain) {
+    scaleSamplesScalar(out, in, count, gain);
+}
+
+void mixSamples(Sint16* out, const Sint16* a, float gainA, const Sint16* b, float gainB, int count) {
+    mixSamplesScalar(out, a, gainA, b, gainB, count);
+}
+
+float sumSquares(const Sint16* samples, int count, int* peak) {
+    return sumSquaresScalar(samples, count, peak);
+}
+#endif
+
+// Function to work out the linear gain that levels a decoded track, ReplayGain-style
+// Loudness is the 95th percentile of 50 ms RMS levels, ReplayGain's statistic without its equal-loudness filter.
+// A gain from the file's tags is used instead when there is one; either way the gain is capped so the peak cannot clip
+float levelingGain(const Sint16* samples, size_t count, int channels, int frequency, float tagGainDb) {
+    int blockSamples = frequency * channels * LOUDNESS_BLOCK_MS / 1000;
+    int histogram[1000] = {0};  // Block levels from -100 to 0 dBFS in 0.1 dB steps
+    int blocks = 0;
+    int peak = 0;
+    for (size_t start = 0; start < count; start += blockSamples) {
+        int n = count - start < (size_t)blockSamples ? (int)(count - start) : blockSamples;
+        float meanSquare = sumSquares(samples + start, n, &peak) / n;
+        float level = 10.0f * log10f(meanSquare / (32768.0f * 32768.0f) + 1e-10f);
+        int bin = (int)((level + 100.0f) * 10.0f);
+        histogram[bin < 0 ? 0 : bin > 999 ? 999 : bin]++;
+        blocks++;
+    }
+    if (blocks == 0) {
+        return 1.0f;
+    }
+
+    float gainDb = tagGainDb;
+    if (isnan(gainDb)) {
+        int louder = 0;
+        int bin = 999;
+        while (bin > 0 && (louder += histogram[bin]) < blocks / 20 + 1) {
+            bin--;
+        }
+        gainDb = LEVELING_TARGET_DBFS - (bin / 10.0f - 100.0f);
+    }
+    gainDb = gainDb < MIN_LEVELING_DB ? MIN_LEVELING_DB : gainDb > MAX_LEVELING_DB ? MAX_LEVELING_DB : gainDb;
+    float gain = powf(10.0f, gainDb / 20.0f);
+    if (peak > 0 && gain * peak > 32767.0f) {
+        gain = 32767.0f / peak;
+    }
+    return gain;
+}
+
+// Function to evaluate sin(x * pi / 2) for x in 0..1 without the C library (runs on the audio thread)
+// Crossfading with it on the way in and 1 - x on the way out keeps the summed power constant
+float quarterSine(float x) {
+    float a = x * 1.5707963f;
+    float a2 = a * a;
+    return a * (1.0f - a2 / 6.0f * (1.0f - a2 / 20.0f * (1.0f - a2 / 42.0f)));
+}
+
+// Function to give the callback's gain for a track: its leveling gain, or 1 with leveling off
+float trackGain(Player* player, const DecodedTrack* track) {
+    return atomic_load(&player->leveling) ? track->gain : 1.0f;
+}
+
+// Function to copy bytes of a decoded track into the device buffer at a gain
+void copyTrack(Uint8* stream, const DecodedTrack* track, Uint32 offset, Uint32 n, float gain) {
+    if (gain == 1.0f) {
+        memcpy(stream, track->chunk->abuf + offset, n);
+    } else {
+        scaleSamples((Sint16*)stream, (const Sint16*)(track->chunk->abuf + offset), (int)(n / 2), gain);
+    }
+}
+
+// Function to hand the playing track to the worker for release and carry on with the one fading in (if any)
+void retirePlaying(Player* player) {
+    unsigned int tail = atomic_load(&player->retiredTail);
+    player->retired[tail % RETIRED_SLOTS] = player->playing;
+    atomic_store(&player->retiredTail, tail + 1);
+    player->playing = player->incoming;
+    player->playedBytes = player->incomingBytes;
+    player->incoming = NULL;
+    sem_post(&player->events);
+}
+
+// Function to start fading the next track in over the last `left` bytes of the playing one
+// Returns 0 if the next track is not decoded yet, is too short, or could not be retired afterwards
+int startCrossfade(Player* player, Uint32 left) {
+    // Both the outgoing and the incoming track need room in the retire ring
+    if (atomic_load(&player->retiredTail) - atomic_load(&player->retiredHead) >= RETIRED_SLOTS - 1) {
+        return 0;
+    }
+    DecodedTrack* next = atomic_load(&player->next);
+    if (next == NULL || next->chunk->alen < left || !atomic_compare_exchange_strong(&player->next, &next, NULL)) {
+        return 0; // The worker may take `next` back at any time, hence the compare-exchange
+    }
+    player->incoming = next;
+    player->incomingBytes = 0;
+    player->fadeBytes = left;
+    atomic_store(&player->handoverGapBytes, -(long)left); // Negative: overlapped instead of a gap
+    atomic_fetch_add(&player->tracksStarted, 1);
+    sem_post(&player->events);
+    return 1;
+}
+
+// Function to fill the audio device buffer from decoded tracks, moving on to the next track mid-buffer
+// With a crossfade set, the next track fades in (equal power) over the end of the playing one.
+// Runs on SDL's audio thread: no locks, no allocation; the playback worker frees what it retires
+void feedAudio(void* udata, Uint8* stream, int len) {
+    Player* player = (Player*)udata;
+    if (atomic_load(&player->paused)) {
+        memset(stream, 0, len);
+        return;
+    }
+    if (player->playing != NULL && atomic_load(&player->seekBytes) >= 0) {
+        if (player->incoming != NULL) {
+            retirePlaying(player); // Finish the crossfade: the seek is meant for the track fading in
+        }
+        long seek = atomic_exchange(&player->seekBytes, -1);
+        Uint32 length = player->playing->chunk->alen;
+        player->playedBytes = seek < (long)length ? (Uint32)seek : length;
+    }
+    Uint32 crossfade = player->mixable ? (Uint32)atomic_load(&player->crossfadeBytes) : 0;
+    Uint32 fadeStep = FADE_STEP_FRAMES * player->bytesPerFrame;
+    while (len > 0) {
+        if (player->playing == NULL) {
+            // Take the next track only if there is room to retire it later
+            DecodedTrack* next = NULL;
+            if (atomic_load(&player->retiredTail) - atomic_load(&player->retiredHead) < RETIRED_SLOTS) {
+                next = atomic_exchange(&player->next, NULL);
+            }
+            if (next == NULL) {
+                memset(stream, 0, len); // Underrun: the next track is still decoding
+                atomic_fetch_add(&player->silentBytes, len);
+                return;
+            }
+            player->playing = next;
+            player->playedBytes = 0;
+            atomic_store(&player->handoverGapBytes, atomic_exchange(&player->silentBytes, 0));
+            atomic_fetch_add(&player->tracksStarted, 1);
+            sem_post(&player->events);
+        }
+
+        Uint32 length = player->playing->chunk->alen;
+        Uint32 left = length - player->playedBytes;
+        Uint32 n = left < (Uint32)len ? left : (Uint32)len;
+        if (player->incoming != NULL) {
+            // Mix a short step of both tracks at the gains for this point of the fade
+            n = n < fadeStep ? n : fadeStep;
+            float progress = 1.0f - (float)left / player->fadeBytes;
+            mixSamples((Sint16*)stream, (const Sint16*)(player->playing->chunk->abuf + player->playedBytes),
+                       quarterSine(1.0f - progress) * trackGain(player, player->playing),
+                       (const Sint16*)(player->incoming->chunk->abuf + player->incomingBytes),
+                       quarterSine(progress) * trackGain(player, player->incoming), (int)(n / 2));
+            player->incomingBytes += n;
+        } else {
+            // A fade never takes more than half of a track
+            Uint32 half = length / 2 / player->bytesPerFrame * player->bytesPerFrame;
+            Uint32 window = crossfade < half ? crossfade : half;
+            if (window > 0 && left <= window && startCrossfade(player, left)) {
+                continue;
+            }
+            if (window > 0 && left > window && left - window < n) {
+                n = left - window; // Stop where the fade should begin
+            }
+            copyTrack(stream, player->playing, player->playedBytes, n, trackGain(player, player->playing));
+        }
+        player->playedBytes += n;
+        stream += n;
+        len -= (int)n;
 
-/*
-Usage Instructions
-Install Required Libraries: SDL2 and SDL_mixer
+        if (player->playedBytes == length) {
+            retirePlaying(player);
+        }
+    }
+}
 
-sudo apt-get update
-sudo apt-get install libsdl2-dev libsdl2-mixer-dev
+// Function to set up an empty audio cache with a memory budget in bytes
+void initChunkCache(ChunkCache* cache, size_t budget) {
+    memset(cache, 0, sizeof(ChunkCache));
+    cache->capacity = INITIAL_PLAYLIST_CAPACITY;
+    cache->entries = (DecodedTrack**)checkedAlloc(malloc(cache->capacity * sizeof(DecodedTrack*)));
+    cache->budget = budget;
+}
 
+// Function to free a decoded track
+void freeDecodedTrack(DecodedTrack* track) {
+    Mix_FreeChunk(track->chunk);
+    free(track);
+}
 
-Compile the Program:
-gcc music_playlist_manager.c -o music_playlist_manager -lSDL2 -lSDL2_mixer -lpthread
+// Function to free every cached track (once the audio callback is detached)
+void freeChunkCache(ChunkCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        freeDecodedTrack(cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache->failedPaths);
+}
 
-Run the Program:
-./music_playlist_manager
+// Function to find the cache entry for a song, or -1
+int findCacheEntry(const ChunkCache* cache, int pathId) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i]->pathId == pathId) {
+            return i;
+        }
+    }
+    return -1;
+}
 
+// Function to check whether a song is known not to decode
+int decodeFailed(const ChunkCache* cache, int pathId) {
+    for (int i = 0; i < cache->failedCount; i++) {
+        if (cache->failedPaths[i] == pathId) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-*/
+// Function to remember whether a song decoded, so a broken file is not decoded ahead again and again
+void setDecodeFailed(ChunkCache* cache, int pathId, int failed) {
+    for (int i = 0; i < cache->failedCount; i++) {
+        if (cache->failedPaths[i] == pathId) {
+            if (!failed) {
+                cache->failedPaths[i] = cache->failedPaths[--cache->failedCount];
+            }
+            return;
+        }
+    }
+    if (!failed) {
+        return;
+    }
+    if (cache->failedCount == cache->failedCapacity) {
+        cache->failedCapacity = cache->failedCapacity > 0 ? cache->failedCapacity * 2 : INITIAL_PLAYLIST_CAPACITY;
+        cache->failedPaths = (int*)checkedAlloc(realloc(cache->failedPaths, cache->failedCapacity * sizeof(int)));
+    }
+    cache->failedPaths[cache->failedCount++] = pathId;
+}
+
+// Function to free unused tracks, least recently used first, until the cache is within its budget
+void evictTracks(ChunkCache* cache) {
+    while (cache->bytes > cache->budget) {
+        int oldest = -1;
+        for (int i = 0; i < cache->count; i++) {
+            if (cache->entries[i]->users == 0 &&
+                (oldest < 0 || cache->entries[i]->lastUse < cache->entries[oldest]->lastUse)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            return; // Everything left is queued or playing
+        }
+        cache->bytes -= cache->entries[oldest]->chunk->alen;
+        freeDecodedTrack(cache->entries[oldest]);
+        cache->entries[oldest] = cache->entries[--cache->count];
+        cache->evictions++;
+    }
+}
 
+// Function to take a cached track for playback, returning NULL if it is not cached
+DecodedTrack* acquireTrack(ChunkCache* cache, int pathId) {
+    int i = findCacheEntry(cache, pathId);
+    if (i < 0) {
+        return NULL;
+    }
+    cache->entries[i]->users++;
+    cache->entries[i]->lastUse = ++cache->clock;
+    return cache->entries[i];
+}
 
+// Function to add a freshly decoded track with its first users, making room by evicting older unused ones
+void storeTrack(ChunkCache* cache, DecodedTrack* track, int users) {
+    if (cache->count == cache->capacity) {
+        cache->capacity *= 2;
+        cache->entries = (DecodedTrack**)checkedAlloc(realloc(cache->entries, cache->capacity * sizeof(DecodedTrack*)));
+    }
+    cache->entries[cache->count++] = track;
+    track->users = users;
+    track->lastUse = ++cache->clock;
+    cache->bytes += track->chunk->alen;
+    evictTracks(cache);
+}
 
-// Structure for a Song node
-struct Song {
-    char name[100];        // Name of the song file
-    int length;           // Length of the song in seconds
-    struct Song* next;     // Pointer to the next song in the list
-};
+// Function to give back a track taken with acquireTrack or stored with users; it stays cached while the budget allows
+void releaseTrack(ChunkCache* cache, DecodedTrack* track) {
+    track->users--;
+    evictTracks(cache);
+}
 
-// Global variable for controlling playback
-volatile int isPlaying = 0; // Flag to indicate if playback is ongoing
+// Function to print the audio cache statistics
+void printCacheStats(const ChunkCache* cache) {
+    long starts = cache->hits + cache->misses;
+    printf(BOLD "Audio cache: %d songs, %.1f of %.1f MB\n" RESET, cache->count, cache->bytes / 1048576.0,
+           cache->budget / 1048576.0);
+    printf("Hits: %ld, misses: %ld (%.0f%% hit rate), filled ahead: %ld, evicted: %ld\n", cache->hits, cache->misses,
+           starts > 0 ? 100.0 * cache->hits / starts : 0.0, cache->filledAhead, cache->evictions);
+}
 
-// Function to create a new song node
-struct Song* createSong(const char* name, int length) {
-    struct Song* newSong = (struct Song*)malloc(sizeof(struct Song));
-    if (newSong == NULL) {
-        printf(RED "Memory allocation failed!\n" RESET);
-        exit(1);
+// Function to decode requested tracks in the background (loader thread)
+void* loadTracks(void* arg) {
+    Player* player = (Player*)arg;
+    char path[MAX_PATH_LENGTH];
+    pthread_mutex_lock(&player->loaderLock);
+    for (;;) {
+        while (!player->loaderExit && player->pendingRequest == 0) {
+            pthread_cond_wait(&player->loaderWake, &player->loaderLock);
+        }
+        if (player->loaderExit) {
+            break;
+        }
+        unsigned int request = player->pendingRequest;
+        player->pendingRequest = 0;
+        strcpy(path, player->pendingPath);
+        float gainDb = player->pendingGainDb;
+        pthread_mutex_unlock(&player->loaderLock);
+
+        // Open, parse and decode the whole file into the device format while the current track plays,
+        // then work out its leveling gain here too so the audio callback only has to apply it
+        DecodedTrack* track = NULL;
+        OP_STATS_START(decodeTimer);
+        Mix_Chunk* chunk = Mix_LoadWAV(path);
+        OP_STATS_STOP(OP_DECODE_TRACK, decodeTimer);
+        if (chunk == NULL) {
+            printf(RED "Failed to load music file: %s. SDL_mixer Error: %s\n" RESET, path, Mix_GetError());
+        } else {
+            track = (DecodedTrack*)checkedAlloc(malloc(sizeof(DecodedTrack)));
+            track->chunk = chunk;
+            OP_STATS_START(loudnessTimer);
+            track->gain = player->mixable ? levelingGain((const Sint16*)chunk->abuf, chunk->alen / 2, player->channels,
+                                                         player->frequency, gainDb)
+                                          : 1.0f;
+            OP_STATS_STOP(OP_ANALYZE_LOUDNESS, loudnessTimer);
+        }
+
+        pthread_mutex_lock(&player->loaderLock);
+        player->loadedTrack = track;
+        player->loadedRequest = request;
+        player->loadDone = 1;
+        sem_post(&player->events);
     }
-    strcpy(newSong->name, name);
-    newSong->length = length; // Assign the length
-    newSong->next = NULL;
-    return newSong;
+    pthread_mutex_unlock(&player->loaderLock);
+    return NULL;
 }
 
-// Function to add a song to the playlist
-void addSong(struct Song** head) {
-    char songName[100];
-    int songLength;
+// Function to set up a player for a playlist, caching up to cacheBudget bytes of decoded audio
+void initPlayer(Player* player, Playlist* playlist, size_t cacheBudget) {
+    memset(player, 0, sizeof(Player));
+    player->playlist = playlist;
+    initChunkCache(&player->cache, cacheBudget);
+    atomic_init(&player->next, NULL);
+    atomic_init(&player->retiredHead, 0);
+    atomic_init(&player->retiredTail, 0);
+    atomic_init(&player->tracksStarted, 0);
+    atomic_init(&player->silentBytes, 0);
+    atomic_init(&player->handoverGapBytes, 0);
+    atomic_init(&player->paused, 0);
+    atomic_init(&player->seekBytes, -1);
+    atomic_init(&player->crossfadeBytes, 0);
+    atomic_init(&player->leveling, 1);
+    atomic_init(&player->commandHead, 0);
+    atomic_init(&player->commandTail, 0);
+    player->state = PLAYER_STOPPED;
+    sem_init(&player->events, 0, 0);
+    sem_init(&player->commandsDone, 0, 0);
+    pthread_mutex_init(&player->loaderLock, NULL);
+    pthread_cond_init(&player->loaderWake, NULL);
 
-    printf(BLUE "Enter song file path (e.g \"songs/song1.mp3\" to add song1.mp3 located in songs folder): " RESET);
-    scanf(" %[^\n]", songName);  // Read string with spaces
-    printf(BLUE "Enter song length (in seconds): " RESET);
-    scanf("%d", &songLength);     // Read song length
+    Uint16 format;
+    Mix_QuerySpec(&player->frequency, &format, &player->channels);
+    player->bytesPerFrame = player->channels * (SDL_AUDIO_BITSIZE(format) / 8);
+    player->bytesPerSecond = (double)player->frequency * player->bytesPerFrame;
+    player->mixable = format == AUDIO_S16SYS;
+}
+
+// Function to set the overlap between songs, in whole frames; 0 plays them back to back
+void setCrossfade(Player* player, double seconds) {
+    atomic_store(&player->crossfadeBytes, (int)(seconds * player->frequency) * player->bytesPerFrame);
+}
+
+// Function to release a player's synchronization objects
+void freePlayer(Player* player) {
+    sem_destroy(&player->events);
+    sem_destroy(&player->commandsDone);
+    pthread_mutex_destroy(&player->loaderLock);
+    pthread_cond_destroy(&player->loaderWake);
+    freeChunkCache(&player->cache);
+}
 
-    struct Song* newSong = createSong(songName, songLength);
-    if (*head == NULL) {
-        *head = newSong;
+// Function to fill a prefetch slot with the track at a position: straight from the cache, or by asking the
+// loader thread to decode it. Slot -1 decodes the track into the cache only (filling ahead)
+void requestTrack(Player* player, int slot, int position) {
+    Playlist* playlist = player->playlist;
+    int pathId = playlist->tracks[position].pathId;
+    unsigned int request = ++player->requestSerial;
+    if (slot >= 0) {
+        PrefetchSlot* target = &player->slots[slot];
+        target->pathId = pathId;
+        target->track = acquireTrack(&player->cache, pathId);
+        if (target->track != NULL) {
+            target->state = SLOT_LOADED;
+            player->cache.hits++;
+            return;
+        }
+        target->state = SLOT_LOADING;
+        target->request = request;
+        player->cache.misses++;
     } else {
-        struct Song* temp = *head;
-        while (temp->next != NULL) {
-            temp = temp->next;
+        player->cache.filledAhead++;
+    }
+    player->loadingPathId = pathId;
+    player->loaderBusy = 1;
+
+    pthread_mutex_lock(&player->loaderLock);
+    strcpy(player->pendingPath, stringAt(&playlist->strings, pathId));
+    player->pendingGainDb = playlist->tracks[position].gainDb;
+    player->pendingRequest = request;
+    pthread_cond_signal(&player->loaderWake);
+    pthread_mutex_unlock(&player->loaderLock);
+}
+
+// Function to take a finished load from the loader thread and file it under the slot that asked for it
+void collectLoad(Player* player) {
+    pthread_mutex_lock(&player->loaderLock);
+    int done = player->loadDone;
+    DecodedTrack* track = player->loadedTrack;
+    unsigned int request = player->loadedRequest;
+    player->loadDone = 0;
+    player->loadedTrack = NULL;
+    pthread_mutex_unlock(&player->loaderLock);
+    if (!done) {
+        return;
+    }
+    player->loaderBusy = 0;
+    int users = 0;
+    for (int i = 0; i < PREFETCH_SLOTS; i++) {
+        if (player->slots[i].state == SLOT_LOADING && player->slots[i].request == request) {
+            player->slots[i].state = track != NULL ? SLOT_LOADED : SLOT_FAILED;
+            player->slots[i].track = track;
+            users = 1;
+            break;
+        }
+    }
+    // Kept even when its slot was dropped while it decoded, or when it was decoded ahead for no slot
+    setDecodeFailed(&player->cache, player->loadingPathId, track == NULL);
+    if (track != NULL) {
+        track->pathId = player->loadingPathId;
+        storeTrack(&player->cache, track, users);
+    }
+}
+
+// Function to empty a prefetch slot; returns 0 if its track has already reached the audio callback
+int dropSlot(Player* player, int slot) {
+    PrefetchSlot* target = &player->slots[slot];
+    if (target->state == SLOT_QUEUED) {
+        DecodedTrack* track = atomic_exchange(&player->next, NULL);
+        if (track == NULL) {
+            return 0;
         }
-        temp->next = newSong;
-        
+        releaseTrack(&player->cache, track);
+    } else if (target->state == SLOT_LOADED) {
+        releaseTrack(&player->cache, target->track);
     }
-        printf(GREEN "%s added to the playlist.\n" RESET, songName);
-    
+    target->state = SLOT_EMPTY;
+    target->track = NULL;
+    return 1;
 }
 
+// Function to move the prefetch slots on by one track after the current one ends
+void shiftSlots(Player* player) {
+    player->slots[0] = player->slots[1];
+    player->slots[1].state = SLOT_EMPTY;
+    player->slots[1].track = NULL;
+}
 
-// Function to display the playlist
-void displayPlaylist(struct Song* head) {
-    if (head == NULL) {
-        printf(YELLOW "The playlist is empty.\n" RESET);
-        return;
+// Function to release the tracks the audio callback has finished with, returning how many tracks ended
+int collectRetired(Player* player) {
+    int ended = 0;
+    unsigned int head = atomic_load(&player->retiredHead);
+    while (head != atomic_load(&player->retiredTail)) {
+        releaseTrack(&player->cache, player->retired[head % RETIRED_SLOTS]);
+        head++;
+        atomic_store(&player->retiredHead, head);
+        ended++;
+    }
+    player->endedTracks += ended;
+    return ended;
+}
+
+// Function to detach the audio callback and release every decoded track to the cache; reattaches it if
+// `reattach` is set
+void resetAudio(Player* player, int reattach) {
+    Mix_HookMusic(NULL, NULL); // Returns once the callback has stopped running
+    if (player->playing != NULL) {
+        releaseTrack(&player->cache, player->playing);
+        player->playing = NULL;
     }
-    struct Song* temp = head;
-    printf(BOLD CYAN "***Playlist***\n" RESET);
-    while (temp != NULL) {
-        printf(GREEN "Song: %s, Length: %d seconds\n" RESET, temp->name, temp->length);
-        temp = temp->next;
+    if (player->incoming != NULL) {
+        releaseTrack(&player->cache, player->incoming);
+        player->incoming = NULL;
+    }
+    DecodedTrack* next = atomic_exchange(&player->next, NULL);
+    if (next != NULL) {
+        releaseTrack(&player->cache, next);
+    }
+    collectRetired(player);
+    for (int i = 0; i < PREFETCH_SLOTS; i++) {
+        if (player->slots[i].state == SLOT_LOADED) {
+            releaseTrack(&player->cache, player->slots[i].track);
+        }
+        player->slots[i].state = SLOT_EMPTY; // A slot still loading is cached when its load comes back
+        player->slots[i].track = NULL;
+    }
+    player->endedTracks = atomic_load(&player->tracksStarted); // Nothing is playing any more
+    atomic_store(&player->silentBytes, 0);
+    player->afterReset = 1;
+    if (reattach) {
+        Mix_HookMusic(feedAudio, player);
     }
 }
 
-// Function to play songs from the playlist
-void* playSongs(void* arg) {
-    struct Song* head = (struct Song*)arg;
-    if (head == NULL) {
-        printf(RED "The playlist is empty. Cannot play songs.\n" RESET);
-        return NULL;
+// Function to hand decoded tracks to the audio callback and keep the loader busy with the next one
+void pumpPlayer(Player* player) {
+    Playlist* playlist = player->playlist;
+
+    // Fill the slots in order; cached tracks need no loader, so they can fill while it is busy
+    for (int i = 0; i < PREFETCH_SLOTS && playlist->current + i < playlist->count; i++) {
+        if (player->slots[i].state == SLOT_EMPTY) {
+            int pathId = playlist->tracks[playlist->current + i].pathId;
+            if (player->loaderBusy && findCacheEntry(&player->cache, pathId) < 0) {
+                break;
+            }
+            requestTrack(player, i, playlist->current + i);
+        }
     }
 
-    struct Song* temp = head;
-    // printf(BOLD "Playing songs" RESET);
+    // The callback holds one track and the `next` slot one more; slot 0 in `next` blocks slot 1
+    if (atomic_load(&player->next) == NULL) {
+        int slot = player->slots[0].state == SLOT_LOADED ? 0
+                   : player->slots[0].state == SLOT_QUEUED && player->slots[1].state == SLOT_LOADED ? 1 : -1;
+        if (slot >= 0) {
+            atomic_store(&player->next, player->slots[slot].track);
+            player->slots[slot].state = SLOT_QUEUED;
+            player->slots[slot].track = NULL;
+        }
+    }
 
-    while (temp != NULL) {
-        // Load and play the song
-        Mix_Music* music = Mix_LoadMUS(temp->name);
-        if (music == NULL) {
-            printf(RED "Failed to load music file: %s. SDL_mixer Error: %s\n" RESET, temp->name, Mix_GetError());
-        } else {
-            isPlaying = 1; // Set the flag indicating playback
-            printf(BOLD CYAN "\nNow playing: %s\n" RESET, temp->name); // Display current song
-            Mix_PlayMusic(music, 1); // Play the music once
-            
-            // Wait until the music finishes or is interrupted
-            while (Mix_PlayingMusic()) {
-                SDL_Delay(100); // Wait until the music finishes
-                if (!isPlaying) { // Check if the user wants to stop
-                    Mix_HaltMusic(); // Stop the music
-                    break;
+    // With the slots filled, decode the next few tracks into the cache while the budget has room for them
+    for (int i = PREFETCH_SLOTS; !player->loaderBusy && i < PREFETCH_SLOTS + CACHE_LOOKAHEAD &&
+                                 playlist->current + i < playlist->count; i++) {
+        Track track = playlist->tracks[playlist->current + i];
+        if (findCacheEntry(&player->cache, track.pathId) >= 0 || decodeFailed(&player->cache, track.pathId)) {
+            continue;
+        }
+        double seconds = track.length > 0 ? track.length : ASSUMED_TRACK_SECONDS;
+        if (player->cache.bytes + seconds * player->bytesPerSecond > player->cache.budget) {
+            break;
+        }
+        requestTrack(player, -1, playlist->current + i);
+    }
+}
+
+// Function to check that the prefetched tracks still match the playlist after an edit, dropping those that do not
+void checkSlots(Player* player) {
+    Playlist* playlist = player->playlist;
+    for (int i = PREFETCH_SLOTS - 1; i >= 0; i--) {
+        PrefetchSlot* slot = &player->slots[i];
+        int position = playlist->current + i;
+        if (slot->state == SLOT_EMPTY ||
+            (position < playlist->count && slot->pathId == playlist->tracks[position].pathId)) {
+            continue;
+        }
+        if (i == 0 || !dropSlot(player, i)) {
+            resetAudio(player, 1); // The wrong track is already playing
+            return;
+        }
+    }
+}
+
+// Function to queue a playback command and wake the worker (menu thread only)
+void sendCommand(Player* player, CommandType type, double seconds) {
+    unsigned int tail = atomic_load(&player->commandTail);
+    while (tail - atomic_load(&player->commandHead) == COMMAND_SLOTS) {
+        sched_yield(); // Ring full: the worker drains it within microseconds
+    }
+    player->commands[tail % COMMAND_SLOTS].type = type;
+    player->commands[tail % COMMAND_SLOTS].seconds = seconds;
+    atomic_store(&player->commandTail, tail + 1);
+    sem_post(&player->events);
+}
+
+// Function to send a command and wait until the worker has carried it out, so its messages come before the next prompt
+void sendCommandAndWait(Player* player, CommandType type, double seconds) {
+    sendCommand(player, type, seconds);
+    while (sem_wait(&player->commandsDone) != 0 && errno == EINTR) {
+    }
+}
+
+// Function to take the next queued command (worker only); returns 0 when none is queued
+int nextCommand(Player* player, Command* command) {
+    unsigned int head = atomic_load(&player->commandHead);
+    if (head == atomic_load(&player->commandTail)) {
+        return 0;
+    }
+    *command = player->commands[head % COMMAND_SLOTS];
+    atomic_store(&player->commandHead, head + 1);
+    return 1;
+}
+
+// Function to change the worker state, mirroring it into the playlist and the audio callback
+void setPlayerState(Player* player, PlayerState state) {
+    player->state = state;
+    player->playlist->playing = state != PLAYER_STOPPED;
+    atomic_store(&player->paused, state == PLAYER_PAUSED);
+}
+
+// Function to carry out one command (worker, playlist lock held); returns 0 for CMD_QUIT
+int runCommand(Player* player, const Command* command) {
+    Playlist* playlist = player->playlist;
+    switch (command->type) {
+        case CMD_PLAY:
+            if (player->state == PLAYER_PAUSED) {
+                setPlayerState(player, PLAYER_PLAYING);
+                printf(GREEN "Playback resumed.\n" RESET);
+            } else if (player->state == PLAYER_PLAYING) {
+                printf(YELLOW "Already playing.\n" RESET);
+            } else if (playlist->count == 0) {
+                printf(RED "The playlist is empty. Cannot play songs.\n" RESET);
+            } else {
+                if (playlist->current >= playlist->count) {
+                    playlist->current = 0; // The last song was removed after playback stopped on it
                 }
+                playlist->restartPending = 0;
+                setPlayerState(player, PLAYER_PLAYING);
+                resetAudio(player, 1);
+            }
+            break;
+        case CMD_PAUSE:
+            if (player->state == PLAYER_PLAYING) {
+                setPlayerState(player, PLAYER_PAUSED);
+                printf(YELLOW "Playback paused. Choose Play to resume.\n" RESET);
+            } else {
+                printf(YELLOW "Nothing is playing.\n" RESET);
+            }
+            break;
+        case CMD_STOP:
+            // `current` stays on the track that was playing so the next Play resumes it
+            if (player->state != PLAYER_STOPPED) {
+                resetAudio(player, 0);
+                setPlayerState(player, PLAYER_STOPPED);
             }
-            Mix_FreeMusic(music);
+            printf(BOLD RED "Playing Stopped.\n" RESET);
+            break;
+        case CMD_NEXT:
+            if (player->state == PLAYER_STOPPED) {
+                printf(YELLOW "Nothing is playing.\n" RESET);
+            } else {
+                playlist->current++;
+                playlist->restartPending = 0;
+                resetAudio(player, 1);
+            }
+            break;
+        case CMD_SEEK:
+            if (player->state == PLAYER_STOPPED) {
+                printf(YELLOW "Nothing is playing.\n" RESET);
+            } else {
+                long frames = (long)(command->seconds * player->bytesPerSecond) / player->bytesPerFrame;
+                atomic_store(&player->seekBytes, frames * player->bytesPerFrame);
+            }
+            break;
+        case CMD_SYNC:
+            break; // The checks after every wake pick up the edit
+        case CMD_STATS:
+            printCacheStats(&player->cache);
+            break;
+        case CMD_QUIT:
+            return 0;
+    }
+    return 1;
+}
+
+// Function to advance playback after track boundaries, finished loads and playlist edits (worker, lock held)
+// Returns 0 when the end of the playlist is reached
+int advancePlayer(Player* player, int* seenStarts) {
+    Playlist* playlist = player->playlist;
+    if (playlist->restartPending) {
+        playlist->restartPending = 0; // `current` already names the track to play
+        resetAudio(player, 1);
+    }
+    for (int ended = collectRetired(player); ended > 0; ended--) {
+        shiftSlots(player);
+        playlist->current++;
+    }
+    // Skip tracks that failed to decode before the end check, so a failed last track still finishes playback
+    while (player->slots[0].state == SLOT_FAILED) {
+        shiftSlots(player);
+        playlist->current++;
+    }
+
+    // During a crossfade `current` stays on the track fading out until it ends; the newest one started is shown
+    int started = atomic_load(&player->tracksStarted);
+    int position = playlist->current + (started - player->endedTracks) - 1;
+    if (started != *seenStarts && position >= 0 && position < playlist->count) {
+        *seenStarts = started;
+        const char* path = stringAt(&playlist->strings, playlist->tracks[position].pathId);
+        long gapBytes = atomic_load(&player->handoverGapBytes);
+        if (player->afterReset) {
+            player->afterReset = 0;
+            printf(BOLD CYAN "\nNow playing: %d. %s\n" RESET, position + 1, path); // Display current song
+        } else if (gapBytes < 0) {
+            player->crossfades++;
+            printf(BOLD CYAN "\nNow playing: %d. %s (crossfade %.1f s)\n" RESET, position + 1, path,
+                   -gapBytes / player->bytesPerSecond);
+        } else {
+            double gapMs = gapBytes * 1000.0 / player->bytesPerSecond;
+            player->handovers++;
+            player->totalGapMs += gapMs;
+            printf(BOLD CYAN "\nNow playing: %d. %s (handover gap %.1f ms)\n" RESET, position + 1, path, gapMs);
+        }
+    }
+
+    if (playlist->current >= playlist->count && player->slots[0].state == SLOT_EMPTY) {
+        resetAudio(player, 0);
+        setPlayerState(player, PLAYER_STOPPED);
+        playlist->current = 0;
+        printf(BOLD BLUE "Finished playing all songs.\n" RESET);
+        return 0;
+    }
+    checkSlots(player);
+    pumpPlayer(player);
+    return 1;
+}
+
+// Playback worker: the one thread that starts, stops and advances playback
+// It sleeps until a command, a track boundary or a finished load posts `events`, so an idle player uses no CPU
+void* playbackWorker(void* arg) {
+    Player* player = (Player*)arg;
+    Playlist* playlist = player->playlist;
+    int seenStarts = atomic_load(&player->tracksStarted);
+    int running = 1;
+
+    pthread_create(&player->loaderThread, NULL, loadTracks, player);
+    while (running) {
+        while (sem_wait(&player->events) != 0 && errno == EINTR) {
+        }
+
+        pthread_mutex_lock(&playlist->lock);
+        int handled = 0;
+        Command command;
+        while (running && nextCommand(player, &command)) {
+            OP_STATS_START(timer);
+            running = runCommand(player, &command);
+            OP_STATS_STOP(OP_RUN_COMMAND, timer);
+            handled++;
+        }
+        collectLoad(player);
+        if (running && player->state != PLAYER_STOPPED && !advancePlayer(player, &seenStarts) &&
+            player->exitWhenFinished) {
+            running = 0;
         }
+        pthread_mutex_unlock(&playlist->lock);
 
-        temp = temp->next;
+        fflush(stdout);
+        for (; handled > 0; handled--) {
+            sem_post(&player->commandsDone);
+        }
     }
 
-    isPlaying = 0; // Clear the flag
-    printf(BOLD BLUE "Finished playing all songs.\n" RESET);
+    pthread_mutex_lock(&playlist->lock);
+    resetAudio(player, 0);
+    setPlayerState(player, PLAYER_STOPPED);
+    pthread_mutex_unlock(&playlist->lock);
+
+    pthread_mutex_lock(&player->loaderLock);
+    player->loaderExit = 1;
+    pthread_cond_signal(&player->loaderWake);
+    pthread_mutex_unlock(&player->loaderLock);
+    pthread_join(player->loaderThread, NULL);
+    collectLoad(player); // Free a track decoded after the stop
     return NULL;
 }
 
-// Function to free the playlist memory
-void freePlaylist(struct Song* head) {
-    struct Song* current = head;
-    while (current != NULL) {
-        struct Song* next = current->next;
-        free(current);
-        current = next;
+// Playlist microbenchmark: append, indexed access, shuffle, move and remove on a large playlist
+// Usage: bench-playlist [tracks]
+int runPlaylistBenchmark(int argc, char* argv[]) {
+    int tracks = argc > 2 ? atoi(argv[2]) : 100000;
+    if (tracks < 1) {
+        printf(RED "Usage: bench-playlist [tracks >= 1]\n" RESET);
+        return 1;
+    }
+    const int edits = 10000;
+    const int lookups = 1000000;
+    Playlist playlist;
+    initPlaylist(&playlist);
+    unsigned long long state = 88172645463325252ull;
+    char path[MAX_PATH_LENGTH];
+
+    // Every fourth track repeats an earlier song, as in real libraries with the same song on several lists
+    double start = nowSeconds();
+    for (int i = 0; i < tracks; i++) {
+        int song = i % 4 == 3 ? (int)randomBelow(&state, (unsigned int)i) : i;
+        snprintf(path, sizeof(path), "library/artist%04d/album%02d/track%07d.mp3", song / 200, song / 20 % 10, song);
+        appendTrack(&playlist, path, NULL, 180 + song % 120, NAN);
+    }
+    double appendNs = (nowSeconds() - start) * 1e9 / tracks;
+
+    long long totalLength = 0;
+    start = nowSeconds();
+    for (int i = 0; i < lookups; i++) {
+        totalLength += trackAt(&playlist, (int)randomBelow(&state, (unsigned int)playlist.count)).length;
+    }
+    double accessNs = (nowSeconds() - start) * 1e9 / lookups;
+
+    start = nowSeconds();
+    shufflePlaylist(&playlist);
+    double shuffleMs = (nowSeconds() - start) * 1e3;
+
+    start = nowSeconds();
+    for (int i = 0; i < edits; i++) {
+        moveTrack(&playlist, (int)randomBelow(&state, (unsigned int)playlist.count),
+                  (int)randomBelow(&state, (unsigned int)playlist.count));
+    }
+    double moveUs = (nowSeconds() - start) * 1e6 / edits;
+
+    int removals = edits < playlist.count ? edits : playlist.count - 1;
+    start = nowSeconds();
+    for (int i = 0; i < removals; i++) {
+        removeTrack(&playlist, (int)randomBelow(&state, (unsigned int)playlist.count));
+    }
+    double removeUs = (nowSeconds() - start) * 1e6 / (removals > 0 ? removals : 1);
+
+    // Persistence round trips, checked against the playlist they were saved from
+    const char* snapshotPath = "bench_playlist.snapshot";
+    const char* m3uPath = "bench_playlist.m3u8";
+    start = nowSeconds();
+    int saved = savePlaylistSnapshot(&playlist, snapshotPath);
+    double snapshotSaveMs = (nowSeconds() - start) * 1e3;
+    Playlist restored;
+    initPlaylist(&restored);
+    start = nowSeconds();
+    int loaded = saved && loadPlaylistSnapshot(&restored, snapshotPath);
+    double snapshotLoadMs = (nowSeconds() - start) * 1e3;
+    start = nowSeconds();
+    saved = saved && savePlaylistM3u(&playlist, m3uPath);
+    double m3uSaveMs = (nowSeconds() - start) * 1e3;
+    Playlist imported;
+    initPlaylist(&imported);
+    start = nowSeconds();
+    loaded = loaded && saved && loadPlaylistM3u(&imported, NULL, m3uPath) == playlist.count;
+    double m3uLoadMs = (nowSeconds() - start) * 1e3;
+    for (int i = 0; loaded && i < playlist.count; i++) {
+        Track a = trackAt(&playlist, i), b = trackAt(&restored, i), c = trackAt(&imported, i);
+        loaded = a.length == b.length && a.length == c.length && a.pathId == b.pathId &&
+                 strcmp(stringAt(&playlist.strings, a.pathId), stringAt(&imported.strings, c.pathId)) == 0;
+    }
+    freePlaylist(&restored);
+    freePlaylist(&imported);
+    remove(snapshotPath);
+    remove(m3uPath);
+
+    size_t bytes = playlist.capacity * sizeof(Track) + playlist.strings.capacity +
+                   playlist.strings.offsetCapacity * sizeof(size_t) + playlist.strings.indexCapacity * sizeof(int);
+    printf(BOLD "Playlist microbenchmark: %d tracks, %d distinct paths\n" RESET, tracks, playlist.strings.count);
+    printf("| %-28s | %12s |\n", "Operation", "Cost");
+    printf("| %-28s | %9.1f ns |\n", "Append", appendNs);
+    printf("| %-28s | %9.1f ns |\n", "Indexed access", accessNs);
+    printf("| %-28s | %9.2f ms |\n", "Shuffle (whole playlist)", shuffleMs);
+    printf("| %-28s | %9.2f us |\n", "Move (random positions)", moveUs);
+    printf("| %-28s | %9.2f us |\n", "Remove (random position)", removeUs);
+    printf("| %-28s | %9.2f ms |\n", "Save snapshot", snapshotSaveMs);
+    printf("| %-28s | %9.2f ms |\n", "Load snapshot (mmap)", snapshotLoadMs);
+    printf("| %-28s | %9.2f ms |\n", "Save M3U", m3uSaveMs);
+    printf("| %-28s | %9.2f ms |\n", "Load M3U", m3uLoadMs);
+    printf("| %-28s | %9.1f B  |\n", "Memory per track", (double)bytes / tracks);
+    if (!loaded) {
+        printf(RED "Saved and loaded playlists differ!\n" RESET);
+    }
+    printf("(checksum %lld)\n", totalLength);
+
+    freePlaylist(&playlist);
+    return 0;
+}
+
+// Function to fill a buffer with a test signal: two tones and some noise, peaking near full scale
+void fillTestSignal(Sint16* samples, int count, unsigned long long* state) {
+    for (int i = 0; i < count; i++) {
+        double t = i / 2 / 44100.0;
+        double v = 14000 * sin(2 * M_PI * 220 * t) + 9000 * sin(2 * M_PI * 3520 * t + i % 2);
+        samples[i] = (Sint16)(v + (int)randomBelow(state, 8001) - 4000);
+    }
+}
+
+// Mixing microbenchmark: the portable and the vectorized sample kernels on the same stereo audio, checked equal
+// Usage: bench-mix [seconds]
+int runMixBenchmark(int argc, char* argv[]) {
+    int seconds = argc > 2 ? atoi(argv[2]) : 60;
+    if (seconds < 1 || seconds > 3600) {
+        printf(RED "Usage: bench-mix [seconds from 1 to 3600]\n" RESET);
+        return 1;
+    }
+#if defined(__SSE2__)
+    const char* vectorName = "SSE2";
+#else
+    const char* vectorName = "none";
+#endif
+    int count = seconds * 44100 * 2;
+    Sint16* a = (Sint16*)checkedAlloc(malloc(count * sizeof(Sint16)));
+    Sint16* b = (Sint16*)checkedAlloc(malloc(count * sizeof(Sint16)));
+    Sint16* expected = (Sint16*)checkedAlloc(malloc(count * sizeof(Sint16)));
+    Sint16* out = (Sint16*)checkedAlloc(malloc(count * sizeof(Sint16)));
+    unsigned long long state = 88172645463325252ull;
+    fillTestSignal(a, count, &state);
+    fillTestSignal(b, count, &state);
+    memset(expected, 0, count * sizeof(Sint16)); // Fault the output pages in before timing
+    memset(out, 0, count * sizeof(Sint16));
+
+    // Gains above 1 make both kernels saturate, so clipping is compared as well
+    double start = nowSeconds();
+    scaleSamplesScalar(expected, a, count, 1.37f);
+    double scaleScalarMs = (nowSeconds() - start) * 1e3;
+    start = nowSeconds();
+    scaleSamples(out, a, count, 1.37f);
+    double scaleVectorMs = (nowSeconds() - start) * 1e3;
+    int same = memcmp(expected, out, count * sizeof(Sint16)) == 0;
+
+    start = nowSeconds();
+    mixSamplesScalar(expected, a, 0.81f, b, 0.93f, count);
+    double mixScalarMs = (nowSeconds() - start) * 1e3;
+    start = nowSeconds();
+    mixSamples(out, a, 0.81f, b, 0.93f, count);
+    double mixVectorMs = (nowSeconds() - start) * 1e3;
+    same = same && memcmp(expected, out, count * sizeof(Sint16)) == 0;
+
+    // Sums are added in a different order, so they match to rounding only; peaks match exactly
+    int blockSamples = 44100 * 2 * LOUDNESS_BLOCK_MS / 1000;
+    int scalarPeak = 0, vectorPeak = 0;
+    double scalarSum = 0, vectorSum = 0;
+    start = nowSeconds();
+    for (int i = 0; i < count; i += blockSamples) {
+        scalarSum += sumSquaresScalar(a + i, count - i < blockSamples ? count - i : blockSamples, &scalarPeak);
+    }
+    double sumScalarMs = (nowSeconds() - start) * 1e3;
+    start = nowSeconds();
+    for (int i = 0; i < count; i += blockSamples) {
+        vectorSum += sumSquares(a + i, count - i < blockSamples ? count - i : blockSamples, &vectorPeak);
+    }
+    double sumVectorMs = (nowSeconds() - start) * 1e3;
+    same = same && scalarPeak == vectorPeak && fabs(scalarSum - vectorSum) <= 1e-5 * scalarSum;
+
+    start = nowSeconds();
+    float gain = levelingGain(a, count, 2, 44100, NAN);
+    double analysisMs = (nowSeconds() - start) * 1e3;
+
+    printf(BOLD "Mixing microbenchmark: %d s of 44.1 kHz stereo (%d samples), vector kernels: %s\n" RESET, seconds,
+           count, vectorName);
+    printf("| %-25s | %12s | %12s | %8s |\n", "Kernel", "Scalar", vectorName, "Speedup");
+    printf("| %-25s | %9.2f ms | %9.2f ms | %7.1fx |\n", "Scale (leveling gain)", scaleScalarMs, scaleVectorMs,
+           scaleScalarMs / scaleVectorMs);
+    printf("| %-25s | %9.2f ms | %9.2f ms | %7.1fx |\n", "Mix (crossfade)", mixScalarMs, mixVectorMs,
+           mixScalarMs / mixVectorMs);
+    printf("| %-25s | %9.2f ms | %9.2f ms | %7.1fx |\n", "Squares + peak (analysis)", sumScalarMs, sumVectorMs,
+           sumScalarMs / sumVectorMs);
+    printf("Loudness analysis of the whole signal: %.2f ms, leveling gain %+.2f dB\n", analysisMs,
+           20 * log10f(gain));
+    printf("Realtime budget for the same audio: %.0f ms\n", seconds * 1e3);
+    if (!same) {
+        printf(RED "Scalar and vector kernels disagree!\n" RESET);
+    }
+
+    free(a);
+    free(b);
+    free(expected);
+    free(out);
+    return same ? 0 : 1;
+}
+
+// Play mode: plays the given files once through, then reports the track-to-track gaps (crossfades are not gaps)
+// Works headless with SDL_AUDIODRIVER=dummy
+int runPlayMode(Playlist* playlist, size_t cacheBudget, double crossfadeSeconds, int argc, char* argv[]) {
+    for (int i = 2; i < argc; i++) {
+        appendTrack(playlist, argv[i], NULL, 0, NAN);
+    }
+    Player player;
+    initPlayer(&player, playlist, cacheBudget);
+    setCrossfade(&player, crossfadeSeconds);
+    player.exitWhenFinished = 1;
+    sendCommand(&player, CMD_PLAY, 0);
+    playbackWorker(&player);
+    printf(BOLD "%d track changes, average gap %.2f ms\n" RESET, player.handovers,
+           player.handovers > 0 ? player.totalGapMs / player.handovers : 0.0);
+    if (player.crossfades > 0) {
+        printf(BOLD "%d crossfade%s\n" RESET, player.crossfades, player.crossfades == 1 ? "" : "s");
+    }
+    printCacheStats(&player.cache);
+    freePlayer(&player);
+    freePlaylist(playlist);
+    Mix_CloseAudio();
+    SDL_Quit();
+    return 0;
+}
+
+// Scan mode: reads durations and titles for every MP3 under the given folders and updates the library index
+// Usage: scan FOLDER... [--threads=N]
+int runScanMode(int argc, char* argv[]) {
+    int threads = defaultScanThreads();
+    char* roots[argc];
+    int rootCount = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            if (threads < 1 || threads > MAX_SCAN_THREADS) {
+                printf(RED "--threads must be between 1 and %d\n" RESET, MAX_SCAN_THREADS);
+                return 1;
+            }
+        } else {
+            roots[rootCount++] = argv[i];
+        }
+    }
+    if (rootCount == 0) {
+        printf(RED "Usage: scan FOLDER... [--threads=N]\n" RESET);
+        return 1;
+    }
+
+    static const char* sources[] = {"unknown", "xing", "vbri", "frames"};
+    LibraryIndex library;
+    initLibraryIndex(&library);
+    loadLibraryIndex(&library, LIBRARY_INDEX_PATH);
+    LibraryScan scan;
+    double start = nowSeconds();
+    scanLibrary(&library, roots, rootCount, threads, &scan);
+    double elapsedMs = (nowSeconds() - start) * 1e3;
+
+    ReportOutput* out = reportBegin();
+    reportFormat(out, "| %9s | %-6s | %9s | %-30s | %s\n", "Duration", "Source", "Gain", "Title", "Path");
+    int failed = 0;
+    for (int i = 0; i < scan.count; i++) {
+        const ScanJob* job = &scan.jobs[i];
+        if (!job->ok) {
+            reportStyle(out, RED);
+            reportFormat(out, "| %9s | %-6s | %9s | %-30s | %s\n", "-", "-", "-", "(no MPEG audio found)", job->path);
+            failed++;
+            continue;
+        }
+        int centiseconds = (int)(job->info.seconds * 100 + 0.5);
+        char gain[16] = "-";
+        if (!isnan(job->info.gainDb)) {
+            snprintf(gain, sizeof(gain), "%+.2f dB", job->info.gainDb);
+        }
+        reportStyle(out, "");
+        reportFormat(out, "| %3d:%02d.%02d | %-6s | %9s | %-30s | %s\n", centiseconds / 6000, centiseconds / 100 % 60,
+                     centiseconds % 100, sources[job->info.source], gain, job->info.title, job->path);
     }
+    reportEnd(out);
+    printf(BOLD "%d files: %d unchanged since the last scan, %d scanned, %d unreadable, %.1f ms on %d thread%s\n" RESET,
+           scan.count, scan.cachedCount, scan.count - scan.cachedCount - failed, failed, elapsedMs, threads,
+           threads == 1 ? "" : "s");
+    if (library.dirty) {
+        saveLibraryIndex(&library, LIBRARY_INDEX_PATH);
+    }
+    freeLibraryScan(&scan);
+    freeLibraryIndex(&library);
+    return 0;
+}
+
+// Function to take a "NAME=VALUE" option out of the arguments, returning the last value given or NULL
+const char* takeOption(int* argc, char* argv[], const char* name) {
+    size_t length = strlen(name);
+    const char* value = NULL;
+    for (int i = 1; i < *argc; i++) {
+        if (strncmp(argv[i], name, length) != 0 || argv[i][length] != '=') {
+            continue;
+        }
+        value = argv[i] + length + 1;
+        memmove(argv + i, argv + i + 1, (size_t)(*argc - i) * sizeof(char*)); // Moves the NULL terminator too
+        (*argc)--;
+        i--;
+    }
+    return value;
+}
+
+// Function to take a "--cache-mb=N" option out of the arguments, returning the audio cache budget in bytes
+// Returns -1 if N is not a whole number of megabytes
+long long takeCacheBudget(int* argc, char* argv[]) {
+    const char* value = takeOption(argc, argv, "--cache-mb");
+    if (value == NULL) {
+        return DEFAULT_CACHE_MB * 1048576LL;
+    }
+    char* end;
+    long long megabytes = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || megabytes < 0 || megabytes > (1LL << 30)) {
+        return -1;
+    }
+    return megabytes * 1048576;
+}
+
+// Function to take a "--crossfade=SECONDS" option out of the arguments, returning -1 if SECONDS is out of range
+double takeCrossfade(int* argc, char* argv[]) {
+    const char* value = takeOption(argc, argv, "--crossfade");
+    if (value == NULL) {
+        return 0;
+    }
+    char* end;
+    double seconds = strtod(value, &end);
+    if (end == value || *end != '\0' || !(seconds >= 0 && seconds <= MAX_CROSSFADE_SECONDS)) {
+        return -1;
+    }
+    return seconds;
 }
 
-// Function to print a decorative line
-void printLine(char ch, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", ch);
+// Function to ask for the crossfade between songs; the audio callback picks it up at the next song change
+void setCrossfadeLength(Player* player) {
+    double seconds;
+    printf(BLUE "Enter the crossfade between songs in seconds (0 to %d, 0 = gapless): " RESET, MAX_CROSSFADE_SECONDS);
+    if (scanf("%lf", &seconds) != 1 || !(seconds >= 0 && seconds <= MAX_CROSSFADE_SECONDS)) {
+        scanf("%*[^\n]");
+        printf(RED "Invalid crossfade.\n" RESET);
+        return;
+    }
+    if (!player->mixable) {
+        printf(YELLOW "The audio device does not take 16-bit samples, so songs cannot be mixed.\n" RESET);
+        return;
+    }
+    setCrossfade(player, seconds);
+    if (seconds > 0) {
+        printf(GREEN "Songs will crossfade over %.1f seconds.\n" RESET, seconds);
+    } else {
+        printf(GREEN "Songs will play back to back without a crossfade.\n" RESET);
     }
-    printf("\n");
+}
+
+// Function to switch volume leveling on or off; it applies straight away, even mid-song
+void toggleLeveling(Player* player) {
+    int on = !atomic_load(&player->leveling);
+    atomic_store(&player->leveling, on);
+    printf(GREEN "Volume leveling %s.\n" RESET, on ? "on" : "off");
 }
 
 // Main function
-int main() {
-    struct Song* playlist = NULL; // Head of the playlist
+int main(int argc, char* argv[]) {
+    opStatsInit("music_playlist_manager", opNames, OP_COUNT);
+    long long cacheBudget = takeCacheBudget(&argc, argv);
+    if (cacheBudget < 0) {
+        printf(RED "Usage: --cache-mb=N, the megabytes of decoded audio to keep (0 = only the songs queued)\n" RESET);
+        return 1;
+    }
+    double crossfadeSeconds = takeCrossfade(&argc, argv);
+    if (crossfadeSeconds < 0) {
+        printf(RED "Usage: --crossfade=SECONDS, the overlap between songs (0 to %d)\n" RESET, MAX_CROSSFADE_SECONDS);
+        return 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench-playlist") == 0) {
+        return runPlaylistBenchmark(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench-mix") == 0) {
+        return runMixBenchmark(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "scan") == 0) {
+        return runScanMode(argc, argv);
+    }
+
+    Playlist playlist;
+    initPlaylist(&playlist);
     int choice;
 
     // Initialize SDL
@@ -172,7 +3003,29 @@ int main() {
         return 1;
     }
 
-    pthread_t playbackThread; // Thread for playing songs
+    // "play FILE..." plays the files once through and reports the gap at each track change
+    if (argc > 2 && strcmp(argv[1], "play") == 0) {
+        return runPlayMode(&playlist, (size_t)cacheBudget, crossfadeSeconds, argc, argv);
+    }
+
+    // Durations and titles of files scanned in earlier sessions
+    LibraryIndex library;
+    initLibraryIndex(&library);
+    loadLibraryIndex(&library, LIBRARY_INDEX_PATH);
+
+    // The playlist left at the end of the last session
+    if (loadPlaylistSnapshot(&playlist, PLAYLIST_SNAPSHOT_PATH) && playlist.count > 0) {
+        printf(GREEN "Restored %d songs from the last session.\n" RESET, playlist.count);
+    }
+
+    // One playback worker for the whole session; the menu only sends it commands
+    Player player;
+    initPlayer(&player, &playlist, (size_t)cacheBudget);
+    setCrossfade(&player, crossfadeSeconds);
+    if (pthread_create(&player.workerThread, NULL, playbackWorker, &player) != 0) {
+        printf(RED "Failed to create thread for playback.\n" RESET);
+        return 1;
+    }
 
     do {
         printLine('-', 30); // Decorative line
@@ -182,46 +3035,140 @@ int main() {
         printf("2. Display playlist\n");
         printf("3. Play songs\n");
         printf("4. Stop playing\n");
-        printf("5. Exit\n");
+        printf("5. Shuffle playlist\n");
+        printf("6. Move a song\n");
+        printf("7. Remove a song\n");
+        printf("8. Jump to a song\n");
+        printf("9. Pause\n");
+        printf("10. Next song\n");
+        printf("11. Seek\n");
+        printf("12. Add a folder\n");
+        printf("13. Save playlist (M3U)\n");
+        printf("14. Load playlist (M3U)\n");
+        printf("15. Audio cache statistics\n");
+        printf("16. Crossfade\n");
+        printf("17. Volume leveling on/off\n");
+        printf("18. Operation statistics\n");
+        printf("19. Save statistics\n");
+        printf("20. Exit\n");
         printLine('-', 30); // Decorative line
 
         // Check for user choice after all messages
         printf(BLUE "Enter your choice: " RESET);
-        scanf("%d", &choice);
+        if (scanf("%d", &choice) != 1) {
+            if (feof(stdin)) {
+                choice = 20;
+            } else {
+                scanf("%*[^\n]");
+                choice = 0;
+            }
+        }
 
         switch (choice) {
             case 1:
-                addSong(&playlist);
+                addSong(&playlist, &library);
+                sendCommandAndWait(&player, CMD_SYNC, 0); // The new song may be the next to prefetch
                 break;
             case 2:
-                displayPlaylist(playlist);
+                displayPlaylist(&playlist);
                 break;
             case 3:
-                if (pthread_create(&playbackThread, NULL, playSongs, (void*)playlist) != 0) {
-                    printf(RED "Failed to create thread for playback.\n" RESET);
-                }
+                sendCommandAndWait(&player, CMD_PLAY, 0);
                 break;
             case 4:
-                isPlaying = 0; // Signal to stop playback
-                printf(BOLD RED "Playing Stopped.\n" RESET);
+                sendCommandAndWait(&player, CMD_STOP, 0);
                 break;
             case 5:
+                shufflePlaylist(&playlist);
+                printf(GREEN "Playlist shuffled.\n" RESET);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 6:
+                moveSong(&playlist);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 7:
+                removeSong(&playlist);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 8:
+                jumpToSong(&playlist);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 9:
+                sendCommandAndWait(&player, CMD_PAUSE, 0);
+                break;
+            case 10:
+                sendCommandAndWait(&player, CMD_NEXT, 0);
+                break;
+            case 11: {
+                double seconds;
+                printf(BLUE "Enter position in the current song (in seconds): " RESET);
+                if (scanf("%lf", &seconds) != 1 || seconds < 0) {
+                    scanf("%*[^\n]");
+                    printf(RED "Invalid position.\n" RESET);
+                    break;
+                }
+                sendCommandAndWait(&player, CMD_SEEK, seconds);
+                break;
+            }
+            case 12:
+                addFolder(&playlist, &library);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 13:
+                savePlaylist(&playlist);
+                break;
+            case 14:
+                loadPlaylist(&playlist, &library);
+                sendCommandAndWait(&player, CMD_SYNC, 0);
+                break;
+            case 15:
+                sendCommandAndWait(&player, CMD_STATS, 0);
+                break;
+            case 16:
+                setCrossfadeLength(&player);
+                break;
+            case 17:
+                toggleLeveling(&player);
+                break;
+            case 18:
+                opStatsPrint();
+                break;
+            case 19: {
+                char path[MAX_PATH_LENGTH];
+                printf(BLUE "Enter a file to save to (.json for JSON, other names for Prometheus text): " RESET);
+                if (scanf(" %1023[^\n]", path) != 1) {
+                    break;
+                }
+                if (opStatsSave(path)) {
+                    printf(GREEN "Statistics saved to %s\n" RESET, path);
+                } else {
+                    printf(RED "Could not write %s\n" RESET, path);
+                }
+                break;
+            }
+            case 20:
                 printf(RED "Exiting...\n" RESET);
-                isPlaying = 0; // Ensure playback stops on exit
-                pthread_join(playbackThread, NULL); // Wait for playback thread to finish
+                sendCommand(&player, CMD_QUIT, 0); // Stops playback on the way out
+                pthread_join(player.workerThread, NULL);
+                freePlayer(&player);
                 break;
             default:
                 printf(RED "Invalid choice. Please try again.\n" RESET);
         }
+    } while (choice != 20);
 
-        // short delay to ensure all messages are printed before the next prompt
-        SDL_Delay(500); // Adjust the delay as necessary
-    } while (choice != 5);
+    if (library.dirty) {
+        saveLibraryIndex(&library, LIBRARY_INDEX_PATH);
+    }
+    savePlaylistSnapshot(&playlist, PLAYLIST_SNAPSHOT_PATH);
+    freeLibraryIndex(&library);
 
     // Free memory
-    freePlaylist(playlist);
+    freePlaylist(&playlist);
     Mix_CloseAudio();
     SDL_Quit();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,327 @@
+#ifndef OP_STATS_H
+#define OP_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "report_output.h"
+
+/*
+Operation counters and latency histograms shared by the four programs. It is header-only: include it and compile
+as before. Compiling with -DOP_STATS_DISABLE removes the timing from every instrumented call.
+
+Each program names its operations once with opStatsInit and brackets a call with OP_STATS_START/OP_STATS_STOP.
+Every thread records into its own block of counters, so threads never share a cache line or take a lock to
+record. A block is allocated the first time a thread records, and it is handed on to the next new thread when
+its thread exits. Latencies go into HDR-style histograms: 16 buckets per power of two, so every value is kept
+to within about 6%, from 1 ns up to about 4 hours.
+
+opStatsPrint shows the totals over all threads. opStatsSave writes them as JSON or as Prometheus text. Setting
+OP_STATS_DUMP=FILE saves them when the program exits, which also covers the modes without a menu.
+*/
+
+#define OP_STATS_MAX_OPS 16        // Operations a program can name
+#define OP_STATS_SUB_BUCKETS 16    // Histogram buckets per power of two
+#define OP_STATS_SUB_BITS 4        // log2(OP_STATS_SUB_BUCKETS)
+#define OP_STATS_BUCKETS (OP_STATS_SUB_BUCKETS * 41) // Covers latencies up to 2^44 ns
+
+// Structure for one operation's counters in one thread (written by that thread only)
+typedef struct OpStatsCell {
+    atomic_ullong count;
+    atomic_ullong totalNs;
+    atomic_ullong maxNs;
+    atomic_ullong buckets[OP_STATS_BUCKETS];
+} OpStatsCell;
+
+// Structure for one thread's counters; blocks form a list that is only ever added to
+typedef struct OpStatsBlock {
+    struct OpStatsBlock* next;
+    atomic_int inUse;      // A live thread records into the block
+    OpStatsCell cells[];   // One per named operation
+} OpStatsBlock;
+
+// Structure for an operation's totals over all threads
+typedef struct OpStatsSummary {
+    unsigned long long count;
+    unsigned long long totalNs;
+    unsigned long long maxNs;
+    int threads;           // Thread blocks that recorded it (a finished thread's block is reused by the next)
+    unsigned long long buckets[OP_STATS_BUCKETS];
+} OpStatsSummary;
+
+static const char* const* opStatsNames;
+static int opStatsCount;
+static const char* opStatsProgram = "program";
+static int opStatsEnabled = 1;
+static _Atomic(OpStatsBlock*) opStatsBlocks;
+static pthread_key_t opStatsKey;
+static pthread_once_t opStatsKeyOnce = PTHREAD_ONCE_INIT;
+static _Thread_local OpStatsBlock* opStatsMine;
+
+// Function to read the monotonic clock in nanoseconds
+static inline unsigned long long opStatsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Function to find the histogram bucket of a latency
+static inline int opStatsBucket(unsigned long long ns) {
+    if (ns < OP_STATS_SUB_BUCKETS) {
+        return (int)ns;
+    }
+    int shift = 63 - __builtin_clzll(ns) - OP_STATS_SUB_BITS;
+    int index = (shift + 1) * OP_STATS_SUB_BUCKETS + (int)((ns >> shift) & (OP_STATS_SUB_BUCKETS - 1));
+    return index < OP_STATS_BUCKETS ? index : OP_STATS_BUCKETS - 1;
+}
+
+// Function to give the largest latency that falls in a bucket
+static inline unsigned long long opStatsBucketTop(int index) {
+    if (index < OP_STATS_SUB_BUCKETS) {
+        return (unsigned long long)index;
+    }
+    int shift = index / OP_STATS_SUB_BUCKETS - 1;
+    unsigned long long low = (unsigned long long)(OP_STATS_SUB_BUCKETS + index % OP_STATS_SUB_BUCKETS) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+// Function to give a thread's block back for the next new thread to use (runs when the thread exits)
+static inline void opStatsReleaseBlock(void* block) {
+    atomic_store(&((OpStatsBlock*)block)->inUse, 0);
+}
+
+// Function to create the key that notices thread exits
+static inline void opStatsCreateKey(void) {
+    pthread_key_create(&opStatsKey, opStatsReleaseBlock);
+}
+
+// Function to find the calling thread's block, adopting a released one or allocating one the first time
+static inline OpStatsBlock* opStatsClaimBlock(void) {
+    pthread_once(&opStatsKeyOnce, opStatsCreateKey);
+    OpStatsBlock* block;
+    for (block = atomic_load(&opStatsBlocks); block != NULL; block = block->next) {
+        int released = 0;
+        if (atomic_compare_exchange_strong(&block->inUse, &released, 1)) {
+            break; // Its counts stay: totals are over all threads, past and present
+        }
+    }
+    if (block == NULL) {
+        block = (OpStatsBlock*)calloc(1, sizeof(OpStatsBlock) + opStatsCount * sizeof(OpStatsCell));
+        if (block == NULL) {
+            return NULL; // The operation goes uncounted
+        }
+        atomic_init(&block->inUse, 1);
+        block->next = atomic_load(&opStatsBlocks);
+        while (!atomic_compare_exchange_weak(&opStatsBlocks, &block->next, block)) {
+        }
+    }
+    pthread_setspecific(opStatsKey, block);
+    opStatsMine = block;
+    return block;
+}
+
+// Function to add to a counter only the calling thread writes
+static inline void opStatsAdd(atomic_ullong* counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Function to start timing an operation; returns 0 when statistics are switched off
+static inline unsigned long long opStatsStart(void) {
+    return opStatsEnabled ? opStatsNow() : 0;
+}
+
+// Function to record an operation that started at `start` in the calling thread's counters
+static inline void opStatsStop(int op, unsigned long long start) {
+    if (start == 0) {
+        return;
+    }
+    unsigned long long ns = opStatsNow() - start;
+    OpStatsBlock* block = opStatsMine != NULL ? opStatsMine : opStatsClaimBlock();
+    if (block == NULL) {
+        return;
+    }
+    OpStatsCell* cell = &block->cells[op];
+    opStatsAdd(&cell->count, 1);
+    opStatsAdd(&cell->totalNs, ns);
+    opStatsAdd(&cell->buckets[opStatsBucket(ns)], 1);
+    if (ns > atomic_load_explicit(&cell->maxNs, memory_order_relaxed)) {
+        atomic_store_explicit(&cell->maxNs, ns, memory_order_relaxed);
+    }
+}
+
+#ifdef OP_STATS_DISABLE
+#define OP_STATS_START(timer)
+#define OP_STATS_STOP(op, timer)
+#else
+#define OP_STATS_START(timer) unsigned long long timer = opStatsStart()
+#define OP_STATS_STOP(op, timer) opStatsStop((op), (timer))
+#endif
+
+// Function to add up an operation's counters over every thread
+// Threads may be recording meanwhile, so the totals can be a few operations apart
+static inline void opStatsCollect(int op, OpStatsSummary* summary) {
+    memset(summary, 0, sizeof(OpStatsSummary));
+    for (OpStatsBlock* block = atomic_load(&opStatsBlocks); block != NULL; block = block->next) {
+        OpStatsCell* cell = &block->cells[op];
+        unsigned long long count = atomic_load_explicit(&cell->count, memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        summary->count += count;
+        summary->totalNs += atomic_load_explicit(&cell->totalNs, memory_order_relaxed);
+        unsigned long long maxNs = atomic_load_explicit(&cell->maxNs, memory_order_relaxed);
+        summary->maxNs = maxNs > summary->maxNs ? maxNs : summary->maxNs;
+        summary->threads++;
+        for (int i = 0; i < OP_STATS_BUCKETS; i++) {
+            summary->buckets[i] += atomic_load_explicit(&cell->buckets[i], memory_order_relaxed);
+        }
+    }
+}
+
+// Function to find the latency at or below which a fraction of the operations completed
+static inline unsigned long long opStatsPercentile(const OpStatsSummary* summary, double fraction) {
+    unsigned long long total = 0;
+    for (int i = 0; i < OP_STATS_BUCKETS; i++) {
+        total += summary->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(fraction * total);
+    rank += rank < fraction * total; // Round up: p90 of two values is the larger one
+    rank = rank < 1 ? 1 : rank > total ? total : rank;
+    unsigned long long seen = 0;
+    for (int i = 0; i < OP_STATS_BUCKETS; i++) {
+        seen += summary->buckets[i];
+        if (seen >= rank) {
+            unsigned long long top = opStatsBucketTop(i);
+            return top < summary->maxNs ? top : summary->maxNs;
+        }
+    }
+    return summary->maxNs;
+}
+
+// Function to write a latency with a readable unit (ns, us, ms or s)
+static inline void opStatsFormatTime(char* text, size_t size, double ns) {
+    if (ns < 1e3) {
+        snprintf(text, size, "%.0f ns", ns);
+    } else if (ns < 1e6) {
+        snprintf(text, size, "%.1f us", ns / 1e3);
+    } else if (ns < 1e9) {
+        snprintf(text, size, "%.2f ms", ns / 1e6);
+    } else {
+        snprintf(text, size, "%.2f s", ns / 1e9);
+    }
+}
+
+// Function to save the statistics as JSON
+static inline void opStatsWriteJson(FILE* file) {
+    fprintf(file, "{\n  \"program\": \"%s\",\n  \"operations\": [", opStatsProgram);
+    OpStatsSummary summary;
+    for (int op = 0; op < opStatsCount; op++) {
+        opStatsCollect(op, &summary);
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"count\": %llu, \"threads\": %d, \"total_ns\": %llu, "
+                      "\"mean_ns\": %.1f, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+                      "\"max_ns\": %llu}",
+                op == 0 ? "" : ",", opStatsNames[op], summary.count, summary.threads, summary.totalNs,
+                summary.count > 0 ? (double)summary.totalNs / summary.count : 0.0,
+                opStatsPercentile(&summary, 0.50), opStatsPercentile(&summary, 0.90),
+                opStatsPercentile(&summary, 0.99), opStatsPercentile(&summary, 0.999), summary.maxNs);
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+// Function to save the statistics in the Prometheus text format, as a summary per operation
+static inline void opStatsWritePrometheus(FILE* file) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char* name = opStatsProgram;
+    fprintf(file, "# HELP %s_operation_duration_seconds Time taken by each operation.\n", name);
+    fprintf(file, "# TYPE %s_operation_duration_seconds summary\n", name);
+    OpStatsSummary summary;
+    for (int op = 0; op < opStatsCount; op++) {
+        opStatsCollect(op, &summary);
+        for (int q = 0; q < (int)(sizeof(quantiles) / sizeof(quantiles[0])); q++) {
+            fprintf(file, "%s_operation_duration_seconds{operation=\"%s\",quantile=\"%g\"} %.9f\n", name,
+                    opStatsNames[op], quantiles[q], opStatsPercentile(&summary, quantiles[q]) / 1e9);
+        }
+        fprintf(file, "%s_operation_duration_seconds_sum{operation=\"%s\"} %.9f\n", name, opStatsNames[op],
+                summary.totalNs / 1e9);
+        fprintf(file, "%s_operation_duration_seconds_count{operation=\"%s\"} %llu\n", name, opStatsNames[op],
+                summary.count);
+    }
+    fprintf(file, "# HELP %s_operation_max_seconds Longest single operation.\n", name);
+    fprintf(file, "# TYPE %s_operation_max_seconds gauge\n", name);
+    for (int op = 0; op < opStatsCount; op++) {
+        opStatsCollect(op, &summary);
+        fprintf(file, "%s_operation_max_seconds{operation=\"%s\"} %.9f\n", name, opStatsNames[op],
+                summary.maxNs / 1e9);
+    }
+}
+
+// Function to save the statistics to a file: JSON if its name ends in ".json", Prometheus text otherwise
+// Returns 0 if the file could not be written
+static inline int opStatsSave(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    size_t length = strlen(path);
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+        opStatsWriteJson(file);
+    } else {
+        opStatsWritePrometheus(file);
+    }
+    return fclose(file) == 0;
+}
+
+// Function to save the statistics named by OP_STATS_DUMP when the program exits
+static inline void opStatsSaveAtExit(void) {
+    const char* path = getenv("OP_STATS_DUMP");
+    if (path != NULL && path[0] != '\0' && !opStatsSave(path)) {
+        fprintf(stderr, "Could not write operation statistics to %s\n", path);
+    }
+}
+
+// Function to name a program's operations (indexes 0 to count - 1) before any is recorded
+static inline void opStatsInit(const char* program, const char* const* names, int count) {
+    opStatsProgram = program;
+    opStatsNames = names;
+    opStatsCount = count < OP_STATS_MAX_OPS ? count : OP_STATS_MAX_OPS;
+#ifndef OP_STATS_DISABLE
+    atexit(opStatsSaveAtExit);
+#endif
+}
+
+// Function to switch recording on or off; benchmark modes switch it off so their own timings stay comparable
+static inline void opStatsSetEnabled(int enabled) {
+    opStatsEnabled = enabled;
+}
+
+// Function to print a table of every operation's count and latency percentiles over all threads
+static inline void opStatsPrint(void) {
+#ifdef OP_STATS_DISABLE
+    printf("Operation statistics were compiled out (OP_STATS_DISABLE).\n");
+#else
+    ReportOutput* out = reportBegin();
+    reportFormat(out, "| %-22s | %10s | %7s | %9s | %9s | %9s | %9s | %9s |\n", "Operation", "Count", "Threads",
+                 "Mean", "p50", "p90", "p99", "Max");
+    OpStatsSummary summary;
+    for (int op = 0; op < opStatsCount; op++) {
+        opStatsCollect(op, &summary);
+        char mean[16], p50[16], p90[16], p99[16], max[16];
+        opStatsFormatTime(mean, sizeof(mean), summary.count > 0 ? (double)summary.totalNs / summary.count : 0);
+        opStatsFormatTime(p50, sizeof(p50), (double)opStatsPercentile(&summary, 0.50));
+        opStatsFormatTime(p90, sizeof(p90), (double)opStatsPercentile(&summary, 0.90));
+        opStatsFormatTime(p99, sizeof(p99), (double)opStatsPercentile(&summary, 0.99));
+        opStatsFormatTime(max, sizeof(max), (double)summary.maxNs);
+        reportFormat(out, "| %-22s | %10llu | %7d | %9s | %9s | %9s | %9s | %9s |\n", opStatsNames[op],
+                     summary.count, summary.threads, mean, p50, p90, p99, max);
+    }
+    reportEnd(out);
+#endif
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef REPORT_OUTPUT_H
+#define REPORT_OUTPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*
+Buffered terminal output shared by the four programs. It is header-only: include it and compile as before.
+
+Reports (tables, matrices and listings) are formatted into one fixed buffer and written with write() a buffer at
+a time, instead of one printf per cell. A color escape code is written only when the style changes. No codes are
+written at all when the output is not a terminal or NO_COLOR is set, so piped listings come out as plain text.
+Nothing is allocated; the buffer is reused by every report, so only one report can be open at a time (main
+thread only).
+*/
+
+#define REPORT_BUFFER_BYTES 65536  // Report bytes held before they are written out
+
+// Structure for a report being written to a file descriptor
+typedef struct ReportOutput {
+    char buffer[REPORT_BUFFER_BYTES];
+    size_t length;         // Bytes waiting in the buffer
+    int fd;
+    int color;             // Write escape codes (a terminal, and NO_COLOR not set)
+    const char* style;     // Style the output is in ("" = plain)
+} ReportOutput;
+
+// Function to write out everything buffered, retrying short writes; output that cannot be written is dropped
+static inline void reportFlush(ReportOutput* out) {
+    size_t done = 0;
+    while (done < out->length) {
+        ssize_t n = write(out->fd, out->buffer + done, out->length - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // Closed pipe or full disk: the rest of the report is lost, as with printf
+        }
+        done += (size_t)n;
+    }
+    out->length = 0;
+}
+
+// Function to start a report on standard output, deciding once whether it is colored
+static inline ReportOutput* reportBegin(void) {
+    static ReportOutput shared;
+    fflush(stdout); // Anything printed before the report comes out first
+    const char* noColor = getenv("NO_COLOR");
+    shared.fd = fileno(stdout);
+    shared.length = 0;
+    shared.color = isatty(shared.fd) && (noColor == NULL || noColor[0] == '\0');
+    shared.style = "";
+    return &shared;
+}
+
+// Function to append raw bytes to a report
+static inline void reportBytes(ReportOutput* out, const char* bytes, size_t n) {
+    if (out->length + n > REPORT_BUFFER_BYTES) {
+        reportFlush(out);
+        if (n > REPORT_BUFFER_BYTES) {
+            memcpy(out->buffer, bytes, REPORT_BUFFER_BYTES); // Longer than the whole buffer: write it in pieces
+            out->length = REPORT_BUFFER_BYTES;
+            reportFlush(out);
+            reportBytes(out, bytes + REPORT_BUFFER_BYTES, n - REPORT_BUFFER_BYTES);
+            return;
+        }
+    }
+    memcpy(out->buffer + out->length, bytes, n);
+    out->length += n;
+}
+
+// Function to switch the report to a style (a color macro, several run together, or "" for plain)
+// Writes nothing if the style is already in effect or the report is plain
+static inline void reportStyle(ReportOutput* out, const char* style) {
+    if (!out->color || out->style == style || strcmp(out->style, style) == 0) {
+        return;
+    }
+    if (out->style[0] != '\0') {
+        reportBytes(out, "\033[0m", 4); // Styles replace each other, so bold does not carry over into the next one
+    }
+    reportBytes(out, style, strlen(style));
+    out->style = style;
+}
+
+// Function to append text to a report
+static inline void reportText(ReportOutput* out, const char* text) {
+    reportBytes(out, text, strlen(text));
+}
+
+// Function to append a character repeated count times
+static inline void reportRepeat(ReportOutput* out, char ch, int count) {
+    while (count > 0) {
+        if (out->length == REPORT_BUFFER_BYTES) {
+            reportFlush(out);
+        }
+        size_t n = REPORT_BUFFER_BYTES - out->length;
+        n = (size_t)count < n ? (size_t)count : n;
+        memset(out->buffer + out->length, ch, n);
+        out->length += n;
+        count -= (int)n;
+    }
+}
+
+// Function to append text padded with spaces to at least width characters, like "%-*s"
+static inline void reportPadded(ReportOutput* out, const char* text, int width) {
+    size_t n = strlen(text);
+    reportBytes(out, text, n);
+    if ((int)n < width) {
+        reportRepeat(out, ' ', width - (int)n);
+    }
+}
+
+// Function to append an integer padded with spaces to at least width characters, like "%-*ld"
+static inline void reportInt(ReportOutput* out, long value, int width) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    *--p = '\0';
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    reportPadded(out, p, width);
+}
+
+// Function to append printf-style formatted text, formatted straight into the buffer
+static inline void reportFormat(ReportOutput* out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t room = REPORT_BUFFER_BYTES - out->length;
+    int n = vsnprintf(out->buffer + out->length, room, format, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n >= room) {
+        // Did not fit: start a fresh buffer and format again (cut short if it is longer than the whole buffer)
+        reportFlush(out);
+        va_start(args, format);
+        n = vsnprintf(out->buffer, REPORT_BUFFER_BYTES, format, args);
+        va_end(args);
+        if ((size_t)n >= REPORT_BUFFER_BYTES) {
+            n = REPORT_BUFFER_BYTES - 1;
+        }
+    }
+    out->length += (size_t)n;
+}
+
+// Function to finish a report: back to the plain style, then write out what is left
+static inline void reportEnd(ReportOutput* out) {
+    reportStyle(out, "");
+    reportFlush(out);
+}
+
+// Function to print a decorative line in one call, between ordinary printf output
+static inline void printLine(char ch, int length) {
+    char line[256];
+    length = length < 0 ? 0 : length < (int)sizeof(line) - 1 ? length : (int)sizeof(line) - 1;
+    memset(line, ch, (size_t)length);
+    line[length] = '\n';
+    fwrite(line, 1, (size_t)length + 1, stdout);
+}
+
+#endif
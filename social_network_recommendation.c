@@ -1,17 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "report_output.h" // Buffered matrix and list output, and printLine
+#include "op_stats.h"      // Operation counters and latency histograms
 
 /*
 Compile the Code: 
-gcc social_network_system.c -o social_network
+gcc social_network_recommendation.c -o social_network -lpthread
+(add -DOP_STATS_DISABLE to compile out the operation statistics)
 
 Run the Program:
 ./social_network
+./social_network stream [users] [edges] [readers]   (live ingestion demo)
+./social_network shard [users] [friends per user] [shards] [queries] [verify]   (multi-process mode)
+./social_network bench [er|rmat|smallworld|all] [users] [average degree] [queries] [results.csv]
 */
 
-#define MAX_USERS 100
+#define INITIAL_USER_CAPACITY 16
+#define INITIAL_LIST_BYTES 8
 #define MAX_NAME_LENGTH 50
+#define MAX_READER_THREADS 64     // Reader slots in the versioned graph
+#define DELTA_BATCH_EDGES 1024    // Friendships per delta segment
+#define MERGE_DELTA_SEGMENTS 8    // Delta segments before merging into the base CSR
+#define MATRIX_BENCH_LIMIT 2000   // Largest graph whose adjacency matrix the benchmark prints
+#define MINHASH_FUNCTIONS 64      // Hash functions per MinHash signature
+#define LSH_ROWS_PER_BAND 2       // Signature rows hashed together into one LSH band
+#define LSH_BANDS (MINHASH_FUNCTIONS / LSH_ROWS_PER_BAND)
+#define MINHASH_TOP_K 10          // Similar users returned by the approximate recommender
 
 // ANSI color codes
 #define RESET "\033[0m"
@@ -23,215 +44,2099 @@ Run the Program:
 #define CYAN "\033[36m"
 #define MAGENTA "\033[35m"
 
+// Operations timed for the statistics menu (and for OP_STATS_DUMP in the stream demo)
+enum {
+    OP_ADD_CONNECTION,
+    OP_RECOMMENDATIONS,
+    OP_MINHASH_RECOMMENDATIONS,
+    OP_LIVE_ADD_CONNECTION,
+    OP_SNAPSHOT_RECOMMENDATIONS,
+    OP_COUNT
+};
+static const char* const opNames[OP_COUNT] = {"add_connection", "recommendations", "minhash_recommendations",
+                                              "live_add_connection", "snapshot_recommendations"};
 
 
-// Function declaration for printLine
-void printLine(char ch, int length);
+// Structure to represent one user's friends as sorted IDs, stored as varint-encoded gaps
+typedef struct AdjacencyList {
+    unsigned char* bytes;  // Delta + varint encoded neighbor IDs
+    int length;            // Number of bytes in use
+    int capacity;          // Number of bytes allocated
+    int degree;            // Number of friends
+} AdjacencyList;
 
+// Structure to decode an adjacency list in ascending ID order
+typedef struct NeighborIterator {
+    const unsigned char* pos;
+    const unsigned char* end;
+    int current;           // Last decoded neighbor ID
+} NeighborIterator;
 
-// Structure to represent a graph node
-typedef struct Node {
-    char name[MAX_NAME_LENGTH];
-    struct Node* next;
-} Node;
+// Structure to represent one LSH bucket: users whose signatures agree on one band
+typedef struct LshBucket {
+    unsigned int key;      // Hash of the band's rows
+    int band;
+    int* users;
+    int count;
+    int capacity;
+    int next;              // Next bucket in the same hash chain (-1 ends the chain)
+} LshBucket;
+
+// Structure to represent per-user MinHash signatures of friend sets plus banded LSH buckets
+typedef struct MinHashIndex {
+    unsigned int (*signatures)[MINHASH_FUNCTIONS]; // Minimum hash of each function over the user's friends
+    int (*bucketOf)[LSH_BANDS];  // Bucket each user is filed under per band (-1 = no friends yet)
+    int (*slotOf)[LSH_BANDS];    // Position of the user inside that bucket
+    int capacity;                // Users allocated
+    LshBucket* buckets;
+    int numBuckets;
+    int bucketCapacity;
+    int freeBuckets;             // Chain of emptied buckets available for reuse (-1 = none)
+    int* chains;                 // Hash table heads, indexed by (band, key) hash
+    int chainMask;
+} MinHashIndex;
+
+// Structure to represent a graph
+typedef struct Graph {
+    char (*names)[MAX_NAME_LENGTH]; // User names indexed by user ID
+    AdjacencyList* adjacency;       // Compressed friend list per user ID
+    int* nameIndex;                 // Open-addressing hash table from name to user ID (-1 = empty slot)
+    int indexCapacity;              // Number of slots in nameIndex (power of two)
+    int numUsers;
+    int capacity;                   // Number of users allocated
+    MinHashIndex* minHash;          // Optional approximate-similarity index (NULL = disabled)
+} Graph;
+
+// Structure to hold one friend recommendation
+typedef struct Recommendation {
+    int userId;
+    int mutualFriends;
+} Recommendation;
+
+// Structure to hold one user ranked by friend-set similarity
+typedef struct SimilarUser {
+    int userId;
+    double similarity;     // Jaccard similarity of the two friend sets (exact or estimated)
+} SimilarUser;
+
+// Function to exit on a failed allocation
+void* checkedAlloc(void* ptr) {
+    if (ptr == NULL) {
+        printf(RED "Memory allocation failed!\n" RESET);
+        exit(1);
+    }
+    return ptr;
+}
+
+// Function to hash a user name (FNV-1a)
+unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to mix a 32-bit value into a well-distributed hash (murmur3 finalizer)
+unsigned int mixHash(unsigned int x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+// Function to apply the i-th MinHash function to a friend ID
+unsigned int minHashFunction(int i, int friendId) {
+    return mixHash((unsigned int)friendId * 0x9E3779B1u + (unsigned int)i * 0x85EBCA77u);
+}
+
+// Function to create an empty MinHash index for a number of users
+MinHashIndex* createMinHashIndex(int capacity) {
+    MinHashIndex* index = (MinHashIndex*)checkedAlloc(calloc(1, sizeof(MinHashIndex)));
+    index->capacity = capacity;
+    index->signatures = checkedAlloc(malloc(capacity * sizeof(*index->signatures)));
+    index->bucketOf = checkedAlloc(malloc(capacity * sizeof(*index->bucketOf)));
+    index->slotOf = checkedAlloc(malloc(capacity * sizeof(*index->slotOf)));
+    memset(index->signatures, 0xFF, capacity * sizeof(*index->signatures));
+    memset(index->bucketOf, 0xFF, capacity * sizeof(*index->bucketOf));
+    index->freeBuckets = -1;
+    index->chainMask = 1023;
+    index->chains = (int*)checkedAlloc(malloc((index->chainMask + 1) * sizeof(int)));
+    memset(index->chains, 0xFF, (index->chainMask + 1) * sizeof(int));
+    return index;
+}
+
+// Function to grow the per-user arrays of a MinHash index along with the graph
+void growMinHashIndex(MinHashIndex* index, int newCapacity) {
+    index->signatures = checkedAlloc(realloc(index->signatures, newCapacity * sizeof(*index->signatures)));
+    index->bucketOf = checkedAlloc(realloc(index->bucketOf, newCapacity * sizeof(*index->bucketOf)));
+    index->slotOf = checkedAlloc(realloc(index->slotOf, newCapacity * sizeof(*index->slotOf)));
+    int added = newCapacity - index->capacity;
+    memset(index->signatures + index->capacity, 0xFF, added * sizeof(*index->signatures));
+    memset(index->bucketOf + index->capacity, 0xFF, added * sizeof(*index->bucketOf));
+    index->capacity = newCapacity;
+}
+
+// Function to hash the rows of one band of a signature
+unsigned int bandKey(const unsigned int* signature, int band) {
+    unsigned int key = 2166136261u;
+    for (int r = 0; r < LSH_ROWS_PER_BAND; r++) {
+        key = mixHash(key ^ signature[band * LSH_ROWS_PER_BAND + r]);
+    }
+    return key;
+}
+
+// Function to rebuild the hash chains at twice the size once buckets outnumber them
+void growLshChains(MinHashIndex* index) {
+    index->chainMask = index->chainMask * 2 + 1;
+    index->chains = (int*)checkedAlloc(realloc(index->chains, (index->chainMask + 1) * sizeof(int)));
+    memset(index->chains, 0xFF, (index->chainMask + 1) * sizeof(int));
+    for (int b = 0; b < index->numBuckets; b++) {
+        LshBucket* bucket = &index->buckets[b];
+        if (bucket->count == 0) {
+            continue; // Emptied buckets live on the free list only
+        }
+        int chain = mixHash(bucket->key + bucket->band) & index->chainMask;
+        bucket->next = index->chains[chain];
+        index->chains[chain] = b;
+    }
+}
+
+// Function to find the bucket for (band, key), creating it if needed
+int findOrCreateBucket(MinHashIndex* index, int band, unsigned int key) {
+    int chain = mixHash(key + band) & index->chainMask;
+    for (int b = index->chains[chain]; b != -1; b = index->buckets[b].next) {
+        if (index->buckets[b].key == key && index->buckets[b].band == band) {
+            return b;
+        }
+    }
+
+    int b;
+    if (index->freeBuckets != -1) {
+        b = index->freeBuckets;
+        index->freeBuckets = index->buckets[b].next;
+    } else {
+        if (index->numBuckets == index->bucketCapacity) {
+            index->bucketCapacity = index->bucketCapacity ? index->bucketCapacity * 2 : 256;
+            index->buckets = (LshBucket*)checkedAlloc(realloc(index->buckets, index->bucketCapacity * sizeof(LshBucket)));
+        }
+        b = index->numBuckets++;
+        index->buckets[b].users = NULL;
+        index->buckets[b].capacity = 0;
+        index->buckets[b].count = 0; // Not linked yet: growLshChains must skip it, it is linked below
+        if (index->numBuckets > 2 * (index->chainMask + 1)) {
+            growLshChains(index);
+            chain = mixHash(key + band) & index->chainMask;
+        }
+    }
+    LshBucket* bucket = &index->buckets[b];
+    bucket->key = key;
+    bucket->band = band;
+    bucket->count = 0;
+    bucket->next = index->chains[chain];
+    index->chains[chain] = b;
+    return b;
+}
+
+// Function to take a user out of its bucket for one band
+void unfileUser(MinHashIndex* index, int userId, int band) {
+    int b = index->bucketOf[userId][band];
+    if (b == -1) {
+        return;
+    }
+    LshBucket* bucket = &index->buckets[b];
+    int slot = index->slotOf[userId][band];
+    int moved = bucket->users[--bucket->count];
+    bucket->users[slot] = moved;
+    index->slotOf[moved][band] = slot;
+    index->bucketOf[userId][band] = -1;
+
+    if (bucket->count == 0) {
+        // Unlink the empty bucket and keep it for reuse
+        int* link = &index->chains[mixHash(bucket->key + bucket->band) & index->chainMask];
+        while (*link != b) {
+            link = &index->buckets[*link].next;
+        }
+        *link = bucket->next;
+        bucket->next = index->freeBuckets;
+        index->freeBuckets = b;
+    }
+}
+
+// Function to file a user under the bucket matching its current signature for one band
+void fileUser(MinHashIndex* index, int userId, int band) {
+    int b = findOrCreateBucket(index, band, bandKey(index->signatures[userId], band));
+    LshBucket* bucket = &index->buckets[b];
+    if (bucket->count == bucket->capacity) {
+        bucket->capacity = bucket->capacity ? bucket->capacity * 2 : 4;
+        bucket->users = (int*)checkedAlloc(realloc(bucket->users, bucket->capacity * sizeof(int)));
+    }
+    index->bucketOf[userId][band] = b;
+    index->slotOf[userId][band] = bucket->count;
+    bucket->users[bucket->count++] = userId;
+}
+
+// Function to fold a new friend into a user's signature, refiling only the bands that changed
+void minHashAddFriend(MinHashIndex* index, int userId, int friendId) {
+    unsigned int* signature = index->signatures[userId];
+    int changedBands = 0;
+    unsigned int changed[LSH_BANDS] = {0};
+    for (int i = 0; i < MINHASH_FUNCTIONS; i++) {
+        unsigned int h = minHashFunction(i, friendId);
+        if (h < signature[i]) {
+            signature[i] = h;
+            if (!changed[i / LSH_ROWS_PER_BAND]) {
+                changed[i / LSH_ROWS_PER_BAND] = 1;
+                changedBands++;
+            }
+        }
+    }
+    for (int band = 0; changedBands > 0 && band < LSH_BANDS; band++) {
+        if (changed[band]) {
+            unfileUser(index, userId, band);
+            fileUser(index, userId, band);
+        }
+    }
+}
+
+// Function to free a MinHash index
+void freeMinHashIndex(MinHashIndex* index) {
+    for (int b = 0; b < index->numBuckets; b++) {
+        free(index->buckets[b].users);
+    }
+    free(index->buckets);
+    free(index->chains);
+    free(index->signatures);
+    free(index->bucketOf);
+    free(index->slotOf);
+    free(index);
+}
+
+// Function to create a new graph
+Graph* createGraph() {
+    Graph* graph = (Graph*)checkedAlloc(malloc(sizeof(Graph)));
+    graph->numUsers = 0;
+    graph->capacity = INITIAL_USER_CAPACITY;
+    graph->names = checkedAlloc(malloc(graph->capacity * sizeof(*graph->names)));
+    graph->adjacency = (AdjacencyList*)checkedAlloc(calloc(graph->capacity, sizeof(AdjacencyList)));
+    graph->minHash = NULL;
+    graph->indexCapacity = INITIAL_USER_CAPACITY * 2;
+    graph->nameIndex = (int*)checkedAlloc(malloc(graph->indexCapacity * sizeof(int)));
+    for (int i = 0; i < graph->indexCapacity; i++) {
+        graph->nameIndex[i] = -1;
+    }
+    return graph;
+}
+
+// Function to find a user's ID by name, or -1 if the user does not exist
+int findUser(Graph* graph, const char* name) {
+    unsigned int mask = graph->indexCapacity - 1;
+    unsigned int slot = hashName(name) & mask;
+    while (graph->nameIndex[slot] != -1) {
+        if (strcmp(graph->names[graph->nameIndex[slot]], name) == 0) {
+            return graph->nameIndex[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Function to place a user ID into the name hash table
+void indexUser(Graph* graph, int userId) {
+    unsigned int mask = graph->indexCapacity - 1;
+    unsigned int slot = hashName(graph->names[userId]) & mask;
+    while (graph->nameIndex[slot] != -1) {
+        slot = (slot + 1) & mask;
+    }
+    graph->nameIndex[slot] = userId;
+}
+
+// Function to grow user storage and the name index when the graph is full
+void growGraph(Graph* graph) {
+    int newCapacity = graph->capacity * 2;
+    graph->names = checkedAlloc(realloc(graph->names, newCapacity * sizeof(*graph->names)));
+    graph->adjacency = (AdjacencyList*)checkedAlloc(realloc(graph->adjacency, newCapacity * sizeof(AdjacencyList)));
+    memset(graph->adjacency + graph->capacity, 0, (newCapacity - graph->capacity) * sizeof(AdjacencyList));
+    graph->capacity = newCapacity;
+    if (graph->minHash != NULL) {
+        growMinHashIndex(graph->minHash, newCapacity);
+    }
+
+    // Keep the hash table at most half full
+    free(graph->nameIndex);
+    graph->indexCapacity = newCapacity * 2;
+    graph->nameIndex = (int*)checkedAlloc(malloc(graph->indexCapacity * sizeof(int)));
+    for (int i = 0; i < graph->indexCapacity; i++) {
+        graph->nameIndex[i] = -1;
+    }
+    for (int i = 0; i < graph->numUsers; i++) {
+        indexUser(graph, i);
+    }
+}
+
+// Function to add a user, returning the new user's ID or -1 if the name is taken
+int addUser(Graph* graph, const char* name) {
+    if (findUser(graph, name) != -1) {
+        return -1;
+    }
+    if (graph->numUsers == graph->capacity) {
+        growGraph(graph);
+    }
+    int userId = graph->numUsers;
+    strncpy(graph->names[userId], name, MAX_NAME_LENGTH - 1);
+    graph->names[userId][MAX_NAME_LENGTH - 1] = '\0';
+    graph->numUsers++;
+    indexUser(graph, userId);
+    return userId;
+}
+
+// Function to write an unsigned value as a varint, returning the number of bytes written
+int encodeVarint(unsigned int value, unsigned char* out) {
+    int n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+// Function to read one varint and advance the cursor
+unsigned int decodeVarint(const unsigned char** cursor) {
+    const unsigned char* p = *cursor;
+    unsigned int value = *p & 0x7F;
+    int shift = 7;
+    while (*p++ & 0x80) {
+        value |= (unsigned int)(*p & 0x7F) << shift;
+        shift += 7;
+    }
+    *cursor = p;
+    return value;
+}
+
+// Function to start iterating over a user's friends
+NeighborIterator neighbors(const Graph* graph, int userId) {
+    const AdjacencyList* list = &graph->adjacency[userId];
+    NeighborIterator it = { list->bytes, list->bytes + list->length, 0 };
+    return it;
+}
+
+// Function to fetch the next friend ID; returns 0 when the list is exhausted
+int nextNeighbor(NeighborIterator* it, int* neighborId) {
+    if (it->pos >= it->end) {
+        return 0;
+    }
+    it->current += (int)decodeVarint(&it->pos);
+    *neighborId = it->current;
+    return 1;
+}
+
+// Function to insert a friend ID into a compressed list, keeping it sorted
+// Returns 1 if inserted, 0 if the ID was already present
+int insertNeighbor(AdjacencyList* list, int neighborId) {
+    const unsigned char* p = list->bytes;
+    const unsigned char* end = list->bytes + list->length;
+    const unsigned char* successor = NULL;
+    int previous = 0, value = 0;
+
+    // Find the first neighbor greater than the new one
+    while (p < end) {
+        const unsigned char* start = p;
+        value = previous + (int)decodeVarint(&p);
+        if (value == neighborId) {
+            return 0;
+        }
+        if (value > neighborId) {
+            successor = start;
+            break;
+        }
+        previous = value;
+    }
+
+    // Re-encode the gap before the new ID and, if any, the gap after it
+    unsigned char encoded[10];
+    int encodedLength = encodeVarint((unsigned int)(neighborId - previous), encoded);
+    int offset = list->length;
+    int replacedLength = 0;
+    if (successor != NULL) {
+        offset = (int)(successor - list->bytes);
+        replacedLength = (int)(p - successor);
+        encodedLength += encodeVarint((unsigned int)(value - neighborId), encoded + encodedLength);
+    }
+
+    int newLength = list->length - replacedLength + encodedLength;
+    if (newLength > list->capacity) {
+        int newCapacity = list->capacity ? list->capacity * 2 : INITIAL_LIST_BYTES;
+        while (newCapacity < newLength) {
+            newCapacity *= 2;
+        }
+        list->bytes = (unsigned char*)checkedAlloc(realloc(list->bytes, newCapacity));
+        list->capacity = newCapacity;
+    }
+    memmove(list->bytes + offset + encodedLength, list->bytes + offset + replacedLength,
+            list->length - offset - replacedLength);
+    memcpy(list->bytes + offset, encoded, encodedLength);
+    list->length = newLength;
+    list->degree++;
+    return 1;
+}
+
+// Function to check whether two users are friends
+int areConnected(const Graph* graph, int user1Id, int user2Id) {
+    NeighborIterator it = neighbors(graph, user1Id);
+    int friendId;
+    while (nextNeighbor(&it, &friendId) && friendId <= user2Id) {
+        if (friendId == user2Id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to connect two users by ID
+// Returns 1 if connected, 0 if they already were friends, -1 for a self-connection
+int connectUsers(Graph* graph, int user1Id, int user2Id) {
+    if (user1Id == user2Id) {
+        return -1;
+    }
+    if (!insertNeighbor(&graph->adjacency[user1Id], user2Id)) {
+        return 0;
+    }
+    insertNeighbor(&graph->adjacency[user2Id], user1Id);
+    if (graph->minHash != NULL) {
+        minHashAddFriend(graph->minHash, user1Id, user2Id);
+        minHashAddFriend(graph->minHash, user2Id, user1Id);
+    }
+    return 1;
+}
+
+// Function to add a connection (friendship)
+void addConnection(Graph* graph, char* user1, char* user2) {
+    int user1Index = findUser(graph, user1);
+    int user2Index = findUser(graph, user2);
+
+    // Ensure both users exist before establishing a connection
+    if (user1Index == -1 || user2Index == -1) {
+        printf(RED "Error: Both users must exist to establish a connection.\n" RESET);
+        return;
+    }
+
+    OP_STATS_START(timer);
+    int result = connectUsers(graph, user1Index, user2Index);
+    OP_STATS_STOP(OP_ADD_CONNECTION, timer);
+    if (result == 1) {
+        printf(GREEN "Connection established between %s and %s.\n" RESET, user1, user2);
+    } else if (result == 0) {
+        printf(YELLOW "%s and %s are already connected.\n" RESET, user1, user2);
+    } else {
+        printf(RED "Error: A user cannot connect to themselves.\n" RESET);
+    }
+}
+
+// Function to order recommendations by mutual friends, then by user ID
+int compareRecommendations(const void* a, const void* b) {
+    const Recommendation* ra = (const Recommendation*)a;
+    const Recommendation* rb = (const Recommendation*)b;
+    if (ra->mutualFriends != rb->mutualFriends) {
+        return rb->mutualFriends - ra->mutualFriends;
+    }
+    return ra->userId - rb->userId;
+}
+
+// Function to compute friend-of-friend recommendations with a two-level BFS
+// Fills out (capacity graph->numUsers) and returns the number of recommendations
+int computeRecommendations(const Graph* graph, int userId, Recommendation* out) {
+    OP_STATS_START(timer);
+    // mutual[i] > 0 counts shared friends, -1 marks the user and direct friends
+    int* mutual = (int*)checkedAlloc(calloc(graph->numUsers, sizeof(int)));
+    int recCount = 0;
+    int friendId, candidateId;
+
+    // Level 1: mark the user and direct friends as visited
+    mutual[userId] = -1;
+    NeighborIterator it = neighbors(graph, userId);
+    while (nextNeighbor(&it, &friendId)) {
+        mutual[friendId] = -1;
+    }
+
+    // Level 2: count every friend-of-friend reached through a direct friend
+    it = neighbors(graph, userId);
+    while (nextNeighbor(&it, &friendId)) {
+        NeighborIterator fof = neighbors(graph, friendId);
+        while (nextNeighbor(&fof, &candidateId)) {
+            if (mutual[candidateId] < 0) {
+                continue;
+            }
+            if (mutual[candidateId] == 0) {
+                out[recCount++].userId = candidateId;
+            }
+            mutual[candidateId]++;
+        }
+    }
+
+    for (int i = 0; i < recCount; i++) {
+        out[i].mutualFriends = mutual[out[i].userId];
+    }
+    qsort(out, recCount, sizeof(Recommendation), compareRecommendations);
+    free(mutual);
+    OP_STATS_STOP(OP_RECOMMENDATIONS, timer);
+    return recCount;
+}
+
+// Function to get friend recommendations
+void getRecommendations(Graph* graph, char* user) {
+    int userIndex = findUser(graph, user);
+
+    if (userIndex == -1) {
+        printf(RED "Error: User %s not found.\n" RESET, user);
+        return;
+    }
+
+    Recommendation* recommendations = (Recommendation*)checkedAlloc(malloc(graph->numUsers * sizeof(Recommendation)));
+    int recCount = computeRecommendations(graph, userIndex, recommendations);
+
+    // Print recommendations
+    printf(YELLOW "Friend recommendations for %s:\n" RESET, user);
+    if (recCount == 0) {
+        printf(RED "None\n" RESET);
+    } else {
+        for (int i = 0; i < recCount; i++) {
+            printf(GREEN "%s" RESET " (%d mutual)\n", graph->names[recommendations[i].userId],
+                   recommendations[i].mutualFriends);
+        }
+    }
+    free(recommendations);
+}
+// Function to display the adjacency matrix
+void displayAdjacencyMatrix(Graph* graph) {
+    ReportOutput* out = reportBegin();
+    reportText(out, "\n");
+    reportStyle(out, MAGENTA);
+    reportText(out, "Adjacency Matrix:\n");
+    reportStyle(out, "");
+    reportText(out, "        ");
+    reportStyle(out, YELLOW);
+    for (int i = 0; i < graph->numUsers; i++) {
+        reportPadded(out, graph->names[i], 10);
+    }
+    reportText(out, "\n");
+
+    for (int i = 0; i < graph->numUsers; i++) {
+        reportStyle(out, CYAN);
+        reportPadded(out, graph->names[i], 10);
+
+        // Friend IDs decode in ascending order, so one pass covers the whole row
+        NeighborIterator it = neighbors(graph, i);
+        int nextFriend = -1;
+        if (!nextNeighbor(&it, &nextFriend)) {
+            nextFriend = -1;
+        }
+        for (int j = 0; j < graph->numUsers; j++) {
+            // Print the connection status; a run of zeros shares one color change
+            if (j == nextFriend) {
+                reportStyle(out, GREEN);
+                reportText(out, "1         "); // Connection exists
+                if (!nextNeighbor(&it, &nextFriend)) {
+                    nextFriend = -1;
+                }
+            } else {
+                reportStyle(out, RED);
+                reportText(out, "0         "); // No connection
+            }
+        }
+        reportText(out, "\n");
+    }
+    reportEnd(out);
+}
+
+// Function to display connections
+void displayConnections(Graph* graph) {
+    ReportOutput* out = reportBegin();
+    reportText(out, "\n");
+    reportStyle(out, MAGENTA);
+    reportText(out, "Connections:\n");
+    for (int i = 0; i < graph->numUsers; i++) {
+        reportStyle(out, YELLOW);
+        reportText(out, graph->names[i]);
+        reportText(out, ":");
+
+        NeighborIterator it = neighbors(graph, i);
+        int friendId;
+        if (!nextNeighbor(&it, &friendId)) {
+            reportStyle(out, RED);
+            reportText(out, " No connections\n"); // No connections
+        } else {
+            reportStyle(out, "");
+            reportText(out, " ");
+            reportStyle(out, GREEN);
+            reportText(out, graph->names[friendId]); // Print friends in green
+            while (nextNeighbor(&it, &friendId)) {
+                reportStyle(out, "");
+                reportText(out, ", "); // Separate friends with a comma
+                reportStyle(out, GREEN);
+                reportText(out, graph->names[friendId]);
+            }
+            reportStyle(out, "");
+            reportText(out, "\n");
+        }
+    }
+    reportEnd(out);
+}
+
+// Function to free the graph and all friend lists
+void freeGraph(Graph* graph) {
+    for (int i = 0; i < graph->numUsers; i++) {
+        free(graph->adjacency[i].bytes);
+    }
+    free(graph->adjacency);
+    free(graph->names);
+    free(graph->nameIndex);
+    if (graph->minHash != NULL) {
+        freeMinHashIndex(graph->minHash);
+    }
+    free(graph);
+}
+
+// ---------------------------------------------------------------------------
+// Versioned graph: concurrent edge ingestion while readers keep querying.
+// Readers work on an immutable snapshot (compressed CSR base + sorted delta
+// segments) and never take a lock; retired snapshots are freed through
+// epoch-based reclamation once no reader can still see them.
+// ---------------------------------------------------------------------------
+
+// Structure to represent an immutable compressed CSR: every friend list packed into one byte array
+typedef struct CompressedCSR {
+    int numUsers;
+    long* offsets;          // numUsers + 1 byte offsets into bytes
+    unsigned char* bytes;   // Delta + varint encoded lists, same encoding as AdjacencyList
+} CompressedCSR;
+
+// Structure to represent one direction of a friendship
+typedef struct DirectedEdge {
+    int from;
+    int to;
+} DirectedEdge;
+
+// Structure to represent an immutable batch of new friendships, sorted by (from, to)
+typedef struct DeltaSegment {
+    DirectedEdge* edges;    // Both directions of every new friendship
+    int count;
+} DeltaSegment;
+
+// Structure to represent one published snapshot of the graph
+typedef struct GraphVersion {
+    CompressedCSR* base;
+    DeltaSegment** segments;  // Owned array; the segments themselves are shared between versions
+    int numSegments;
+    int numUsers;
+} GraphVersion;
+
+// Structure to represent an object waiting until no reader can reference it
+typedef struct RetiredObject {
+    void* object;
+    void (*destroy)(void*);
+    unsigned long epoch;      // Global epoch when the object was unlinked
+    struct RetiredObject* next;
+} RetiredObject;
+
+// Structure to represent the versioned graph shared by one writer side and many readers
+typedef struct VersionedGraph {
+    _Atomic(GraphVersion*) current;
+    atomic_ulong globalEpoch;
+    atomic_ulong readerEpochs[MAX_READER_THREADS]; // 0 = reader slot is outside a read section
+
+    pthread_mutex_t writerLock;   // Serializes writers only; readers never touch it
+    DirectedEdge* pending;        // Edges not yet sealed into a delta segment
+    int pendingCount;
+    RetiredObject* retired;
+    long mergeCount;
+} VersionedGraph;
+
+// Function to build a compressed CSR from the mutable graph; the encodings are copied as-is
+CompressedCSR* buildCSRFromGraph(const Graph* graph) {
+    CompressedCSR* csr = (CompressedCSR*)checkedAlloc(malloc(sizeof(CompressedCSR)));
+    csr->numUsers = graph->numUsers;
+    csr->offsets = (long*)checkedAlloc(malloc((graph->numUsers + 1) * sizeof(long)));
+    csr->offsets[0] = 0;
+    for (int i = 0; i < graph->numUsers; i++) {
+        csr->offsets[i + 1] = csr->offsets[i] + graph->adjacency[i].length;
+    }
+    csr->bytes = (unsigned char*)checkedAlloc(malloc(csr->offsets[graph->numUsers] + 1));
+    for (int i = 0; i < graph->numUsers; i++) {
+        if (graph->adjacency[i].length > 0) { // A user with no friends may have no byte array at all
+            memcpy(csr->bytes + csr->offsets[i], graph->adjacency[i].bytes, graph->adjacency[i].length);
+        }
+    }
+    return csr;
+}
+
+// Function to free a compressed CSR
+void freeCSR(void* object) {
+    CompressedCSR* csr = (CompressedCSR*)object;
+    free(csr->offsets);
+    free(csr->bytes);
+    free(csr);
+}
+
+// Function to free a delta segment
+void freeDeltaSegment(void* object) {
+    DeltaSegment* segment = (DeltaSegment*)object;
+    free(segment->edges);
+    free(segment);
+}
+
+// Function to free a version record (base and segments are retired separately)
+void freeGraphVersion(void* object) {
+    GraphVersion* version = (GraphVersion*)object;
+    free(version->segments);
+    free(version);
+}
+
+// Function to start iterating over a user's friends in a compressed CSR
+NeighborIterator csrNeighbors(const CompressedCSR* csr, int userId) {
+    NeighborIterator it = { NULL, NULL, 0 };
+    if (userId < csr->numUsers) {
+        it.pos = csr->bytes + csr->offsets[userId];
+        it.end = csr->bytes + csr->offsets[userId + 1];
+    }
+    return it;
+}
+
+// Function to find the first edge in a segment leaving userId (binary search)
+int segmentLowerBound(const DeltaSegment* segment, int userId) {
+    int low = 0, high = segment->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (segment->edges[mid].from < userId) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Structure to iterate a user's friends across the base CSR and every delta segment
+typedef struct SnapshotIterator {
+    const GraphVersion* version;
+    NeighborIterator baseIt;
+    int userId;
+    int segment;       // Segment currently being scanned
+    int position;      // Edge index inside that segment
+} SnapshotIterator;
+
+// Function to start iterating over a user's friends in a snapshot
+SnapshotIterator snapshotNeighbors(const GraphVersion* version, int userId) {
+    SnapshotIterator it;
+    it.version = version;
+    it.baseIt = csrNeighbors(version->base, userId);
+    it.userId = userId;
+    it.segment = -1;
+    it.position = 0;
+    return it;
+}
+
+// Function to fetch the next friend in a snapshot; returns 0 when exhausted
+int nextSnapshotNeighbor(SnapshotIterator* it, int* neighborId) {
+    if (it->segment < 0) {
+        if (nextNeighbor(&it->baseIt, neighborId)) {
+            return 1;
+        }
+        it->segment = 0;
+        it->position = it->version->numSegments > 0 ? segmentLowerBound(it->version->segments[0], it->userId) : 0;
+    }
+    while (it->segment < it->version->numSegments) {
+        const DeltaSegment* segment = it->version->segments[it->segment];
+        if (it->position < segment->count && segment->edges[it->position].from == it->userId) {
+            *neighborId = segment->edges[it->position++].to;
+            return 1;
+        }
+        if (++it->segment < it->version->numSegments) {
+            it->position = segmentLowerBound(it->version->segments[it->segment], it->userId);
+        }
+    }
+    return 0;
+}
+
+// Function to check whether an edge exists in a snapshot
+int snapshotHasEdge(const GraphVersion* version, int from, int to) {
+    NeighborIterator it = csrNeighbors(version->base, from);
+    int friendId;
+    while (nextNeighbor(&it, &friendId) && friendId <= to) {
+        if (friendId == to) {
+            return 1;
+        }
+    }
+    for (int s = 0; s < version->numSegments; s++) {
+        const DeltaSegment* segment = version->segments[s];
+        for (int i = segmentLowerBound(segment, from); i < segment->count && segment->edges[i].from == from; i++) {
+            if (segment->edges[i].to == to) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Function to create a versioned graph whose first snapshot is the current graph
+VersionedGraph* createVersionedGraph(const Graph* graph) {
+    VersionedGraph* vg = (VersionedGraph*)checkedAlloc(calloc(1, sizeof(VersionedGraph)));
+    GraphVersion* version = (GraphVersion*)checkedAlloc(calloc(1, sizeof(GraphVersion)));
+    version->base = buildCSRFromGraph(graph);
+    version->numUsers = graph->numUsers;
+    atomic_init(&vg->current, version);
+    atomic_init(&vg->globalEpoch, 1);
+    for (int i = 0; i < MAX_READER_THREADS; i++) {
+        atomic_init(&vg->readerEpochs[i], 0);
+    }
+    pthread_mutex_init(&vg->writerLock, NULL);
+    vg->pending = (DirectedEdge*)checkedAlloc(malloc(2 * DELTA_BATCH_EDGES * sizeof(DirectedEdge)));
+    return vg;
+}
+
+// Function to enter a read section and get a consistent snapshot; never blocks
+const GraphVersion* beginRead(VersionedGraph* vg, int readerSlot) {
+    atomic_store(&vg->readerEpochs[readerSlot], atomic_load(&vg->globalEpoch));
+    return atomic_load(&vg->current);
+}
+
+// Function to leave a read section; the snapshot must not be used afterwards
+void endRead(VersionedGraph* vg, int readerSlot) {
+    atomic_store_explicit(&vg->readerEpochs[readerSlot], 0, memory_order_release);
+}
+
+// Function to queue an unlinked object for freeing once all readers have moved on (writer lock held)
+void retireObject(VersionedGraph* vg, void* object, void (*destroy)(void*)) {
+    RetiredObject* retired = (RetiredObject*)checkedAlloc(malloc(sizeof(RetiredObject)));
+    retired->object = object;
+    retired->destroy = destroy;
+    retired->epoch = atomic_load(&vg->globalEpoch);
+    retired->next = vg->retired;
+    vg->retired = retired;
+}
+
+// Function to advance the epoch and free everything no active reader can still hold (writer lock held)
+void reclaimRetired(VersionedGraph* vg) {
+    atomic_fetch_add(&vg->globalEpoch, 1);
+
+    // A reader that entered at epoch e may hold anything retired at epoch >= e
+    unsigned long oldestActive = ~0UL;
+    for (int i = 0; i < MAX_READER_THREADS; i++) {
+        unsigned long epoch = atomic_load(&vg->readerEpochs[i]);
+        if (epoch != 0 && epoch < oldestActive) {
+            oldestActive = epoch;
+        }
+    }
+
+    RetiredObject** link = &vg->retired;
+    while (*link != NULL) {
+        RetiredObject* retired = *link;
+        if (retired->epoch < oldestActive) {
+            *link = retired->next;
+            retired->destroy(retired->object);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
+
+// Function to order directed edges by (from, to)
+int compareDirectedEdges(const void* a, const void* b) {
+    const DirectedEdge* ea = (const DirectedEdge*)a;
+    const DirectedEdge* eb = (const DirectedEdge*)b;
+    if (ea->from != eb->from) {
+        return ea->from < eb->from ? -1 : 1;
+    }
+    return (ea->to > eb->to) - (ea->to < eb->to);
+}
+
+// Function to seal pending edges into a new delta segment and publish it (writer lock held)
+void sealPendingEdges(VersionedGraph* vg) {
+    if (vg->pendingCount == 0) {
+        return;
+    }
+    GraphVersion* old = atomic_load(&vg->current);
+
+    // Sort, drop duplicates inside the batch and friendships the snapshot already has
+    qsort(vg->pending, vg->pendingCount, sizeof(DirectedEdge), compareDirectedEdges);
+    DeltaSegment* segment = (DeltaSegment*)checkedAlloc(malloc(sizeof(DeltaSegment)));
+    segment->edges = (DirectedEdge*)checkedAlloc(malloc(vg->pendingCount * sizeof(DirectedEdge)));
+    segment->count = 0;
+    int numUsers = old->numUsers;
+    for (int i = 0; i < vg->pendingCount; i++) {
+        DirectedEdge edge = vg->pending[i];
+        if (i > 0 && compareDirectedEdges(&edge, &vg->pending[i - 1]) == 0) {
+            continue;
+        }
+        if (edge.from < old->numUsers && edge.to < old->numUsers && snapshotHasEdge(old, edge.from, edge.to)) {
+            continue;
+        }
+        segment->edges[segment->count++] = edge;
+        if (edge.from >= numUsers) {
+            numUsers = edge.from + 1;
+        }
+    }
+    vg->pendingCount = 0;
+    if (segment->count == 0) {
+        freeDeltaSegment(segment);
+        return;
+    }
+
+    GraphVersion* version = (GraphVersion*)checkedAlloc(malloc(sizeof(GraphVersion)));
+    version->base = old->base;
+    version->numSegments = old->numSegments + 1;
+    version->segments = (DeltaSegment**)checkedAlloc(malloc(version->numSegments * sizeof(DeltaSegment*)));
+    if (old->numSegments > 0) {
+        memcpy(version->segments, old->segments, old->numSegments * sizeof(DeltaSegment*));
+    }
+    version->segments[old->numSegments] = segment;
+    version->numUsers = numUsers;
+
+    atomic_store(&vg->current, version);
+    retireObject(vg, old, freeGraphVersion);
+    reclaimRetired(vg);
+}
+
+// Function to compare two ints for qsort
+int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to merge all delta segments into a new base CSR and publish it (writer lock held)
+void mergeDeltaSegments(VersionedGraph* vg) {
+    GraphVersion* old = atomic_load(&vg->current);
+    if (old->numSegments == 0) {
+        return;
+    }
+
+    CompressedCSR* csr = (CompressedCSR*)checkedAlloc(malloc(sizeof(CompressedCSR)));
+    csr->numUsers = old->numUsers;
+    csr->offsets = (long*)checkedAlloc(malloc((old->numUsers + 1) * sizeof(long)));
+    long byteCapacity = old->base->offsets[old->base->numUsers] + 64;
+    for (int s = 0; s < old->numSegments; s++) {
+        byteCapacity += 5L * old->segments[s]->count;
+    }
+    csr->bytes = (unsigned char*)checkedAlloc(malloc(byteCapacity));
+
+    int* list = NULL;
+    int listCapacity = 0;
+    long length = 0;
+    for (int u = 0; u < old->numUsers; u++) {
+        // Gather base and delta friends, then re-encode them as one sorted list
+        int count = 0;
+        SnapshotIterator it = snapshotNeighbors(old, u);
+        int friendId;
+        while (nextSnapshotNeighbor(&it, &friendId)) {
+            if (count == listCapacity) {
+                listCapacity = listCapacity ? listCapacity * 2 : 64;
+                list = (int*)checkedAlloc(realloc(list, listCapacity * sizeof(int)));
+            }
+            list[count++] = friendId;
+        }
+        qsort(list, count, sizeof(int), compareInts);
+
+        csr->offsets[u] = length;
+        int previous = 0;
+        for (int i = 0; i < count; i++) {
+            length += encodeVarint((unsigned int)(list[i] - previous), csr->bytes + length);
+            previous = list[i];
+        }
+    }
+    csr->offsets[old->numUsers] = length;
+    free(list);
+
+    GraphVersion* version = (GraphVersion*)checkedAlloc(calloc(1, sizeof(GraphVersion)));
+    version->base = csr;
+    version->numUsers = old->numUsers;
+
+    atomic_store(&vg->current, version);
+    retireObject(vg, old->base, freeCSR);
+    for (int s = 0; s < old->numSegments; s++) {
+        retireObject(vg, old->segments[s], freeDeltaSegment);
+    }
+    retireObject(vg, old, freeGraphVersion);
+    vg->mergeCount++;
+    reclaimRetired(vg);
+}
+
+// Function to add a friendship to the versioned graph; visible to readers once its batch is sealed
+void versionedAddConnection(VersionedGraph* vg, int user1Id, int user2Id) {
+    if (user1Id == user2Id) {
+        return;
+    }
+    OP_STATS_START(timer);
+    pthread_mutex_lock(&vg->writerLock);
+    vg->pending[vg->pendingCount].from = user1Id;
+    vg->pending[vg->pendingCount++].to = user2Id;
+    vg->pending[vg->pendingCount].from = user2Id;
+    vg->pending[vg->pendingCount++].to = user1Id;
+    if (vg->pendingCount >= 2 * DELTA_BATCH_EDGES) {
+        sealPendingEdges(vg);
+        if (atomic_load(&vg->current)->numSegments >= MERGE_DELTA_SEGMENTS) {
+            mergeDeltaSegments(vg);
+        }
+    }
+    pthread_mutex_unlock(&vg->writerLock);
+    OP_STATS_STOP(OP_LIVE_ADD_CONNECTION, timer);
+}
+
+// Function to publish every pending friendship immediately
+void versionedFlush(VersionedGraph* vg) {
+    pthread_mutex_lock(&vg->writerLock);
+    sealPendingEdges(vg);
+    pthread_mutex_unlock(&vg->writerLock);
+}
+
+// Function to free the versioned graph (no readers or writers may be running)
+void freeVersionedGraph(VersionedGraph* vg) {
+    GraphVersion* version = atomic_load(&vg->current);
+    freeCSR(version->base);
+    for (int s = 0; s < version->numSegments; s++) {
+        freeDeltaSegment(version->segments[s]);
+    }
+    freeGraphVersion(version);
+    while (vg->retired != NULL) {
+        RetiredObject* retired = vg->retired;
+        vg->retired = retired->next;
+        retired->destroy(retired->object);
+        free(retired);
+    }
+    pthread_mutex_destroy(&vg->writerLock);
+    free(vg->pending);
+    free(vg);
+}
 
-// Structure to represent a graph
-typedef struct Graph {
-    Node* adjacencyList[MAX_USERS];
+// Function to compute recommendations on a snapshot, same ranking as computeRecommendations
+// Fills out (capacity version->numUsers) and returns the number of recommendations
+int computeSnapshotRecommendations(const GraphVersion* version, int userId, Recommendation* out) {
+    OP_STATS_START(timer);
+    int* mutual = (int*)checkedAlloc(calloc(version->numUsers, sizeof(int)));
+    int recCount = 0;
+    int friendId, candidateId;
+
+    mutual[userId] = -1;
+    SnapshotIterator it = snapshotNeighbors(version, userId);
+    while (nextSnapshotNeighbor(&it, &friendId)) {
+        mutual[friendId] = -1;
+    }
+
+    it = snapshotNeighbors(version, userId);
+    while (nextSnapshotNeighbor(&it, &friendId)) {
+        SnapshotIterator fof = snapshotNeighbors(version, friendId);
+        while (nextSnapshotNeighbor(&fof, &candidateId)) {
+            if (mutual[candidateId] < 0) {
+                continue;
+            }
+            if (mutual[candidateId] == 0) {
+                out[recCount++].userId = candidateId;
+            }
+            mutual[candidateId]++;
+        }
+    }
+
+    for (int i = 0; i < recCount; i++) {
+        out[i].mutualFriends = mutual[out[i].userId];
+    }
+    qsort(out, recCount, sizeof(Recommendation), compareRecommendations);
+    free(mutual);
+    OP_STATS_STOP(OP_SNAPSHOT_RECOMMENDATIONS, timer);
+    return recCount;
+}
+
+// Structure to hold the arguments and results of one stream demo thread
+typedef struct StreamWorker {
+    VersionedGraph* vg;
+    int slot;                 // Reader slot for query threads
     int numUsers;
-} Graph;
+    long operations;          // Edges ingested or queries served
+    atomic_int* running;
+    unsigned int seed;
+} StreamWorker;
 
-// Function to create a new graph
-Graph* createGraph() {
-    Graph* graph = (Graph*)malloc(sizeof(Graph));
-    graph->numUsers = 0;
-    for (int i = 0; i < MAX_USERS; i++) {
-        graph->adjacencyList[i] = NULL;
+// Function to ingest random friendships until the edge budget is spent
+void* streamWriter(void* arg) {
+    StreamWorker* worker = (StreamWorker*)arg;
+    for (long i = 0; i < worker->operations; i++) {
+        int a = rand_r(&worker->seed) % worker->numUsers;
+        int b = rand_r(&worker->seed) % worker->numUsers;
+        versionedAddConnection(worker->vg, a, b);
     }
-    return graph;
+    versionedFlush(worker->vg);
+    atomic_store(worker->running, 0);
+    return NULL;
 }
 
-// Function to add a user
-void addUser(Graph* graph, char* name) {
-    if (graph->numUsers < MAX_USERS) {
-        Node* newUser = (Node*)malloc(sizeof(Node));
-        strcpy(newUser->name, name);
-        newUser->next = graph->adjacencyList[graph->numUsers];
-        graph->adjacencyList[graph->numUsers] = newUser;
-        graph->numUsers++;
+// Function to serve recommendation queries on snapshots while the writer runs
+void* streamReader(void* arg) {
+    StreamWorker* worker = (StreamWorker*)arg;
+    Recommendation* out = NULL;
+    int outCapacity = 0;
+    worker->operations = 0;
+    while (atomic_load(worker->running)) {
+        const GraphVersion* version = beginRead(worker->vg, worker->slot);
+        if (version->numUsers > outCapacity) {
+            outCapacity = version->numUsers;
+            out = (Recommendation*)checkedAlloc(realloc(out, outCapacity * sizeof(Recommendation)));
+        }
+        computeSnapshotRecommendations(version, rand_r(&worker->seed) % version->numUsers, out);
+        endRead(worker->vg, worker->slot);
+        worker->operations++;
     }
+    free(out);
+    return NULL;
 }
 
-// Function to add a connection (friendship)
-void addConnection(Graph* graph, char* user1, char* user2) {
-    int user1Index = -1, user2Index = -1;
-    
-    // Find indices of user1 and user2
-    for (int i = 0; i < graph->numUsers; i++) {
-        if (strcmp(graph->adjacencyList[i]->name, user1) == 0) {
-            user1Index = i;
+// Function to return monotonic time in seconds
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to run the live ingestion demo: one writer streams edges while readers query
+// Usage: stream [users] [edges] [readers]
+int runStreamDemo(int argc, char* argv[]) {
+    int numUsers = argc > 2 ? atoi(argv[2]) : 10000;
+    long numEdges = argc > 3 ? atol(argv[3]) : 200000;
+    int numReaders = argc > 4 ? atoi(argv[4]) : 4;
+    if (numUsers < 2 || numEdges < 0 || numReaders < 1 || numReaders > MAX_READER_THREADS) {
+        printf(RED "Usage: stream [users >= 2] [edges] [readers 1-%d]\n" RESET, MAX_READER_THREADS);
+        return 1;
+    }
+
+    Graph* graph = createGraph();
+    char name[MAX_NAME_LENGTH];
+    for (int i = 0; i < numUsers; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        addUser(graph, name);
+    }
+    VersionedGraph* vg = createVersionedGraph(graph);
+    freeGraph(graph);
+
+    atomic_int running;
+    atomic_init(&running, 1);
+    StreamWorker writer = { vg, -1, numUsers, numEdges, &running, 12345 };
+    StreamWorker* readers = (StreamWorker*)checkedAlloc(calloc(numReaders, sizeof(StreamWorker)));
+    pthread_t writerThread;
+    pthread_t* readerThreads = (pthread_t*)checkedAlloc(malloc(numReaders * sizeof(pthread_t)));
+
+    double start = nowSeconds();
+    for (int i = 0; i < numReaders; i++) {
+        StreamWorker reader = { vg, i, numUsers, 0, &running, 777u + i };
+        readers[i] = reader;
+        pthread_create(&readerThreads[i], NULL, streamReader, &readers[i]);
+    }
+    pthread_create(&writerThread, NULL, streamWriter, &writer);
+    pthread_join(writerThread, NULL);
+    for (int i = 0; i < numReaders; i++) {
+        pthread_join(readerThreads[i], NULL);
+    }
+    double elapsed = nowSeconds() - start;
+
+    long queries = 0;
+    for (int i = 0; i < numReaders; i++) {
+        queries += readers[i].operations;
+    }
+    const GraphVersion* final = atomic_load(&vg->current);
+    long storedEdges = final->base->offsets[final->base->numUsers];
+    printf(BOLD "Live ingestion: %d users, %ld edges streamed, %d readers\n" RESET, numUsers, numEdges, numReaders);
+    printf(GREEN "Ingestion: %.0f edges/s\n" RESET, numEdges / elapsed);
+    printf(GREEN "Queries:   %.0f recommendations/s (%ld total)\n" RESET, queries / elapsed, queries);
+    printf(CYAN "Merges into base CSR: %ld, delta segments pending: %d, base size: %ld bytes\n" RESET,
+           vg->mergeCount, final->numSegments, storedEdges);
+
+    freeVersionedGraph(vg);
+    free(readers);
+    free(readerThreads);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Sharded mode: users are hash-partitioned (user ID modulo shard count) across
+// worker processes. The coordinator talks to each worker over a Unix socket
+// pair and batches every cross-shard request for a whole group of queries.
+// ---------------------------------------------------------------------------
+
+// Message types understood by a shard worker
+enum ShardMessageType {
+    SHARD_ADD_EDGES = 1,   // Payload: (from, to) pairs; "from" is owned by the shard
+    SHARD_FRIENDS,         // Payload: (tag, user) pairs; reply: (tag, degree, friends...) per user
+    SHARD_EXPAND,          // Payload: (tag, count, friends...) groups; reply: (tag, candidates, (candidate, mutual)...) groups
+    SHARD_QUIT
+};
+
+// Structure to represent a message header; "count" ints of payload follow
+typedef struct ShardHeader {
+    int type;
+    int count;
+} ShardHeader;
+
+// Structure to represent a growable int buffer used to build message payloads
+typedef struct IntBuffer {
+    int* data;
+    int count;
+    int capacity;
+} IntBuffer;
+
+// Structure to represent the coordinator's view of one worker process
+typedef struct ShardLink {
+    int fd;
+    pid_t pid;
+    IntBuffer outgoing;
+} ShardLink;
+
+// Function to append one int to a buffer
+void pushInt(IntBuffer* buffer, int value) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        buffer->data = (int*)checkedAlloc(realloc(buffer->data, buffer->capacity * sizeof(int)));
+    }
+    buffer->data[buffer->count++] = value;
+}
+
+// Function to write a whole buffer to a socket, retrying on short writes
+void writeAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written <= 0) {
+            perror("shard write");
+            exit(1);
         }
-        if (strcmp(graph->adjacencyList[i]->name, user2) == 0) {
-            user2Index = i;
+        p += written;
+        size -= written;
+    }
+}
+
+// Function to read exactly size bytes from a socket
+void readAll(int fd, void* data, size_t size) {
+    char* p = (char*)data;
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got <= 0) {
+            perror("shard read");
+            exit(1);
         }
+        p += got;
+        size -= got;
     }
+}
 
-    // Ensure both users exist before establishing a connection
-    if (user1Index != -1 && user2Index != -1) {
-        Node* newFriend = (Node*)malloc(sizeof(Node));
-        strcpy(newFriend->name, user2);
-        newFriend->next = graph->adjacencyList[user1Index]->next;
-        graph->adjacencyList[user1Index]->next = newFriend;
-        
-        // Add the reverse connection
-        newFriend = (Node*)malloc(sizeof(Node));
-        strcpy(newFriend->name, user1);
-        newFriend->next = graph->adjacencyList[user2Index]->next;
-        graph->adjacencyList[user2Index]->next = newFriend;
+// Function to send one message with its payload
+void sendShardMessage(int fd, int type, const IntBuffer* payload) {
+    ShardHeader header = { type, payload ? payload->count : 0 };
+    writeAll(fd, &header, sizeof(header));
+    if (header.count > 0) {
+        writeAll(fd, payload->data, header.count * sizeof(int));
+    }
+}
 
-        printf(GREEN "Connection established between %s and %s.\n" RESET, user1, user2);
-    } else {
-        printf(RED "Error: Both users must exist to establish a connection.\n" RESET);
+// Function to receive one message, reusing the buffer's storage for the payload
+int receiveShardMessage(int fd, IntBuffer* payload) {
+    ShardHeader header;
+    readAll(fd, &header, sizeof(header));
+    if (header.count > payload->capacity) {
+        payload->capacity = header.count;
+        payload->data = (int*)checkedAlloc(realloc(payload->data, payload->capacity * sizeof(int)));
+    }
+    payload->count = header.count;
+    if (header.count > 0) {
+        readAll(fd, payload->data, header.count * sizeof(int));
     }
+    return header.type;
 }
 
-// DFS function to find recommendations
-// Revised DFS function for finding friend recommendations
-void dfs(Graph* graph, int index, int* visited, char recommendations[][MAX_NAME_LENGTH], int* recCount, char* user) {
-    Node* current = graph->adjacencyList[index]->next;
+// Function to map a user to the shard that owns it
+int shardOf(int userId, int numShards) {
+    return userId % numShards;
+}
 
-    while (current != NULL) {
-        // Check if the current friend is the user or already visited
-        if (strcmp(current->name, user) != 0 && !visited[index]) {
-            // Check if the recommendation is already present
-            int found = 0;
-            for (int j = 0; j < *recCount; j++) {
-                if (strcmp(recommendations[j], current->name) == 0) {
-                    found = 1;
-                    break;
+// Function to run a shard worker: owns the friend lists of its users and answers batched requests
+void runShardWorker(int fd, int shard, int numShards, int numUsers) {
+    int localUsers = (numUsers - shard + numShards - 1) / numShards;
+    AdjacencyList* lists = (AdjacencyList*)checkedAlloc(calloc(localUsers > 0 ? localUsers : 1, sizeof(AdjacencyList)));
+    int* mutual = (int*)checkedAlloc(calloc(numUsers, sizeof(int)));
+    int* touched = (int*)checkedAlloc(malloc(numUsers * sizeof(int)));
+    IntBuffer request = { NULL, 0, 0 };
+    IntBuffer reply = { NULL, 0, 0 };
+
+    while (1) {
+        int type = receiveShardMessage(fd, &request);
+        reply.count = 0;
+        if (type == SHARD_ADD_EDGES) {
+            for (int i = 0; i + 1 < request.count; i += 2) {
+                insertNeighbor(&lists[request.data[i] / numShards], request.data[i + 1]);
+            }
+            continue; // No reply: loading is one-way
+        } else if (type == SHARD_FRIENDS) {
+            for (int i = 0; i + 1 < request.count; i += 2) {
+                AdjacencyList* list = &lists[request.data[i + 1] / numShards];
+                pushInt(&reply, request.data[i]);
+                pushInt(&reply, list->degree);
+                NeighborIterator it = { list->bytes, list->bytes + list->length, 0 };
+                int friendId;
+                while (nextNeighbor(&it, &friendId)) {
+                    pushInt(&reply, friendId);
                 }
             }
-            if (!found) {
-                strcpy(recommendations[*recCount], current->name);
-                (*recCount)++;
+        } else if (type == SHARD_EXPAND) {
+            // Pre-aggregate mutual counts per query so only distinct candidates cross the socket
+            int i = 0;
+            while (i < request.count) {
+                int tag = request.data[i], count = request.data[i + 1];
+                int touchedCount = 0;
+                for (int k = 0; k < count; k++) {
+                    AdjacencyList* list = &lists[request.data[i + 2 + k] / numShards];
+                    NeighborIterator it = { list->bytes, list->bytes + list->length, 0 };
+                    int candidateId;
+                    while (nextNeighbor(&it, &candidateId)) {
+                        if (mutual[candidateId]++ == 0) {
+                            touched[touchedCount++] = candidateId;
+                        }
+                    }
+                }
+                pushInt(&reply, tag);
+                pushInt(&reply, touchedCount);
+                for (int k = 0; k < touchedCount; k++) {
+                    pushInt(&reply, touched[k]);
+                    pushInt(&reply, mutual[touched[k]]);
+                    mutual[touched[k]] = 0;
+                }
+                i += 2 + count;
             }
+        } else {
+            break;
         }
-        current = current->next;
+        sendShardMessage(fd, type, &reply);
     }
-}
 
-// Function to get friend recommendations
-void getRecommendations(Graph* graph, char* user) {
-    int userIndex = -1;
+    for (int i = 0; i < localUsers; i++) {
+        free(lists[i].bytes);
+    }
+    free(lists);
+    free(mutual);
+    free(touched);
+    free(request.data);
+    free(reply.data);
+    close(fd);
+}
 
-    // Check if the user exists
-    for (int i = 0; i < graph->numUsers; i++) {
-        if (strcmp(graph->adjacencyList[i]->name, user) == 0) {
-            userIndex = i;
-            break;
+// Function to fork one worker process per shard
+ShardLink* startShards(int numShards, int numUsers) {
+    ShardLink* shards = (ShardLink*)checkedAlloc(calloc(numShards, sizeof(ShardLink)));
+    fflush(stdout);
+    for (int s = 0; s < numShards; s++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            for (int i = 0; i < s; i++) {
+                close(shards[i].fd);
+            }
+            runShardWorker(fds[1], s, numShards, numUsers);
+            _exit(0);
         }
+        close(fds[1]);
+        shards[s].fd = fds[0];
+        shards[s].pid = pid;
     }
+    return shards;
+}
 
-    if (userIndex == -1) {
-        printf(RED "Error: User %s not found.\n" RESET, user);
-        return;
+// Function to queue a friendship for its two owner shards, flushing full batches
+void shardAddConnection(ShardLink* shards, int numShards, int user1Id, int user2Id) {
+    ShardLink* owner1 = &shards[shardOf(user1Id, numShards)];
+    ShardLink* owner2 = &shards[shardOf(user2Id, numShards)];
+    pushInt(&owner1->outgoing, user1Id);
+    pushInt(&owner1->outgoing, user2Id);
+    pushInt(&owner2->outgoing, user2Id);
+    pushInt(&owner2->outgoing, user1Id);
+    for (int s = 0; s < numShards; s++) {
+        if (shards[s].outgoing.count >= 2 * DELTA_BATCH_EDGES) {
+            sendShardMessage(shards[s].fd, SHARD_ADD_EDGES, &shards[s].outgoing);
+            shards[s].outgoing.count = 0;
+        }
     }
+}
 
-    int visited[MAX_USERS] = {0};
-    char recommendations[MAX_USERS][MAX_NAME_LENGTH];
-    int recCount = 0;
+// Function to send each shard's queued payload as one message; sent[s] is set for shards that were sent one
+void flushShardRequests(ShardLink* shards, int numShards, int type, int* sent, long* bytesMoved) {
+    for (int s = 0; s < numShards; s++) {
+        sent[s] = shards[s].outgoing.count > 0;
+        if (!sent[s]) {
+            continue;
+        }
+        sendShardMessage(shards[s].fd, type, &shards[s].outgoing);
+        *bytesMoved += sizeof(ShardHeader) + shards[s].outgoing.count * sizeof(int);
+        shards[s].outgoing.count = 0;
+    }
+}
 
-    // Mark direct friends as visited and perform DFS
-    Node* current = graph->adjacencyList[userIndex]->next;
+// Function to answer a batch of recommendation queries across all shards
+// Two request rounds per batch: friend lists from the query owners, then candidate counts from the friend owners
+// results[q] receives the number of recommendations for queries[q]; topUser[q] the best one (-1 if none)
+void shardRecommendBatch(ShardLink* shards, int numShards, int numUsers, const int* queries, int numQueries,
+                         int* results, int* topUser, long* bytesMoved) {
+    int* sent = (int*)checkedAlloc(malloc(numShards * sizeof(int)));
+    IntBuffer reply = { NULL, 0, 0 };
+    IntBuffer* friends = (IntBuffer*)checkedAlloc(calloc(numQueries, sizeof(IntBuffer)));
 
-    // Mark the user as visited
-    visited[userIndex] = 1;
+    // Round 1: each query's friend list from the shard that owns the user
+    for (int q = 0; q < numQueries; q++) {
+        ShardLink* owner = &shards[shardOf(queries[q], numShards)];
+        pushInt(&owner->outgoing, q);
+        pushInt(&owner->outgoing, queries[q]);
+    }
+    flushShardRequests(shards, numShards, SHARD_FRIENDS, sent, bytesMoved);
+    for (int s = 0; s < numShards; s++) {
+        if (!sent[s]) {
+            continue;
+        }
+        receiveShardMessage(shards[s].fd, &reply);
+        *bytesMoved += sizeof(ShardHeader) + reply.count * sizeof(int);
+        int i = 0;
+        while (i < reply.count) {
+            int tag = reply.data[i], degree = reply.data[i + 1];
+            for (int k = 0; k < degree; k++) {
+                pushInt(&friends[tag], reply.data[i + 2 + k]);
+            }
+            i += 2 + degree;
+        }
+    }
 
-    while (current != NULL) {
-        int friendIndex = -1;
+    // Round 2: group every query's friends by owner shard into one request per shard
+    for (int q = 0; q < numQueries; q++) {
+        for (int s = 0; s < numShards; s++) {
+            int start = shards[s].outgoing.count;
+            int count = 0;
+            pushInt(&shards[s].outgoing, q);
+            pushInt(&shards[s].outgoing, 0);
+            for (int k = 0; k < friends[q].count; k++) {
+                if (shardOf(friends[q].data[k], numShards) == s) {
+                    pushInt(&shards[s].outgoing, friends[q].data[k]);
+                    count++;
+                }
+            }
+            if (count == 0) {
+                shards[s].outgoing.count = start;
+            } else {
+                shards[s].outgoing.data[start + 1] = count;
+            }
+        }
+    }
+    flushShardRequests(shards, numShards, SHARD_EXPAND, sent, bytesMoved);
 
-        // Find the friend index
-        for (int i = 0; i < graph->numUsers; i++) {
-            if (strcmp(graph->adjacencyList[i]->name, current->name) == 0) {
-                friendIndex = i;
-                break;
+    // Merge the per-shard partial counts; the same rules as computeRecommendations apply
+    int* mutual = (int*)checkedAlloc(calloc(numUsers, sizeof(int)));
+    IntBuffer* partial = (IntBuffer*)checkedAlloc(calloc(numQueries, sizeof(IntBuffer)));
+    for (int s = 0; s < numShards; s++) {
+        if (!sent[s]) {
+            continue;
+        }
+        receiveShardMessage(shards[s].fd, &reply);
+        *bytesMoved += sizeof(ShardHeader) + reply.count * sizeof(int);
+        int i = 0;
+        while (i < reply.count) {
+            int tag = reply.data[i], candidates = reply.data[i + 1];
+            for (int k = 0; k < 2 * candidates; k++) {
+                pushInt(&partial[tag], reply.data[i + 2 + k]);
+            }
+            i += 2 + 2 * candidates;
+        }
+    }
+    for (int q = 0; q < numQueries; q++) {
+        mutual[queries[q]] = -1;
+        for (int k = 0; k < friends[q].count; k++) {
+            mutual[friends[q].data[k]] = -1;
+        }
+        int count = 0, best = -1;
+        for (int k = 0; k < partial[q].count; k += 2) {
+            int candidateId = partial[q].data[k];
+            if (mutual[candidateId] < 0) {
+                continue;
+            }
+            if (mutual[candidateId] == 0) {
+                count++;
             }
+            mutual[candidateId] += partial[q].data[k + 1];
+        }
+        for (int k = 0; k < partial[q].count; k += 2) {
+            int candidateId = partial[q].data[k];
+            if (mutual[candidateId] > 0) {
+                if (best == -1 || mutual[candidateId] > mutual[best] ||
+                    (mutual[candidateId] == mutual[best] && candidateId < best)) {
+                    best = candidateId;
+                }
+            }
+        }
+        // Reset only what this query touched
+        for (int k = 0; k < partial[q].count; k += 2) {
+            mutual[partial[q].data[k]] = 0;
         }
+        mutual[queries[q]] = 0;
+        for (int k = 0; k < friends[q].count; k++) {
+            mutual[friends[q].data[k]] = 0;
+        }
+        results[q] = count;
+        topUser[q] = best;
+        free(friends[q].data);
+        free(partial[q].data);
+    }
+
+    free(mutual);
+    free(partial);
+    free(friends);
+    free(reply.data);
+    free(sent);
+}
+
+// Function to stop every worker process
+void stopShards(ShardLink* shards, int numShards) {
+    for (int s = 0; s < numShards; s++) {
+        sendShardMessage(shards[s].fd, SHARD_QUIT, NULL);
+        close(shards[s].fd);
+        waitpid(shards[s].pid, NULL, 0);
+        free(shards[s].outgoing.data);
+    }
+    free(shards);
+}
+
+// Function to run the sharded demo: load a random graph into N workers and serve batched queries
+// Usage: shard [users] [friends per user] [shards] [queries] [verify]
+int runShardDemo(int argc, char* argv[]) {
+    int numUsers = argc > 2 ? atoi(argv[2]) : 100000;
+    int friendsPerUser = argc > 3 ? atoi(argv[3]) : 10;
+    int numShards = argc > 4 ? atoi(argv[4]) : 4;
+    int numQueries = argc > 5 ? atoi(argv[5]) : 20000;
+    int verify = argc > 6 && strcmp(argv[6], "verify") == 0;
+    if (numUsers < 2 || friendsPerUser < 0 || numShards < 1 || numQueries < 0) {
+        printf(RED "Usage: shard [users >= 2] [friends per user] [shards >= 1] [queries] [verify]\n" RESET);
+        return 1;
+    }
 
-        // Perform DFS from each friend
-        if (friendIndex != -1) {
-            dfs(graph, friendIndex, visited, recommendations, &recCount, user);
+    ShardLink* shards = startShards(numShards, numUsers);
+    Graph* reference = NULL;
+    if (verify) {
+        char name[MAX_NAME_LENGTH];
+        reference = createGraph();
+        for (int i = 0; i < numUsers; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            addUser(reference, name);
         }
+    }
 
-        current = current->next;
+    // Load: each endpoint of a friendship goes to its owner shard, so edges are
+    // deduplicated in the worker; self-loops are skipped like connectUsers does
+    unsigned int seed = 2024;
+    double start = nowSeconds();
+    long numEdges = (long)numUsers * friendsPerUser / 2;
+    for (long i = 0; i < numEdges; i++) {
+        int a = rand_r(&seed) % numUsers, b = rand_r(&seed) % numUsers;
+        if (a == b) {
+            continue;
+        }
+        shardAddConnection(shards, numShards, a, b);
+        if (reference) {
+            connectUsers(reference, a, b);
+        }
     }
+    long loadBytes = 0;
+    int* sent = (int*)checkedAlloc(malloc(numShards * sizeof(int)));
+    flushShardRequests(shards, numShards, SHARD_ADD_EDGES, sent, &loadBytes);
+    free(sent);
+    double loadTime = nowSeconds() - start;
 
-    // Print recommendations
-    printf(YELLOW "Friend recommendations for %s:\n" RESET, user);
-    if (recCount == 0) {
-        printf(RED "None\n" RESET);
-    } else {
-        for (int i = 0; i < recCount; i++) {
-            printf(GREEN "%s\n" RESET, recommendations[i]);
+    // Query in batches so cross-shard traffic is two messages per shard per batch
+    int batchSize = 256;
+    int* queries = (int*)checkedAlloc(malloc(batchSize * sizeof(int)));
+    int* results = (int*)checkedAlloc(malloc(batchSize * sizeof(int)));
+    int* topUser = (int*)checkedAlloc(malloc(batchSize * sizeof(int)));
+    Recommendation* expected = reference ? (Recommendation*)checkedAlloc(malloc(numUsers * sizeof(Recommendation))) : NULL;
+    long bytesMoved = 0, mismatches = 0;
+    double verifyTime = 0;
+    start = nowSeconds();
+    for (int done = 0; done < numQueries; done += batchSize) {
+        int count = numQueries - done < batchSize ? numQueries - done : batchSize;
+        for (int q = 0; q < count; q++) {
+            queries[q] = rand_r(&seed) % numUsers;
+        }
+        shardRecommendBatch(shards, numShards, numUsers, queries, count, results, topUser, &bytesMoved);
+        double verifyStart = nowSeconds();
+        for (int q = 0; reference && q < count; q++) {
+            int expectedCount = computeRecommendations(reference, queries[q], expected);
+            int expectedTop = expectedCount > 0 ? expected[0].userId : -1;
+            if (expectedCount != results[q] || expectedTop != topUser[q]) {
+                mismatches++;
+            }
+        }
+        verifyTime += nowSeconds() - verifyStart;
+    }
+    double queryTime = nowSeconds() - start - verifyTime;
+
+    printf(BOLD "Sharded graph: %d users, ~%ld friendships, %d shard processes\n" RESET, numUsers, numEdges, numShards);
+    printf(GREEN "Load:    %.2f s\n" RESET, loadTime);
+    printf(GREEN "Queries: %.0f recommendations/s (%d queries, batches of %d)\n" RESET,
+           numQueries / queryTime, numQueries, batchSize);
+    printf(CYAN "Cross-shard traffic: %.1f KB per query\n" RESET, numQueries ? bytesMoved / 1024.0 / numQueries : 0.0);
+    if (reference) {
+        if (mismatches == 0) {
+            printf(GREEN "Verified against single-process recommendations.\n" RESET);
+        } else {
+            printf(RED "%ld queries differ from single-process recommendations!\n" RESET, mismatches);
         }
+        freeGraph(reference);
+        free(expected);
     }
+
+    stopShards(shards, numShards);
+    free(queries);
+    free(results);
+    free(topUser);
+    return mismatches == 0 ? 0 : 1;
 }
-// Function to display the adjacency matrix
-void displayAdjacencyMatrix(Graph* graph) {
-    printf("\n" MAGENTA "Adjacency Matrix:\n" RESET);
-    printf("        ");
-    for (int i = 0; i < graph->numUsers; i++) {
-        printf(YELLOW "%-10s" RESET, graph->adjacencyList[i]->name);
+
+// Function to build the MinHash index from the current graph; connectUsers keeps it current afterwards
+void enableMinHash(Graph* graph) {
+    if (graph->minHash != NULL) {
+        return;
     }
-    printf("\n");
+    MinHashIndex* index = createMinHashIndex(graph->capacity);
 
-    for (int i = 0; i < graph->numUsers; i++) {
-        printf(CYAN "%-10s" RESET, graph->adjacencyList[i]->name);
-        for (int j = 0; j < graph->numUsers; j++) {
-            int found = 0;
-            Node* current = graph->adjacencyList[i]->next;
-            // Check for connection
-            while (current != NULL) {
-                if (strcmp(current->name, graph->adjacencyList[j]->name) == 0) {
-                    found = 1;
-                    break;
+    // Bulk build: finish each signature first, then file the user once per band
+    for (int u = 0; u < graph->numUsers; u++) {
+        NeighborIterator it = neighbors(graph, u);
+        int friendId;
+        while (nextNeighbor(&it, &friendId)) {
+            for (int i = 0; i < MINHASH_FUNCTIONS; i++) {
+                unsigned int h = minHashFunction(i, friendId);
+                if (h < index->signatures[u][i]) {
+                    index->signatures[u][i] = h;
                 }
-                current = current->next;
             }
+        }
+        if (graph->adjacency[u].degree > 0) {
+            for (int band = 0; band < LSH_BANDS; band++) {
+                fileUser(index, u, band);
+            }
+        }
+    }
+    graph->minHash = index;
+}
+
+// Function to estimate the Jaccard similarity of two users' friend sets from their signatures
+double estimateJaccard(const MinHashIndex* index, int user1Id, int user2Id) {
+    int matches = 0;
+    for (int i = 0; i < MINHASH_FUNCTIONS; i++) {
+        matches += index->signatures[user1Id][i] == index->signatures[user2Id][i];
+    }
+    return (double)matches / MINHASH_FUNCTIONS;
+}
+
+// Function to order similar users by estimated similarity, then by user ID
+int compareSimilarUsers(const void* a, const void* b) {
+    const SimilarUser* sa = (const SimilarUser*)a;
+    const SimilarUser* sb = (const SimilarUser*)b;
+    if (sa->similarity != sb->similarity) {
+        return sa->similarity < sb->similarity ? 1 : -1;
+    }
+    return sa->userId - sb->userId;
+}
+
+// Function to return up to k non-friends with the highest estimated Jaccard similarity
+// Only users sharing an LSH bucket with the user are scored, so the cost depends on bucket sizes, not on numUsers
+int computeApproximateRecommendations(const Graph* graph, int userId, SimilarUser* out, int k) {
+    OP_STATS_START(timer);
+    const MinHashIndex* index = graph->minHash;
+    int* candidates = NULL;
+    int count = 0, capacity = 0;
+
+    // Gather everyone filed in the same bucket as the user in any band
+    for (int band = 0; band < LSH_BANDS; band++) {
+        int b = index->bucketOf[userId][band];
+        if (b == -1) {
+            continue;
+        }
+        const LshBucket* bucket = &index->buckets[b];
+        if (count + bucket->count > capacity) {
+            capacity = (count + bucket->count) * 2;
+            candidates = (int*)checkedAlloc(realloc(candidates, capacity * sizeof(int)));
+        }
+        memcpy(candidates + count, bucket->users, bucket->count * sizeof(int));
+        count += bucket->count;
+    }
+    if (count > 0) {
+        qsort(candidates, count, sizeof(int), compareInts);
+    }
+
+    // Score each distinct candidate, skipping the user and existing friends
+    // Both lists are sorted, so one pass over the friend list finds every friend among the candidates
+    SimilarUser* scored = (SimilarUser*)checkedAlloc(malloc((count > 0 ? count : 1) * sizeof(SimilarUser)));
+    int scoredCount = 0;
+    NeighborIterator friends = neighbors(graph, userId);
+    int friendId = -1;
+    int moreFriends = nextNeighbor(&friends, &friendId);
+    for (int i = 0; i < count; i++) {
+        int candidateId = candidates[i];
+        while (moreFriends && friendId < candidateId) {
+            moreFriends = nextNeighbor(&friends, &friendId);
+        }
+        if ((i > 0 && candidateId == candidates[i - 1]) || candidateId == userId ||
+            (moreFriends && friendId == candidateId)) {
+            continue;
+        }
+        scored[scoredCount].userId = candidateId;
+        scored[scoredCount++].similarity = estimateJaccard(index, userId, candidateId);
+    }
+    qsort(scored, scoredCount, sizeof(SimilarUser), compareSimilarUsers);
+
+    int result = scoredCount < k ? scoredCount : k;
+    memcpy(out, scored, result * sizeof(SimilarUser));
+    free(scored);
+    free(candidates);
+    OP_STATS_STOP(OP_MINHASH_RECOMMENDATIONS, timer);
+    return result;
+}
+
+// Function to rank exact recommendations by true Jaccard similarity, for checking the approximation
+// Any non-friend with a non-zero similarity shares a friend, so the exact friend-of-friend list covers them all
+int computeExactSimilarUsers(const Graph* graph, int userId, SimilarUser* out, int k) {
+    Recommendation* recommendations = (Recommendation*)checkedAlloc(malloc(graph->numUsers * sizeof(Recommendation)));
+    int recCount = computeRecommendations(graph, userId, recommendations);
+    int userDegree = graph->adjacency[userId].degree;
+    SimilarUser* scored = (SimilarUser*)checkedAlloc(malloc((recCount > 0 ? recCount : 1) * sizeof(SimilarUser)));
+    for (int i = 0; i < recCount; i++) {
+        int candidateId = recommendations[i].userId;
+        int shared = recommendations[i].mutualFriends;
+        scored[i].userId = candidateId;
+        scored[i].similarity = (double)shared / (userDegree + graph->adjacency[candidateId].degree - shared);
+    }
+    qsort(scored, recCount, sizeof(SimilarUser), compareSimilarUsers);
+    int result = recCount < k ? recCount : k;
+    memcpy(out, scored, result * sizeof(SimilarUser));
+    free(scored);
+    free(recommendations);
+    return result;
+}
+
+// Function to show exact and MinHash recommendations side by side with their latencies
+void compareRecommendationMethods(Graph* graph, char* user) {
+    int userIndex = findUser(graph, user);
+    if (userIndex == -1) {
+        printf(RED "Error: User %s not found.\n" RESET, user);
+        return;
+    }
+
+    SimilarUser exact[MINHASH_TOP_K], approximate[MINHASH_TOP_K];
+    double start = nowSeconds();
+    int exactCount = computeExactSimilarUsers(graph, userIndex, exact, MINHASH_TOP_K);
+    double exactTime = nowSeconds() - start;
+    start = nowSeconds();
+    int approximateCount = computeApproximateRecommendations(graph, userIndex, approximate, MINHASH_TOP_K);
+    double approximateTime = nowSeconds() - start;
+
+    printf(YELLOW "Top %d similar users for %s:\n" RESET, MINHASH_TOP_K, user);
+    printf(CYAN "%-4s %-22s %-8s %-22s %-8s\n" RESET, "#", "Exact", "Jaccard", "MinHash/LSH", "Estimate");
+    int rows = exactCount > approximateCount ? exactCount : approximateCount;
+    if (rows == 0) {
+        printf(RED "None\n" RESET);
+    }
+    for (int i = 0; i < rows; i++) {
+        printf("%-4d ", i + 1);
+        if (i < exactCount) {
+            printf(GREEN "%-22s" RESET " %-8.3f ", graph->names[exact[i].userId], exact[i].similarity);
+        } else {
+            printf("%-22s %-8s ", "", "");
+        }
+        if (i < approximateCount) {
+            printf(GREEN "%-22s" RESET " %-8.3f", graph->names[approximate[i].userId], approximate[i].similarity);
+        }
+        printf("\n");
+    }
+    printf(BLUE "Exact: %.1f us, MinHash/LSH: %.1f us\n" RESET, exactTime * 1e6, approximateTime * 1e6);
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark harness: synthetic graph generators plus timing of ingestion,
+// recommendation latency and memory per edge, appended to a CSV file.
+// ---------------------------------------------------------------------------
+
+// Synthetic graph models
+typedef enum GraphModel {
+    MODEL_ERDOS_RENYI,   // Uniform random endpoints
+    MODEL_RMAT,          // Recursive matrix, power-law degrees
+    MODEL_SMALL_WORLD    // Watts-Strogatz ring lattice with rewiring
+} GraphModel;
+
+const char* graphModelNames[] = { "erdos-renyi", "rmat", "small-world" };
+
+// Function to draw a 64-bit pseudo-random number (xorshift64*)
+unsigned long long nextRandom(unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+// Function to draw a uniform double in [0, 1)
+double randomUnit(unsigned long long* state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
 
-            // Print the connection status
-            if (found) {
-                printf(GREEN "%-10d" RESET, 1); // Connection exists
+// Function to pick one R-MAT endpoint pair by descending the quadrants of the adjacency matrix
+void rmatEdge(int numUsers, unsigned long long* state, int* from, int* to) {
+    const double a = 0.57, b = 0.19, c = 0.19;   // d = 0.05
+    int scale = 1;
+    while ((1 << scale) < numUsers) {
+        scale++;
+    }
+    do {
+        int row = 0, column = 0;
+        for (int level = 0; level < scale; level++) {
+            double r = randomUnit(state);
+            row <<= 1;
+            column <<= 1;
+            if (r < a) {
+                // Top-left quadrant
+            } else if (r < a + b) {
+                column |= 1;
+            } else if (r < a + b + c) {
+                row |= 1;
             } else {
-                printf(RED "%-10d" RESET, 0);   // No connection
+                row |= 1;
+                column |= 1;
             }
         }
-        printf("\n");
+        *from = row;
+        *to = column;
+    } while (*from >= numUsers || *to >= numUsers);
+}
+
+// Function to generate undirected friendships for a model; returns the edge count and sets *edges
+// The list can contain self-loops and duplicates; connectUsers drops them like the interactive path does
+long generateEdges(GraphModel model, int numUsers, int averageDegree, unsigned long long seed, DirectedEdge** edges) {
+    long numEdges = (long)numUsers * averageDegree / 2;
+    unsigned long long state = seed ? seed : 1;
+    *edges = (DirectedEdge*)checkedAlloc(malloc((numEdges > 0 ? numEdges : 1) * sizeof(DirectedEdge)));
+
+    if (model == MODEL_SMALL_WORLD) {
+        // Ring lattice: each user links to averageDegree / 2 successors; each link is rewired with p = 0.1
+        int half = averageDegree / 2 > 0 ? averageDegree / 2 : 1;
+        long count = 0;
+        for (int u = 0; u < numUsers && count < numEdges; u++) {
+            for (int k = 1; k <= half && count < numEdges; k++) {
+                int v = (u + k) % numUsers;
+                if (randomUnit(&state) < 0.1) {
+                    v = (int)(nextRandom(&state) % numUsers);
+                }
+                (*edges)[count].from = u;
+                (*edges)[count++].to = v;
+            }
+        }
+        return count;
+    }
+
+    for (long i = 0; i < numEdges; i++) {
+        if (model == MODEL_RMAT) {
+            rmatEdge(numUsers, &state, &(*edges)[i].from, &(*edges)[i].to);
+        } else {
+            (*edges)[i].from = (int)(nextRandom(&state) % numUsers);
+            (*edges)[i].to = (int)(nextRandom(&state) % numUsers);
+        }
     }
+    return numEdges;
 }
 
-// Function to display connections
-void displayConnections(Graph* graph) {
-    printf("\n" MAGENTA "Connections:\n" RESET);
+// Function to compare doubles for qsort
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to read a percentile from sorted samples
+double percentile(const double* sorted, int count, double p) {
+    if (count == 0) {
+        return 0;
+    }
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+// Function to benchmark one generated graph and append a CSV row to the results file
+void benchmarkModel(GraphModel model, int numUsers, int averageDegree, int numQueries, FILE* results) {
+    DirectedEdge* edges;
+    long generated = generateEdges(model, numUsers, averageDegree, 42, &edges);
+
+    // Ingestion through the same name lookups addUser/addConnection use, minus the console output
+    char (*names)[MAX_NAME_LENGTH] = checkedAlloc(malloc((size_t)numUsers * MAX_NAME_LENGTH));
+    for (int i = 0; i < numUsers; i++) {
+        snprintf(names[i], MAX_NAME_LENGTH, "user%d", i);
+    }
+    Graph* graph = createGraph();
+    double start = nowSeconds();
+    for (int i = 0; i < numUsers; i++) {
+        addUser(graph, names[i]);
+    }
+    double userTime = nowSeconds() - start;
+    long friendships = 0;
+    start = nowSeconds();
+    for (long i = 0; i < generated; i++) {
+        int user1Id = findUser(graph, names[edges[i].from]);
+        int user2Id = findUser(graph, names[edges[i].to]);
+        if (connectUsers(graph, user1Id, user2Id) == 1) {
+            friendships++;
+        }
+    }
+    double edgeTime = nowSeconds() - start;
+
+    // Memory per friendship: encoded bytes and allocated bytes (both ends of every edge)
+    long usedBytes = 0, allocatedBytes = 0;
+    int maxDegree = 0;
     for (int i = 0; i < graph->numUsers; i++) {
-        Node* current = graph->adjacencyList[i];
-        printf(YELLOW "%s:" RESET, current->name);
-        
-        current = current->next; // Move to the first friend
-        if (current == NULL) {
-            printf(RED " No connections\n" RESET); // No connections
-        } else {
-            printf(" ");
-            while (current != NULL) {
-                printf(GREEN "%s" RESET, current->name); // Print friends in green
-                current = current->next;
-                if (current != NULL) {
-                    printf(", "); // Separate friends with a comma
+        usedBytes += graph->adjacency[i].length;
+        allocatedBytes += graph->adjacency[i].capacity;
+        if (graph->adjacency[i].degree > maxDegree) {
+            maxDegree = graph->adjacency[i].degree;
+        }
+    }
+    double bytesPerEdge = friendships ? (double)usedBytes / friendships : 0;
+    double allocatedPerEdge = friendships ? (double)(allocatedBytes + graph->numUsers * sizeof(AdjacencyList)) / friendships : 0;
+
+    // Recommendation latency distribution over random users
+    unsigned long long state = 7;
+    double* latencies = (double*)checkedAlloc(malloc((numQueries > 0 ? numQueries : 1) * sizeof(double)));
+    Recommendation* out = (Recommendation*)checkedAlloc(malloc(graph->numUsers * sizeof(Recommendation)));
+    for (int q = 0; q < numQueries; q++) {
+        int userId = (int)(nextRandom(&state) % graph->numUsers);
+        double queryStart = nowSeconds();
+        computeRecommendations(graph, userId, out);
+        latencies[q] = (nowSeconds() - queryStart) * 1e6;
+    }
+    qsort(latencies, numQueries, sizeof(double), compareDoubles);
+    double p50 = percentile(latencies, numQueries, 0.50);
+    double p99 = percentile(latencies, numQueries, 0.99);
+
+    // MinHash/LSH: index build, query latency and recall against the exact Jaccard top-k
+    start = nowSeconds();
+    enableMinHash(graph);
+    double minHashBuildTime = nowSeconds() - start;
+    SimilarUser exact[MINHASH_TOP_K], approximate[MINHASH_TOP_K];
+    long relevant = 0, found = 0;
+    state = 7;
+    for (int q = 0; q < numQueries; q++) {
+        int userId = (int)(nextRandom(&state) % graph->numUsers);
+        double queryStart = nowSeconds();
+        int approximateCount = computeApproximateRecommendations(graph, userId, approximate, MINHASH_TOP_K);
+        latencies[q] = (nowSeconds() - queryStart) * 1e6;
+        int exactCount = computeExactSimilarUsers(graph, userId, exact, MINHASH_TOP_K);
+        relevant += exactCount;
+        for (int i = 0; i < exactCount; i++) {
+            for (int j = 0; j < approximateCount; j++) {
+                if (approximate[j].userId == exact[i].userId) {
+                    found++;
+                    break;
                 }
             }
-            printf("\n");
         }
     }
+    qsort(latencies, numQueries, sizeof(double), compareDoubles);
+    double minHashP50 = percentile(latencies, numQueries, 0.50);
+    double minHashP99 = percentile(latencies, numQueries, 0.99);
+    double recall = relevant ? (double)found / relevant : 1.0;
+
+    // The adjacency matrix is O(users^2) output, so only time it on small graphs, printed to /dev/null
+    double matrixTime = -1;
+    if (numUsers <= MATRIX_BENCH_LIMIT) {
+        fflush(stdout);
+        int savedStdout = dup(STDOUT_FILENO);
+        FILE* devNull = freopen("/dev/null", "w", stdout);
+        start = nowSeconds();
+        displayAdjacencyMatrix(graph);
+        fflush(stdout);
+        matrixTime = nowSeconds() - start;
+        if (devNull != NULL) {
+            dup2(savedStdout, STDOUT_FILENO);
+        }
+        close(savedStdout);
+    }
+
+    printf(BOLD "%s" RESET ": %d users, %ld friendships, max degree %d\n", graphModelNames[model], numUsers, friendships, maxDegree);
+    printf("  addUser:          %.0f users/s\n", numUsers / userTime);
+    printf("  addConnection:    %.0f edges/s\n", generated / edgeTime);
+    printf("  recommendations:  p50 %.1f us, p99 %.1f us (%d queries)\n", p50, p99, numQueries);
+    printf("  MinHash/LSH:      p50 %.1f us, p99 %.1f us, recall@%d %.2f, index build %.2f s\n",
+           minHashP50, minHashP99, MINHASH_TOP_K, recall, minHashBuildTime);
+    if (matrixTime >= 0) {
+        printf("  adjacency matrix: %.1f ms\n", matrixTime * 1e3);
+    }
+    printf("  memory:           %.2f encoded / %.2f allocated bytes per friendship\n", bytesPerEdge, allocatedPerEdge);
+
+    fprintf(results, "%ld,%s,%d,%ld,%.0f,%.0f,%.2f,%.2f,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f\n", (long)time(NULL),
+            graphModelNames[model], numUsers, friendships, numUsers / userTime, generated / edgeTime, p50, p99,
+            matrixTime >= 0 ? matrixTime * 1e3 : -1.0, bytesPerEdge, allocatedPerEdge, minHashP50, minHashP99, recall);
+
+    free(out);
+    free(latencies);
+    free(names);
+    free(edges);
+    freeGraph(graph);
+}
+
+// Function to run the benchmark harness
+// Usage: bench [er|rmat|smallworld|all] [users] [average degree] [queries] [results.csv]
+int runBenchmark(int argc, char* argv[]) {
+    const char* modelName = argc > 2 ? argv[2] : "all";
+    int numUsers = argc > 3 ? atoi(argv[3]) : 100000;
+    int averageDegree = argc > 4 ? atoi(argv[4]) : 16;
+    int numQueries = argc > 5 ? atoi(argv[5]) : 2000;
+    const char* resultsPath = argc > 6 ? argv[6] : "social_network_bench.csv";
+    opStatsSetEnabled(0); // The harness keeps its own latency figures; the clock reads would skew them
+
+    int first = 0, last = 2;
+    if (strcmp(modelName, "er") == 0) {
+        first = last = MODEL_ERDOS_RENYI;
+    } else if (strcmp(modelName, "rmat") == 0) {
+        first = last = MODEL_RMAT;
+    } else if (strcmp(modelName, "smallworld") == 0) {
+        first = last = MODEL_SMALL_WORLD;
+    } else if (strcmp(modelName, "all") != 0) {
+        first = -1; // Unknown model name
+    }
+    if (first < 0 || numUsers < 1 || averageDegree < 0 || numQueries < 0) {
+        printf(RED "Usage: bench [er|rmat|smallworld|all] [users] [average degree] [queries] [results.csv]\n" RESET);
+        return 1;
+    }
+
+    FILE* results = fopen(resultsPath, "a");
+    if (results == NULL) {
+        printf(RED "Error: Cannot open %s for writing.\n" RESET, resultsPath);
+        return 1;
+    }
+    if (ftell(results) == 0) {
+        fprintf(results, "timestamp,model,users,friendships,add_user_per_s,add_connection_per_s,"
+                         "rec_p50_us,rec_p99_us,matrix_ms,bytes_per_edge,allocated_bytes_per_edge,"
+                         "minhash_p50_us,minhash_p99_us,minhash_recall\n");
+    }
+    for (int model = first; model <= last; model++) {
+        benchmarkModel((GraphModel)model, numUsers, averageDegree, numQueries, results);
+    }
+    fclose(results);
+    printf(GREEN "Results appended to %s\n" RESET, resultsPath);
+    return 0;
 }
 
 // Function to display the menu and get user input
@@ -244,20 +2149,26 @@ void displayMenu() {
     printf("3. Get Friend Recommendations\n");
     printf("4. Add Connection\n");
     printf("5. Add New User\n");
-    printf("6. Exit\n");
+    printf("6. Compare Exact and MinHash Recommendations\n");
+    printf("7. Operation Statistics\n");
+    printf("8. Save Statistics\n");
+    printf("9. Exit\n");
     printf(BLUE "Select an option: " RESET);
 }
 
-// Function to print decorative lines
-void printLine(char ch, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", ch);
+// Main function
+int main(int argc, char* argv[]) {
+    opStatsInit("social_network", opNames, OP_COUNT);
+    if (argc > 1 && strcmp(argv[1], "stream") == 0) {
+        return runStreamDemo(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "shard") == 0) {
+        return runShardDemo(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return runBenchmark(argc, argv);
     }
-    printf("\n");
-}
 
-// Main function
-int main() {
     Graph* graph = createGraph();
 
     // Adding initial users
@@ -266,6 +2177,7 @@ int main() {
     addUser(graph, "Charlie");
     addUser(graph, "David");
     addUser(graph, "Eve");
+    enableMinHash(graph);
 
     // Establishing initial connections
     addConnection(graph, "Alice", "Bob");
@@ -275,6 +2187,7 @@ int main() {
 
     int choice;
     char user1[MAX_NAME_LENGTH], user2[MAX_NAME_LENGTH], user[MAX_NAME_LENGTH];
+    char path[256];
 
     while (1) {
         displayMenu();
@@ -302,21 +2215,33 @@ int main() {
             case 5:
                 printf("\n" BLUE "Enter the name of the new user: " RESET);
                 scanf("%s", user1);
-                addUser(graph, user1);
-                printf(GREEN "User %s added successfully.\n" RESET, user1);
+                if (addUser(graph, user1) == -1) {
+                    printf(RED "Error: User %s already exists.\n" RESET, user1);
+                } else {
+                    printf(GREEN "User %s added successfully.\n" RESET, user1);
+                }
                 break;
             case 6:
+                printf("\n" BLUE "Enter the name of the person to compare recommendations for: " RESET);
+                scanf("%s", user);
+                compareRecommendationMethods(graph, user);
+                break;
+            case 7:
+                opStatsPrint();
+                break;
+            case 8:
+                printf("\n" BLUE "Enter a file to save to (.json for JSON, other names for Prometheus text): " RESET);
+                scanf(" %255[^\n]", path);
+                if (opStatsSave(path)) {
+                    printf(GREEN "Statistics saved to %s\n" RESET, path);
+                } else {
+                    printf(RED "Could not write %s\n" RESET, path);
+                }
+                break;
+            case 9:
                 printf(RED "Exiting...\n" RESET);
                 // Free allocated memory
-                for (int i = 0; i < graph->numUsers; i++) {
-                    Node* current = graph->adjacencyList[i];
-                    while (current != NULL) {
-                        Node* temp = current;
-                        current = current->next;
-                        free(temp);
-                    }
-                }
-                free(graph);
+                freeGraph(graph);
                 exit(0);
             default:
                 printf(RED "Invalid choice. Please try again.\n" RESET);